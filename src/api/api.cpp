@@ -3,13 +3,67 @@
 #include <iostream>
 #include <format>
 #include <nlohmann/json.hpp>
+#include <future>
+#include <thread>
 #include <utility>
 
 static bool is_success(const cpr::Response& response) {
     return response.status_code >= 200 && response.status_code < 300;
 }
 
-static std::optional<cpr::Response> oauth_code_exchange(const OAuthAuthRequest& data, const std::string& base_url) {
+static cpr::Response cached_response(CachedResponse& cached) {
+    cpr::Response response;
+    response.status_code = 200;
+    response.text = std::move(cached.body);
+    return response;
+}
+
+static void configure_session(cpr::Session& session, const ApiRequest& request) {
+    cpr::Parameters query;
+
+    for (const auto& [key, value] : request.params) {
+        query.Add({key, value});
+    }
+
+    session.SetUrl(cpr::Url{request.url});
+    session.SetHeader(request.header);
+    session.SetParameters(std::move(query));
+    session.SetTimeout(cpr::Timeout{30000});
+    session.SetConnectTimeout(cpr::ConnectTimeout{10000});
+}
+
+// token requests count against the same host limit as everything else. only a 429 is
+// retried, like any other post
+static cpr::Response
+post_payload(SessionPool& sessions, RateLimiter& limiter, const std::string& url, const cpr::Payload& payload) {
+    for (int attempt = 0;; attempt++) {
+        limiter.acquire();
+
+        auto session = sessions.acquire();
+        session.discard();
+
+        session->SetUrl(cpr::Url{url});
+        session->SetHeader(cpr::Header{{"Accept", "application/json"}});
+        session->SetParameters(cpr::Parameters{});
+        session->SetPayload(cpr::Payload{payload});
+        session->SetTimeout(cpr::Timeout{30000});
+        session->SetConnectTimeout(cpr::ConnectTimeout{10000});
+
+        cpr::Response response = session->Post();
+        const auto delay = limiter.on_response(response, attempt);
+
+        if (!delay.has_value() || response.status_code != 429) {
+            return response;
+        }
+
+        std::cerr << "[api] retrying " << url << " in " << delay->count() << "ms (status=429)\n";
+        std::this_thread::sleep_for(*delay);
+    }
+}
+
+static std::optional<cpr::Response> oauth_code_exchange(
+    const OAuthAuthRequest& data, const std::string& base_url, SessionPool& sessions, RateLimiter& limiter
+) {
     const auto& id = data.client_id;
     const auto& secret = data.client_secret;
     const auto& code = data.code;
@@ -28,11 +82,12 @@ static std::optional<cpr::Response> oauth_code_exchange(const OAuthAuthRequest&
     }
 
     const auto url = std::format("{}/oauth/token", base_url);
-    return cpr::Post(cpr::Url{url}, cpr::Header{{"Accept", "application/json"}}, parameters);
+    return post_payload(sessions, limiter, url, parameters);
 }
 
-static std::optional<cpr::Response>
-oauth_refresh_access_token(const OAuthAuthRequest& data, const std::string& base_url) {
+static std::optional<cpr::Response> oauth_refresh_access_token(
+    const OAuthAuthRequest& data, const std::string& base_url, SessionPool& sessions, RateLimiter& limiter
+) {
     const auto& id = data.client_id;
     const auto& secret = data.client_secret;
     const auto& refresh_token = data.refresh_token;
@@ -51,11 +106,12 @@ oauth_refresh_access_token(const OAuthAuthRequest& data, const std::string& base
     }
 
     const auto url = std::format("{}/oauth/token", base_url);
-    return cpr::Post(cpr::Url{url}, cpr::Header{{"Accept", "application/json"}}, parameters);
+    return post_payload(sessions, limiter, url, parameters);
 }
 
-static std::optional<cpr::Response>
-oauth_client_credentials_grant(const OAuthAuthRequest& data, const std::string& base_url) {
+static std::optional<cpr::Response> oauth_client_credentials_grant(
+    const OAuthAuthRequest& data, const std::string& base_url, SessionPool& sessions, RateLimiter& limiter
+) {
     const auto& id = data.client_id;
     const auto& secret = data.client_secret;
 
@@ -72,17 +128,311 @@ oauth_client_credentials_grant(const OAuthAuthRequest& data, const std::string&
     };
 
     const auto url = std::format("{}/oauth/token", base_url);
-    return cpr::Post(cpr::Url{url}, cpr::Header{{"Accept", "application/json"}}, parameters);
+    return post_payload(sessions, limiter, url, parameters);
 }
 
-OAuthApi::OAuthApi(std::string url, OAuthAuthType type) : m_base_url(std::move(url)), m_auth_type(type) {}
+OAuthApi::OAuthApi(std::string url, OAuthAuthType type)
+    : m_base_url(std::move(url)), m_limiter(RateLimiter::for_host(m_base_url)), m_auth_type(type) {}
+
+OAuthApi::~OAuthApi() {
+    m_limiter->release(this);
+}
 
 bool OAuthApi::authenticate() {
-    if (has_valid_access_token()) {
-        return true;
+    return obtain_token(m_auth_type, nullptr, true);
+}
+
+std::optional<ApiRequest> OAuthApi::make_request(ApiMethod method, std::string_view endpoint, bool use_auth) {
+    if (use_auth && !authenticate()) {
+        return std::nullopt;
+    }
+
+    ApiRequest request;
+    request.method = method;
+    request.header = cpr::Header{{"Accept", "application/json"}};
+
+    if (use_auth) {
+        std::scoped_lock lock(m_token_mutex);
+        request.header["Authorization"] = "Bearer " + m_token_data.access_token;
+        request.identity = m_token_owner;
+    }
+
+    request.url =
+        endpoint.starts_with('/') ? m_base_url + std::string(endpoint) : m_base_url + "/" + std::string(endpoint);
+    return request;
+}
+
+cpr::Response OAuthApi::send(const ApiRequest& request) {
+    if (!m_cache || request.method != ApiMethod::GET) {
+        return fetch(request);
+    }
+
+    const auto key = response_cache::make_key("GET", request.url, request.params, request.identity);
+    auto cached = m_cache->load(key);
+
+    if (cached.has_value() && cached->is_fresh()) {
+        return cached_response(*cached);
+    }
+
+    cpr::Response response;
+
+    if (cached.has_value() && cached->has_validators()) {
+        ApiRequest conditional = request;
+
+        if (!cached->etag.empty()) {
+            conditional.header["If-None-Match"] = cached->etag;
+        }
+
+        if (!cached->last_modified.empty()) {
+            conditional.header["If-Modified-Since"] = cached->last_modified;
+        }
+
+        response = fetch(conditional);
+    } else {
+        response = fetch(request);
+    }
+
+    if (cached.has_value() && response.status_code == 304) {
+        m_cache->refresh(key, *cached, response);
+        return cached_response(*cached);
+    }
+
+    if (is_success(response)) {
+        m_cache->store(key, response, !request.identity.empty());
+        return response;
+    }
+
+    if (cached.has_value() && m_cache->get_options().serve_stale_on_error &&
+        (response.status_code == 0 || response.status_code >= 500)) {
+        std::cerr << "[api] serving stale response for " << request.url << " (status=" << response.status_code
+                  << ")\n";
+        return cached_response(*cached);
+    }
+
+    return response;
+}
+
+static bool is_cancelled(const ApiRequest& request) {
+    return request.cancel != nullptr && request.cancel->load(std::memory_order_relaxed);
+}
+
+static cpr::Response cancelled_response() {
+    cpr::Response response;
+    response.error.message = "cancelled";
+    return response;
+}
+
+cpr::Response OAuthApi::fetch(const ApiRequest& request) {
+    for (int attempt = 0;; attempt++) {
+        if (!m_limiter->acquire(request.cancel)) {
+            return cancelled_response();
+        }
+
+        cpr::Response response = perform(request);
+
+        if (is_cancelled(request)) {
+            return cancelled_response();
+        }
+
+        const auto delay = m_limiter->on_response(response, attempt);
+
+        // a post may have been applied before the failure, only a 429 guarantees it wasn't
+        if (!delay.has_value() || (request.method == ApiMethod::POST && response.status_code != 429)) {
+            return response;
+        }
+
+        std::cerr << "[api] retrying " << request.url << " in " << delay->count() << "ms (status=" << response.status_code
+                  << ")\n";
+
+        if (!rate_limit::sleep_until(std::chrono::steady_clock::now() + *delay, request.cancel)) {
+            return cancelled_response();
+        }
+    }
+}
+
+cpr::Response OAuthApi::perform(const ApiRequest& request) {
+    auto session = m_sessions->acquire();
+    configure_session(*session, request);
+
+    if (request.cancel != nullptr) {
+        // curl aborts the transfer once the callback says no. the callback would stick to
+        // a pooled session
+        session.discard();
+        const std::atomic<bool>* cancel = request.cancel;
+        session->SetProgressCallback(cpr::ProgressCallback{[cancel](int64_t, int64_t, int64_t, int64_t, intptr_t) {
+            return !cancel->load(std::memory_order_relaxed);
+        }});
+    }
+
+    switch (request.method) {
+        case ApiMethod::GET:
+            return session->Get();
+        case ApiMethod::POST:
+            session.discard();
+            session->SetBody(cpr::Body{request.body});
+            return session->Post();
+    }
+
+    return cpr::Response{};
+}
+
+bool OAuthApi::stream(const ApiRequest& request, json_stream::Parser& parser) {
+    std::string key;
+    std::optional<CachedResponse> cached;
+    ApiRequest conditional = request;
+
+    if (m_cache) {
+        key = response_cache::make_key("GET", request.url, request.params, request.identity);
+        cached = m_cache->load(key);
+
+        if (cached.has_value() && cached->is_fresh()) {
+            return parser.parse(cached->body);
+        }
+
+        if (cached.has_value() && !cached->etag.empty()) {
+            conditional.header["If-None-Match"] = cached->etag;
+        }
+
+        if (cached.has_value() && !cached->last_modified.empty()) {
+            conditional.header["If-Modified-Since"] = cached->last_modified;
+        }
+    }
+
+    cpr::Response response;
+    std::vector<uint8_t> compressed;
+    bool parsed = false;
+
+    for (int attempt = 0;; attempt++) {
+        // the raw body is compressed on the fly so the cache never needs the full text
+        auto tee = m_cache ? std::make_unique<binary::GzipWriter>() : nullptr;
+
+        if (!m_limiter->acquire(request.cancel)) {
+            return false;
+        }
+
+        response = perform_streamed(conditional, parser, parsed, tee.get());
+
+        if (is_cancelled(request)) {
+            return false;
+        }
+
+        const auto delay = m_limiter->on_response(response, attempt);
+
+        if (!delay.has_value()) {
+            if (tee && parsed) {
+                tee->finish(compressed);
+            }
+            break;
+        }
+
+        std::cerr << "[api] retrying " << request.url << " in " << delay->count() << "ms (status=" << response.status_code
+                  << ")\n";
+
+        if (!rate_limit::sleep_until(std::chrono::steady_clock::now() + *delay, request.cancel)) {
+            return false;
+        }
+    }
+
+    if (cached.has_value() && response.status_code == 304) {
+        m_cache->refresh(key, *cached, response);
+        return parser.parse(cached->body);
+    }
+
+    if (is_success(response)) {
+        if (parsed && m_cache && !compressed.empty()) {
+            m_cache->store_compressed(key, response, compressed, !request.identity.empty());
+        }
+        return parsed;
+    }
+
+    if (cached.has_value() && m_cache->get_options().serve_stale_on_error &&
+        (response.status_code == 0 || response.status_code >= 500)) {
+        std::cerr << "[api] serving stale response for " << request.url << " (status=" << response.status_code
+                  << ")\n";
+        return parser.parse(cached->body);
+    }
+
+    std::cerr << "[api] request failed: status=" << response.status_code << " error=" << response.error.message << "\n";
+    return false;
+}
+
+cpr::Response OAuthApi::perform_streamed(
+    const ApiRequest& request, json_stream::Parser& parser, bool& parsed, binary::GzipWriter* tee
+) {
+    auto session = m_sessions->acquire();
+    // the write callback would stick to a pooled session
+    session.discard();
+    configure_session(*session, request);
+
+    CURL* handle = session->GetCurlHolder()->handle;
+    json_stream::PipeBuffer pipe;
+    std::promise<bool> status_known;
+    bool decided = false;
+    bool streaming = false;
+    std::string error_body;
+
+    // runs on the download thread, the status line is in by the first body chunk
+    const auto decide = [&]() {
+        if (!decided) {
+            long status = 0;
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+            streaming = status >= 200 && status < 300;
+            decided = true;
+            status_known.set_value(streaming);
+        }
+    };
+
+    session->SetWriteCallback(cpr::WriteCallback{[&](const std::string_view& data, intptr_t) {
+        decide();
+
+        if (!streaming) {
+            error_body.append(data);
+            return true;
+        }
+
+        if (tee != nullptr) {
+            tee->append(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        }
+
+        return pipe.write(data);
+    }});
+
+    cpr::Response response;
+    std::thread download([&]() {
+        response = session->Get();
+        decide();
+        pipe.close();
+    });
+
+    // joins the download however the decoding ends, a decoder that throws included
+    struct DownloadGuard {
+        json_stream::PipeBuffer& pipe;
+        std::thread& download;
+
+        ~DownloadGuard() {
+            // unblocks the transfer when the decoder gave up early
+            pipe.cancel();
+            download.join();
+        }
+    };
+
+    parsed = false;
+
+    {
+        DownloadGuard guard{pipe, download};
+
+        // error bodies are kept as text, only 2xx bodies go through the decoder
+        if (status_known.get_future().get()) {
+            std::istream input(&pipe);
+            parsed = parser.parse(input);
+        }
     }
 
-    return get_or_refresh_access_token(m_auth_type, m_auth_data);
+    if (!streaming) {
+        response.text = std::move(error_body);
+    }
+
+    return response;
 }
 
 std::optional<nlohmann::json> OAuthApi::parse_response(const cpr::Response& response) {
@@ -104,7 +454,86 @@ std::optional<nlohmann::json> OAuthApi::parse_response(const cpr::Response& resp
     }
 }
 
-bool OAuthApi::store_token(const nlohmann::json& json) {
+// the "sub" claim of a jwt access token (the osu! user id), empty for anything else
+static std::string token_subject(std::string_view token) {
+    const size_t first = token.find('.');
+    const size_t second = first == std::string_view::npos ? first : token.find('.', first + 1);
+
+    if (second == std::string_view::npos) {
+        return "";
+    }
+
+    // base64url without padding
+    std::string payload;
+    uint32_t bits = 0;
+    int count = 0;
+
+    for (const char c : token.substr(first + 1, second - first - 1)) {
+        int value = -1;
+
+        if (c >= 'A' && c <= 'Z') {
+            value = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            value = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            value = c - '0' + 52;
+        } else if (c == '-' || c == '+') {
+            value = 62;
+        } else if (c == '_' || c == '/') {
+            value = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return "";
+        }
+
+        bits = (bits << 6) | static_cast<uint32_t>(value);
+        count += 6;
+
+        if (count >= 8) {
+            count -= 8;
+            payload.push_back(static_cast<char>((bits >> count) & 0xFF));
+        }
+    }
+
+    const auto json = nlohmann::json::parse(payload, nullptr, false);
+
+    if (!json.is_object() || !json.contains("sub")) {
+        return "";
+    }
+
+    const auto& subject = json["sub"];
+
+    if (subject.is_string()) {
+        return subject.get<std::string>();
+    }
+
+    return subject.is_number_integer() ? std::to_string(subject.get<int64_t>()) : "";
+}
+
+void OAuthApi::assign_token(std::string_view token, int32_t expiration_seconds, bool refreshed) {
+    m_token_data.access_token = token;
+    m_auth_timestamp = std::chrono::system_clock::now();
+    m_expiration_seconds = expiration_seconds;
+
+    // an app token sees the same data for everyone using that client
+    if (m_auth_type == OAuthAuthType::CLIENT_CREDENTIALS_GRANT && !m_auth_data.client_id.empty()) {
+        m_token_owner = "client:" + m_auth_data.client_id;
+        return;
+    }
+
+    const std::string subject = token_subject(token);
+
+    if (!subject.empty()) {
+        m_token_owner = "user:" + subject;
+    } else if (!refreshed || m_token_owner.empty()) {
+        // opaque token, it's the only thing that tells users apart. hashed, the key is
+        // stored in the entry
+        m_token_owner = "token:" + response_cache::hash(token);
+    }
+}
+
+bool OAuthApi::store_token(const nlohmann::json& json, bool refreshed) {
     if (!json.is_object()) {
         std::cerr << "[api] failed to store token (payload is not an object)\n";
         return false;
@@ -123,7 +552,8 @@ bool OAuthApi::store_token(const nlohmann::json& json) {
         return false;
     }
 
-    set_access_token(data.access_token, data.expires_in);
+    std::scoped_lock lock(m_token_mutex);
+    assign_token(data.access_token, data.expires_in, refreshed);
     if (!data.refresh_token.empty()) {
         m_token_data.refresh_token = data.refresh_token;
         m_auth_data.refresh_token = data.refresh_token;
@@ -133,42 +563,89 @@ bool OAuthApi::store_token(const nlohmann::json& json) {
 }
 
 bool OAuthApi::get_or_refresh_access_token(OAuthAuthType type, OAuthAuthRequest& data) {
+    return obtain_token(type, &data, false);
+}
+
+// only one token request runs at a time. the others wait for it, and authenticate() then
+// takes the token it got instead of asking for another one
+bool OAuthApi::obtain_token(OAuthAuthType type, OAuthAuthRequest* data, bool only_if_invalid) {
+    OAuthAuthRequest request;
+    {
+        std::unique_lock lock(m_token_mutex);
+        m_token_cv.wait(lock, [this] { return !m_refreshing; });
+
+        if (only_if_invalid && token_valid()) {
+            return true;
+        }
+
+        request = data != nullptr ? *data : m_auth_data;
+        m_refreshing = true;
+    }
+
+    // let the waiting callers go however this ends, a throw included
+    struct RefreshGuard {
+        OAuthApi& api;
+
+        ~RefreshGuard() {
+            {
+                std::scoped_lock lock(api.m_token_mutex);
+                api.m_refreshing = false;
+            }
+            api.m_token_cv.notify_all();
+        }
+    } guard{*this};
+
+    const bool exchanging = type == OAuthAuthType::CODE_GRANT && request.code.has_value() && !request.code->empty();
+    const auto json = request_token(type, request);
+
+    if (!json.has_value()) {
+        return false;
+    }
+
+    // clear code so next time we authenticate, we just refresh the token
+    if (exchanging) {
+        std::scoped_lock lock(m_token_mutex);
+        auto& target = data != nullptr ? *data : m_auth_data;
+
+        if (target.code.has_value()) {
+            target.code->clear();
+        }
+    }
+
+    return store_token(*json, type == OAuthAuthType::CODE_GRANT && !exchanging);
+}
+
+std::optional<nlohmann::json> OAuthApi::request_token(OAuthAuthType type, const OAuthAuthRequest& data) {
     cpr::Response response;
     switch (type) {
         case OAuthAuthType::CODE_GRANT: {
             // If a code is available, exchange it for an access and refresh token.
             // otherwise, just update the refresh token
             if (data.code.has_value() && !data.code->empty()) {
-                auto result = oauth_code_exchange(data, m_base_url);
+                auto result = oauth_code_exchange(data, m_base_url, *m_sessions, *m_limiter);
                 response = result.value_or(cpr::Response{});
             } else {
-                auto result = oauth_refresh_access_token(data, m_base_url);
+                auto result = oauth_refresh_access_token(data, m_base_url, *m_sessions, *m_limiter);
                 response = result.value_or(cpr::Response{});
             }
 
             break;
         }
         case OAuthAuthType::CLIENT_CREDENTIALS_GRANT: {
-            auto result = oauth_client_credentials_grant(data, m_base_url);
+            auto result = oauth_client_credentials_grant(data, m_base_url, *m_sessions, *m_limiter);
             response = result.value_or(cpr::Response{});
             break;
         }
     }
 
     if (!is_success(response)) {
-        return false;
+        return std::nullopt;
     }
 
-    const auto json = parse_response(response);
+    auto json = parse_response(response);
     if (!json.has_value()) {
         std::cout << "[api] get_or_refresh_access_token received invalid JSON\n";
-        return false;
-    }
-
-    // clear code so next time we authenticate, we just refresh the token
-    if (type == OAuthAuthType::CODE_GRANT && data.code.has_value() && !data.code->empty()) {
-        data.code->clear();
     }
 
-    return store_token(*json);
+    return json;
 }
@@ -1,11 +1,20 @@
 #pragma once
 
+#include "../utils/gzip.hpp"
 #include "../utils/query.hpp"
+#include "json_stream.hpp"
+#include "rate_limiter.hpp"
+#include "response_cache.hpp"
+#include "session_pool.hpp"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cpr/api.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <set>
@@ -33,6 +42,23 @@ enum class OAuthAuthType : int32_t {
     CLIENT_CREDENTIALS_GRANT
 };
 
+enum class ApiMethod : int32_t {
+    GET,
+    POST
+};
+
+struct ApiRequest {
+    ApiMethod method = ApiMethod::GET;
+    std::string url;
+    cpr::Header header;
+    query::Parameters params;
+    std::string body;
+    // checked while waiting and during the transfer, a set flag aborts the request
+    const std::atomic<bool>* cancel = nullptr;
+    // who the response belongs to, part of the cache key. empty for anonymous requests
+    std::string identity;
+};
+
 struct OAuthTokenData {
     std::string token_type;
     std::string access_token;
@@ -43,77 +69,120 @@ struct OAuthTokenData {
 class OAuthApi {
 public:
     OAuthApi(std::string url, OAuthAuthType type);
-    ~OAuthApi() = default;
+    ~OAuthApi();
+
+    OAuthApi(const OAuthApi&) = delete;
+    OAuthApi& operator=(const OAuthApi&) = delete;
 
     bool authenticate();
 
     void set_auth_data(const OAuthAuthRequest& data) {
+        std::scoped_lock lock(m_token_mutex);
         m_auth_data = data;
     }
 
     template <typename T>
-    std::optional<T> get(std::string_view endpoint, const query::Parameters& params, bool use_auth = true) {
-        if (use_auth && !authenticate()) {
+    std::optional<T> get(
+        std::string_view endpoint, const query::Parameters& params, bool use_auth = true,
+        const std::atomic<bool>* cancel = nullptr
+    ) {
+        auto request = make_request(ApiMethod::GET, endpoint, use_auth);
+        if (!request.has_value()) {
             return std::nullopt;
         }
 
-        cpr::Header header{{"Accept", "application/json"}};
-        if (use_auth) {
-            header["Authorization"] = "Bearer " + m_token_data.access_token;
-        }
-        cpr::Parameters query;
+        request->params = params;
+        request->cancel = cancel;
+        return parse_typed_response<T>(send(*request));
+    };
 
-        for (const auto& [key, value] : params) {
-            query.Add({key, value});
+    template <typename T>
+    std::optional<T> post(std::string_view endpoint, const nlohmann::json& body, bool use_auth = true) {
+        auto request = make_request(ApiMethod::POST, endpoint, use_auth);
+        if (!request.has_value()) {
+            return std::nullopt;
         }
 
-        const auto url =
-            endpoint.starts_with('/') ? m_base_url + std::string(endpoint) : m_base_url + "/" + std::string(endpoint);
-        return parse_typed_response<T>(
-            cpr::Get(cpr::Url{url}, header, query, cpr::Timeout{30000}, cpr::ConnectTimeout{10000})
-        );
+        request->header["Content-Type"] = "application/json";
+        request->body = body.dump();
+        return parse_typed_response<T>(send(*request));
     };
 
+    // like get(), but the body is decoded while it downloads instead of being buffered first
     template <typename T>
-    std::optional<T> post(std::string_view endpoint, const nlohmann::json& body, bool use_auth = true) {
-        if (use_auth && !authenticate()) {
+    std::optional<T> get_streamed(
+        std::string_view endpoint, const query::Parameters& params, json_stream::Decoder<T>& decoder,
+        bool use_auth = true
+    ) {
+        auto request = make_request(ApiMethod::GET, endpoint, use_auth);
+        if (!request.has_value()) {
             return std::nullopt;
         }
-        cpr::Header header{{"Accept", "application/json"}, {"Content-Type", "application/json"}};
-        if (use_auth) {
-            header["Authorization"] = "Bearer " + m_token_data.access_token;
+
+        request->params = params;
+        if (!stream(*request, decoder)) {
+            return std::nullopt;
         }
 
-        const auto url =
-            endpoint.starts_with('/') ? m_base_url + std::string(endpoint) : m_base_url + "/" + std::string(endpoint);
-        return parse_typed_response<T>(
-            cpr::Post(cpr::Url{url}, header, cpr::Body{body.dump()}, cpr::Timeout{30000}, cpr::ConnectTimeout{10000})
-        );
-    };
+        return decoder.take();
+    }
+
+    void set_connection_options(const SessionPoolOptions& options) {
+        m_sessions->set_options(options);
+    }
+
+    SessionPoolOptions get_connection_options() const {
+        return m_sessions->get_options();
+    }
+
+    // the limiter is shared with every api instance talking to the same host (token
+    // requests included). false when another instance already set different options
+    bool set_rate_limit_options(const RateLimiterOptions& options) {
+        return m_limiter->configure(options, this);
+    }
+
+    RateLimiterOptions get_rate_limit_options() const {
+        return m_limiter->get_options();
+    }
+
+    // GET responses are cached on disk once a directory is set (disabled by default)
+    void set_cache_options(const ResponseCacheOptions& options) {
+        m_cache = options.directory.empty() ? nullptr : std::make_unique<ResponseCache>(options);
+    }
+
+    void clear_cache() {
+        if (m_cache) {
+            m_cache->clear();
+        }
+    }
 
     bool get_or_refresh_access_token(OAuthAuthType type, OAuthAuthRequest& data);
 
     void set_access_token(std::string_view token, int32_t expiration_seconds) {
-        m_token_data.access_token = token;
-        m_auth_timestamp = std::chrono::system_clock::now();
-        m_expiration_seconds = expiration_seconds;
+        std::scoped_lock lock(m_token_mutex);
+        assign_token(token, expiration_seconds, false);
     }
 
     std::string get_access_token() const {
+        std::scoped_lock lock(m_token_mutex);
         return m_token_data.access_token;
     }
 
     bool is_access_token_expired() const {
-        constexpr auto skew = std::chrono::seconds(30);
-        auto expiration = m_auth_timestamp + std::chrono::seconds(m_expiration_seconds) - skew;
-        return expiration < std::chrono::system_clock::now();
+        std::scoped_lock lock(m_token_mutex);
+        return token_expired();
     }
 
     bool has_valid_access_token() const {
-        return !m_token_data.access_token.empty() && !is_access_token_expired();
+        std::scoped_lock lock(m_token_mutex);
+        return token_valid();
     }
 
 protected:
+    std::optional<ApiRequest> make_request(ApiMethod method, std::string_view endpoint, bool use_auth);
+    cpr::Response send(const ApiRequest& request);
+    bool stream(const ApiRequest& request, json_stream::Parser& parser);
+
     std::optional<nlohmann::json> parse_response(const cpr::Response& response);
 
     template <typename T>
@@ -132,19 +201,54 @@ protected:
         }
     }
 
-    bool store_token(const nlohmann::json& json);
+    // refreshed keeps the cache owner of the previous token when the new one doesn't name it
+    bool store_token(const nlohmann::json& json, bool refreshed = false);
 
 private:
+    // the helpers below expect m_token_mutex to be held
+    void assign_token(std::string_view token, int32_t expiration_seconds, bool refreshed);
+
+    bool token_expired() const {
+        constexpr auto skew = std::chrono::seconds(30);
+        auto expiration = m_auth_timestamp + std::chrono::seconds(m_expiration_seconds) - skew;
+        return expiration < std::chrono::system_clock::now();
+    }
+
+    bool token_valid() const {
+        return !m_token_data.access_token.empty() && !token_expired();
+    }
+
+    bool obtain_token(OAuthAuthType type, OAuthAuthRequest* data, bool only_if_invalid);
+    std::optional<nlohmann::json> request_token(OAuthAuthType type, const OAuthAuthRequest& data);
+    cpr::Response fetch(const ApiRequest& request);
+    cpr::Response perform(const ApiRequest& request);
+    cpr::Response
+    perform_streamed(const ApiRequest& request, json_stream::Parser& parser, bool& parsed, binary::GzipWriter* tee);
+
+    // guards the token state and m_auth_data, which the api threads read while one of
+    // them refreshes. m_refreshing marks the single token request in flight
+    mutable std::mutex m_token_mutex;
+    std::condition_variable m_token_cv;
+    bool m_refreshing = false;
+
     // last auth details
     TimePoint m_auth_timestamp{};
     int32_t m_expiration_seconds = 0;
 
     // auth data
     OAuthTokenData m_token_data{};
+    // cache identity of the token: the client for app tokens, the user id from the token
+    // otherwise. survives refreshes so cached responses don't go stale with every token
+    std::string m_token_owner;
 
     // base address
     std::string m_base_url{};
 
+    // reusable sessions for m_base_url
+    std::unique_ptr<SessionPool> m_sessions = std::make_unique<SessionPool>();
+    std::shared_ptr<RateLimiter> m_limiter;
+    std::unique_ptr<ResponseCache> m_cache;
+
     OAuthAuthType m_auth_type = OAuthAuthType::CODE_GRANT;
     OAuthAuthRequest m_auth_data{};
 };
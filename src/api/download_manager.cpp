@@ -0,0 +1,614 @@
+#include "download_manager.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cpr/cpr.h>
+#include <curl/curl.h>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <system_error>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+static std::string expand_template(const std::string& url_template, const std::string& key) {
+    std::string url = url_template;
+    const size_t position = url.find("{key}");
+
+    if (position != std::string::npos) {
+        url.replace(position, 5, key);
+    }
+
+    return url;
+}
+
+// feeds what a previous attempt already saved to the sink
+static bool replay_part(const std::filesystem::path& part, DownloadSink& sink) {
+    std::ifstream file(part, std::ios::binary);
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<char> buffer(1024 * 1024);
+
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const auto size = static_cast<size_t>(file.gcount());
+
+        if (size > 0 && !sink.write(buffer.data(), size)) {
+            return false;
+        }
+    }
+
+    return file.eof();
+}
+
+// total size from a "Content-Range: bytes */<total>" header, 0 when the server didn't send it
+static uint64_t content_range_total(const cpr::Header& header) {
+    const auto it = header.find("Content-Range");
+
+    if (it == header.end()) {
+        return 0;
+    }
+
+    const size_t slash = it->second.rfind('/');
+
+    if (slash == std::string::npos) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    const char* begin = it->second.data() + slash + 1;
+    const char* end = it->second.data() + it->second.size();
+    const auto [ptr, ec] = std::from_chars(begin, end, total);
+    return ec == std::errc() ? total : 0;
+}
+
+static std::filesystem::path part_path(const std::filesystem::path& destination) {
+    auto path = destination;
+    path += ".part";
+    return path;
+}
+
+DownloadManager::DownloadManager(std::vector<DownloadMirror> mirrors, DownloadManagerOptions options)
+    : m_options(std::move(options)), m_selector(mirrors.size(), m_options.selector) {
+    for (auto& mirror : mirrors) {
+        mirror.max_connections = std::max<size_t>(1, mirror.max_connections);
+        m_mirrors.push_back(MirrorSlot{std::move(mirror)});
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(m_options.directory, error);
+
+    const size_t workers = std::max<size_t>(1, m_options.max_concurrent);
+    for (size_t i = 0; i < workers; i++) {
+        m_workers.emplace_back([this]() { worker(); });
+    }
+}
+
+DownloadManager::~DownloadManager() {
+    cancel_all();
+
+    {
+        std::scoped_lock lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+std::shared_ptr<DownloadTask> DownloadManager::enqueue(
+    const std::string& key, const std::string& file_name, std::shared_ptr<DownloadSink> sink
+) {
+    auto task = std::make_shared<DownloadTask>();
+    task->key = key;
+    task->destination = m_options.directory / file_name;
+    task->sink = std::move(sink);
+
+    {
+        std::scoped_lock lock(m_mutex);
+        m_queue.push_back(task);
+        m_counters.queued++;
+    }
+
+    m_cv.notify_one();
+    return task;
+}
+
+void DownloadManager::wait() {
+    std::unique_lock lock(m_mutex);
+    m_idle_cv.wait(lock, [this] { return m_queue.empty() && m_running == 0; });
+}
+
+void DownloadManager::cancel_all() {
+    std::deque<std::shared_ptr<DownloadTask>> queued;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        queued.swap(m_queue);
+
+        for (const auto& task : m_active) {
+            task->cancelled = true;
+        }
+    }
+
+    for (const auto& task : queued) {
+        task->cancelled = true;
+        task->state = DownloadState::CANCELLED;
+        m_counters.queued--;
+    }
+
+    m_idle_cv.notify_all();
+}
+
+void DownloadManager::worker() {
+    while (true) {
+        std::shared_ptr<DownloadTask> task;
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+
+            if (m_queue.empty()) {
+                return;
+            }
+
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_active.push_back(task);
+            m_running++;
+        }
+
+        m_counters.queued--;
+        m_counters.active++;
+
+        run(*task);
+
+        m_counters.active--;
+
+        {
+            std::scoped_lock lock(m_mutex);
+            m_active.erase(std::find(m_active.begin(), m_active.end(), task));
+            m_running--;
+        }
+
+        m_idle_cv.notify_all();
+    }
+}
+
+void DownloadManager::run(DownloadTask& task) {
+    task.state = DownloadState::DOWNLOADING;
+    std::vector<bool> tried(m_mirrors.size(), false);
+    const auto part = part_path(task.destination);
+
+    while (!task.cancelled) {
+        const int32_t primary = acquire_mirror(tried, true);
+
+        if (primary < 0) {
+            break;
+        }
+
+        std::error_code error;
+        uint64_t offset = std::filesystem::exists(part, error) ? std::filesystem::file_size(part, error) : 0;
+
+        if (error) {
+            offset = 0;
+        }
+
+        task.downloaded = offset;
+
+        Race race;
+        std::array<Lane, 2> lanes;
+        launch(task, race, lanes[0], primary, offset);
+
+        bool hedge = false;
+        {
+            std::unique_lock lock(race.mutex);
+            hedge = m_options.hedge &&
+                    !race.cv.wait_for(lock, m_selector.hedge_delay(static_cast<size_t>(primary)), [&] {
+                        return race.winner >= 0 || race.finished == race.launched;
+                    });
+        }
+
+        if (hedge) {
+            const int32_t secondary = acquire_mirror(tried, false);
+
+            if (secondary >= 0 && race.winner >= 0) {
+                // the first mirror answered in the meantime
+                release_mirror(secondary);
+                tried[static_cast<size_t>(secondary)] = false;
+            } else if (secondary >= 0) {
+                launch(task, race, lanes[1], secondary, offset);
+            }
+        }
+
+        Lane* winner = nullptr;
+        {
+            std::unique_lock lock(race.mutex);
+            race.cv.wait(lock, [&] { return race.done || race.finished == race.launched; });
+
+            for (auto& lane : lanes) {
+                if (lane.result == AttemptResult::DONE) {
+                    winner = &lane;
+                }
+            }
+        }
+
+        // the loser still holds the task until it returns, its socket was shut down by
+        // the winner so this doesn't wait on a slow connection
+        std::string errors;
+        for (auto& lane : lanes) {
+            if (!lane.thread.joinable()) {
+                continue;
+            }
+
+            lane.thread.join();
+
+            if (lane.result == AttemptResult::LOST) {
+                // it never got to download anything, give it another chance
+                tried[static_cast<size_t>(lane.mirror)] = false;
+            }
+
+            if (!lane.error.empty()) {
+                errors += errors.empty() ? lane.error : ", " + lane.error;
+            }
+        }
+
+        if (winner != nullptr) {
+            task.mirror = m_mirrors[static_cast<size_t>(winner->mirror)].mirror.name;
+            task.total = task.downloaded.load();
+            task.state = DownloadState::COMPLETED;
+            m_counters.completed++;
+            return;
+        }
+
+        if (!errors.empty()) {
+            task.error = errors;
+        }
+
+        if (race.stale_part) {
+            std::filesystem::remove(part, error);
+        }
+    }
+
+    if (task.cancelled) {
+        task.state = DownloadState::CANCELLED;
+        return;
+    }
+
+    if (task.error.empty()) {
+        task.error = "no mirror available";
+    }
+
+    std::cerr << "[download] failed to download " << task.key << ": " << task.error << "\n";
+    task.state = DownloadState::FAILED;
+    m_counters.failed++;
+}
+
+void DownloadManager::launch(DownloadTask& task, Race& race, Lane& lane, int32_t index, uint64_t offset) {
+    int32_t id = 0;
+    {
+        std::scoped_lock lock(race.mutex);
+        id = race.launched++;
+    }
+
+    lane.mirror = index;
+    lane.thread = std::thread([this, &task, &race, &lane, index, offset, id]() {
+        const AttemptResult result = attempt(task, static_cast<size_t>(index), offset, race, id, lane.error);
+        release_mirror(index);
+
+        // run() reads the result under the lock once the race is decided
+        {
+            std::scoped_lock lock(race.mutex);
+            lane.result = result;
+            race.finished++;
+            race.done = race.done || result == AttemptResult::DONE;
+        }
+
+        race.cv.notify_all();
+    });
+}
+
+DownloadManager::AttemptResult DownloadManager::attempt(
+    DownloadTask& task, size_t mirror, uint64_t offset, Race& race, int32_t lane, std::string& error
+) {
+    using Clock = std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+
+    const DownloadMirror& config = m_mirrors[mirror].mirror;
+    const auto part = part_path(task.destination);
+
+    // declared before the session, curl closes the socket when the session goes away
+    LaneSocket lane_socket{&race, lane};
+    cpr::Session session;
+    CURL* handle = session.GetCurlHolder()->handle;
+
+    session.SetUrl(cpr::Url{expand_template(config.url_template, task.key)});
+    session.SetConnectTimeout(cpr::ConnectTimeout{m_options.connect_timeout});
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, static_cast<long>(m_options.low_speed_limit));
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, static_cast<long>(m_options.low_speed_time.count()));
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTFUNCTION, on_socket_open);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTDATA, &lane_socket);
+    curl_easy_setopt(handle, CURLOPT_CLOSESOCKETFUNCTION, on_socket_close);
+    curl_easy_setopt(handle, CURLOPT_CLOSESOCKETDATA, &lane_socket);
+
+    if (offset > 0) {
+        session.SetHeader(cpr::Header{{"Range", "bytes=" + std::to_string(offset) + "-"}});
+    }
+
+    const auto lost = [&race, lane]() {
+        const int32_t winner = race.winner.load();
+        return winner >= 0 && winner != lane;
+    };
+
+    std::ofstream file;
+    long status = 0;
+    bool write_failed = false;
+    bool sink_failed = false;
+    uint64_t received = 0;
+    const auto started = Clock::now();
+    std::optional<Clock::time_point> first_byte;
+
+    session.SetWriteCallback(cpr::WriteCallback{[&](const std::string_view& data, intptr_t) {
+        if (status == 0) {
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+
+            if (status == 200 || status == 206) {
+                first_byte = Clock::now();
+
+                // only the first mirror to answer touches the .part
+                int32_t expected = -1;
+                if (!race.winner.compare_exchange_strong(expected, lane)) {
+                    return false;
+                }
+
+                abort_losers(race, lane);
+                race.cv.notify_all();
+
+                if (status == 206) {
+                    file.open(part, std::ios::binary | std::ios::app);
+                } else {
+                    // the server ignored the range, start over
+                    offset = 0;
+                    task.downloaded = 0;
+                    file.open(part, std::ios::binary | std::ios::trunc);
+                }
+
+                if (!file.is_open()) {
+                    write_failed = true;
+                    return false;
+                }
+
+                if (task.sink) {
+                    task.sink->reset();
+
+                    if (offset > 0 && !replay_part(part, *task.sink)) {
+                        sink_failed = true;
+                        return false;
+                    }
+                }
+            }
+        }
+
+        // error bodies are dropped
+        if (status != 200 && status != 206) {
+            return true;
+        }
+
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+        if (!file) {
+            write_failed = true;
+            return false;
+        }
+
+        if (task.sink && !task.sink->write(data.data(), data.size())) {
+            sink_failed = true;
+            return false;
+        }
+
+        received += data.size();
+        task.downloaded.fetch_add(data.size(), std::memory_order_relaxed);
+        m_counters.bytes.fetch_add(data.size(), std::memory_order_relaxed);
+        return !task.cancelled.load(std::memory_order_relaxed);
+    }});
+
+    session.SetProgressCallback(cpr::ProgressCallback{[&](int64_t download_total, int64_t, int64_t, int64_t, intptr_t) {
+        if (download_total > 0 && race.winner.load() == lane) {
+            task.total.store(offset + static_cast<uint64_t>(download_total), std::memory_order_relaxed);
+        }
+        return !task.cancelled.load(std::memory_order_relaxed) && !lost();
+    }});
+
+    const cpr::Response response = session.Get();
+    const auto finished = Clock::now();
+    file.close();
+
+    if (task.cancelled) {
+        return AttemptResult::CANCELLED;
+    }
+
+    if (lost()) {
+        // slower than the other mirror, count how long it kept us waiting
+        m_selector.record_first_byte(mirror, duration_cast<milliseconds>(first_byte.value_or(finished) - started));
+        return AttemptResult::LOST;
+    }
+
+    if (write_failed) {
+        error = "failed to write " + part.string();
+        return AttemptResult::NEXT_MIRROR;
+    }
+
+    if (sink_failed) {
+        // most likely a broken file, get it again from somewhere else
+        std::scoped_lock lock(race.mutex);
+        race.stale_part = true;
+        error = config.name + ": rejected by the sink";
+        return AttemptResult::NEXT_MIRROR;
+    }
+
+    if (response.status_code == 416 && offset > 0 && content_range_total(response.header) == offset) {
+        // a previous run got the whole file but stopped before renaming the part
+        int32_t expected = -1;
+        if (!race.winner.compare_exchange_strong(expected, lane)) {
+            return AttemptResult::LOST;
+        }
+
+        abort_losers(race, lane);
+
+        if (task.sink) {
+            task.sink->reset();
+
+            if (!replay_part(part, *task.sink) || !task.sink->finish()) {
+                std::scoped_lock lock(race.mutex);
+                race.stale_part = true;
+                error = config.name + ": rejected by the sink";
+                return AttemptResult::NEXT_MIRROR;
+            }
+        }
+
+        std::error_code rename_error;
+        std::filesystem::rename(part, task.destination, rename_error);
+
+        if (rename_error) {
+            error = "failed to move " + part.string() + ": " + rename_error.message();
+            return AttemptResult::NEXT_MIRROR;
+        }
+
+        return AttemptResult::DONE;
+    }
+
+    if (response.status_code == 416 && offset > 0) {
+        // the part is larger than the file on this mirror (or it didn't say), don't trust it
+        std::scoped_lock lock(race.mutex);
+        race.stale_part = true;
+        error = config.name + ": range not satisfiable";
+        return AttemptResult::NEXT_MIRROR;
+    }
+
+    if ((response.status_code != 200 && response.status_code != 206) || response.error || !first_byte.has_value()) {
+        // the part stays, the next mirror resumes it
+        m_selector.record_failure(mirror);
+        error = config.name + ": status=" + std::to_string(response.status_code) + " " + response.error.message;
+        return AttemptResult::NEXT_MIRROR;
+    }
+
+    if (task.sink && !task.sink->finish()) {
+        std::scoped_lock lock(race.mutex);
+        race.stale_part = true;
+        error = config.name + ": rejected by the sink";
+        return AttemptResult::NEXT_MIRROR;
+    }
+
+    m_selector.record_first_byte(mirror, duration_cast<milliseconds>(*first_byte - started));
+    m_selector.record_transfer(mirror, received, duration_cast<milliseconds>(finished - *first_byte));
+
+    std::error_code rename_error;
+    std::filesystem::rename(part, task.destination, rename_error);
+
+    if (rename_error) {
+        error = "failed to move " + part.string() + ": " + rename_error.message();
+        return AttemptResult::NEXT_MIRROR;
+    }
+
+    return AttemptResult::DONE;
+}
+
+int DownloadManager::on_socket_open(void* data, curl_socket_t socket, curlsocktype) {
+    auto* owner = static_cast<LaneSocket*>(data);
+    std::scoped_lock lock(owner->race->mutex);
+
+    // another mirror won while this one was still connecting
+    const int32_t winner = owner->race->winner.load();
+    if (winner >= 0 && winner != owner->lane) {
+        return CURL_SOCKOPT_ERROR;
+    }
+
+    owner->race->sockets[static_cast<size_t>(owner->lane)] = socket;
+    return CURL_SOCKOPT_OK;
+}
+
+int DownloadManager::on_socket_close(void* data, curl_socket_t socket) {
+    auto* owner = static_cast<LaneSocket*>(data);
+    {
+        std::scoped_lock lock(owner->race->mutex);
+        auto& slot = owner->race->sockets[static_cast<size_t>(owner->lane)];
+
+        if (slot == socket) {
+            slot = CURL_SOCKET_BAD;
+        }
+    }
+
+#ifdef _WIN32
+    return closesocket(socket);
+#else
+    return close(socket);
+#endif
+}
+
+void DownloadManager::abort_losers(Race& race, int32_t winner) {
+    std::scoped_lock lock(race.mutex);
+
+    for (size_t i = 0; i < race.sockets.size(); i++) {
+        if (static_cast<int32_t>(i) == winner || race.sockets[i] == CURL_SOCKET_BAD) {
+            continue;
+        }
+
+#ifdef _WIN32
+        shutdown(race.sockets[i], SD_BOTH);
+#else
+        shutdown(race.sockets[i], SHUT_RDWR);
+#endif
+    }
+}
+
+int32_t DownloadManager::acquire_mirror(std::vector<bool>& tried, bool wait) {
+    std::unique_lock lock(m_mirror_mutex);
+
+    while (true) {
+        bool untried = false;
+
+        for (const size_t i : m_selector.rank()) {
+            if (tried[i]) {
+                continue;
+            }
+
+            untried = true;
+
+            if (m_mirrors[i].active < m_mirrors[i].mirror.max_connections) {
+                m_mirrors[i].active++;
+                tried[i] = true;
+                return static_cast<int32_t>(i);
+            }
+        }
+
+        if (!untried || !wait) {
+            return -1;
+        }
+
+        m_mirror_cv.wait(lock);
+    }
+}
+
+void DownloadManager::release_mirror(int32_t index) {
+    {
+        std::scoped_lock lock(m_mirror_mutex);
+        m_mirrors[static_cast<size_t>(index)].active--;
+    }
+
+    m_mirror_cv.notify_all();
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "mirror_selector.hpp"
+
+#include <array>
+#include <curl/curl.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct DownloadMirror {
+    std::string name;
+    std::string url_template;   // "{key}" is replaced with the download key (md5, set id...)
+    size_t max_connections = 2; // downloads allowed on this mirror at the same time
+};
+
+struct DownloadManagerOptions {
+    std::filesystem::path directory;
+    size_t max_concurrent = 4;
+    std::chrono::milliseconds connect_timeout{10000};
+    int64_t low_speed_limit = 1024; // bytes/s, below this for low_speed_time the transfer is dropped
+    std::chrono::seconds low_speed_time{30};
+    bool hedge = true; // race a second mirror when the first byte takes too long
+    MirrorSelectorOptions selector{};
+};
+
+enum class DownloadState : int32_t {
+    QUEUED,
+    DOWNLOADING,
+    COMPLETED,
+    FAILED,
+    CANCELLED
+};
+
+// receives the file while it downloads (e.g. to extract it on the fly). reset() is called
+// before the data starts over, a resumed download replays the .part first
+class DownloadSink {
+public:
+    virtual ~DownloadSink() = default;
+
+    virtual void reset() = 0;
+    virtual bool write(const char* data, size_t size) = 0;
+    // the whole file went through write(), false drops the download and tries the next mirror
+    virtual bool finish() = 0;
+};
+
+// shared with the ui, every counter can be read without locking.
+// error / mirror are written before state changes to COMPLETED / FAILED.
+struct DownloadTask {
+    std::string key;
+    std::filesystem::path destination;
+    std::shared_ptr<DownloadSink> sink;
+
+    std::atomic<DownloadState> state = DownloadState::QUEUED;
+    std::atomic<uint64_t> downloaded = 0; // bytes on disk, resumed ones included
+    std::atomic<uint64_t> total = 0;      // 0 while unknown
+    std::atomic<bool> cancelled = false;
+
+    std::string mirror;
+    std::string error;
+
+    float progress() const {
+        const uint64_t size = total.load(std::memory_order_relaxed);
+        return size == 0 ? 0.0f : static_cast<float>(downloaded.load(std::memory_order_relaxed)) / size;
+    }
+};
+
+struct DownloadCounters {
+    std::atomic<uint32_t> queued = 0;
+    std::atomic<uint32_t> active = 0;
+    std::atomic<uint32_t> completed = 0;
+    std::atomic<uint32_t> failed = 0;
+    std::atomic<uint64_t> bytes = 0; // received in this session
+};
+
+// downloads files into options.directory with a fixed number of workers. files are
+// written to "<name>.part" as data arrives and renamed once complete, a leftover
+// .part is resumed with a Range request. mirrors are picked by their health score,
+// skipping the ones that are at their connection limit. when the first byte takes
+// longer than the mirror usually needs, the next best mirror races it and whichever
+// answers first keeps the download while the other one is dropped.
+class DownloadManager {
+public:
+    DownloadManager(std::vector<DownloadMirror> mirrors, DownloadManagerOptions options);
+    ~DownloadManager();
+
+    DownloadManager(const DownloadManager&) = delete;
+    DownloadManager& operator=(const DownloadManager&) = delete;
+
+    std::shared_ptr<DownloadTask> enqueue(
+        const std::string& key, const std::string& file_name, std::shared_ptr<DownloadSink> sink = nullptr
+    );
+
+    // blocks until every queued download finished
+    void wait();
+    void cancel_all();
+
+    const DownloadCounters& counters() const {
+        return m_counters;
+    }
+
+    MirrorStats mirror_stats(size_t mirror) {
+        return m_selector.stats(mirror);
+    }
+
+private:
+    enum class AttemptResult {
+        DONE,
+        NEXT_MIRROR,
+        LOST, // another mirror answered first
+        CANCELLED
+    };
+
+    // attempts of one task running at the same time, the first lane that
+    // receives a byte of the file wins and the others give up
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::atomic<int32_t> winner = -1;
+        int32_t launched = 0;
+        int32_t finished = 0;
+        bool done = false;
+        bool stale_part = false; // a mirror refused the range, drop the .part once every lane stopped
+        // connection of each lane, the winner shuts the others down instead of waiting for their callbacks
+        std::array<curl_socket_t, 2> sockets{CURL_SOCKET_BAD, CURL_SOCKET_BAD};
+    };
+
+    struct Lane {
+        int32_t mirror = -1;
+        std::thread thread;
+        AttemptResult result = AttemptResult::NEXT_MIRROR;
+        std::string error;
+    };
+
+    struct LaneSocket {
+        Race* race;
+        int32_t lane;
+    };
+
+    // curl socket callbacks, they keep Race::sockets up to date
+    static int on_socket_open(void* data, curl_socket_t socket, curlsocktype purpose);
+    static int on_socket_close(void* data, curl_socket_t socket);
+    // cuts the connection of every lane but the winner, their transfer fails right away
+    static void abort_losers(Race& race, int32_t winner);
+
+    void worker();
+    void run(DownloadTask& task);
+    void launch(DownloadTask& task, Race& race, Lane& lane, int32_t index, uint64_t offset);
+    AttemptResult attempt(
+        DownloadTask& task, size_t mirror, uint64_t offset, Race& race, int32_t lane, std::string& error
+    );
+
+    // best ranked mirror with a free connection that wasn't tried yet, -1 when all were
+    // tried (or when none is free and wait is false)
+    int32_t acquire_mirror(std::vector<bool>& tried, bool wait);
+    void release_mirror(int32_t index);
+
+    struct MirrorSlot {
+        DownloadMirror mirror;
+        size_t active = 0;
+    };
+
+    DownloadManagerOptions m_options;
+
+    std::mutex m_mirror_mutex;
+    std::condition_variable m_mirror_cv;
+    std::vector<MirrorSlot> m_mirrors;
+    MirrorSelector m_selector;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_idle_cv;
+    std::deque<std::shared_ptr<DownloadTask>> m_queue;
+    std::vector<std::shared_ptr<DownloadTask>> m_active;
+    size_t m_running = 0;
+    bool m_stop = false;
+
+    DownloadCounters m_counters;
+    std::vector<std::thread> m_workers;
+};
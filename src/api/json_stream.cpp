@@ -0,0 +1,247 @@
+#include "json_stream.hpp"
+
+#include <iostream>
+
+namespace json_stream {
+    bool PipeBuffer::write(std::string_view data) {
+        if (data.empty()) {
+            return true;
+        }
+
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_cancelled || m_chunks.size() < m_max_chunks; });
+
+        if (m_cancelled) {
+            return false;
+        }
+
+        m_chunks.emplace_back(data);
+        m_cv.notify_all();
+        return true;
+    }
+
+    void PipeBuffer::close() {
+        std::scoped_lock lock(m_mutex);
+        m_closed = true;
+        m_cv.notify_all();
+    }
+
+    void PipeBuffer::cancel() {
+        std::scoped_lock lock(m_mutex);
+        m_cancelled = true;
+        m_chunks.clear();
+        m_cv.notify_all();
+    }
+
+    PipeBuffer::int_type PipeBuffer::underflow() {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_cancelled || m_closed || !m_chunks.empty(); });
+
+            if (m_cancelled || m_chunks.empty()) {
+                return traits_type::eof();
+            }
+
+            m_current = std::move(m_chunks.front());
+            m_chunks.pop_front();
+            m_cv.notify_all();
+        }
+
+        setg(m_current.data(), m_current.data(), m_current.data() + m_current.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+    // nlohmann sax interface. values outside streamed arrays go into m_rest, elements of
+    // streamed arrays are built one at a time and handed to the parser right away.
+    class Handler {
+    public:
+        explicit Handler(Parser& parser) : m_parser(parser) {}
+
+        bool null() {
+            return value(nullptr);
+        }
+
+        bool boolean(bool value) {
+            return this->value(value);
+        }
+
+        bool number_integer(nlohmann::json::number_integer_t value) {
+            return this->value(value);
+        }
+
+        bool number_unsigned(nlohmann::json::number_unsigned_t value) {
+            return this->value(value);
+        }
+
+        bool number_float(nlohmann::json::number_float_t value, const nlohmann::json::string_t&) {
+            return this->value(value);
+        }
+
+        bool string(nlohmann::json::string_t& value) {
+            return this->value(std::move(value));
+        }
+
+        bool binary(nlohmann::json::binary_t& value) {
+            return this->value(nlohmann::json::binary(std::move(value)));
+        }
+
+        bool start_object(size_t) {
+            if (m_state == State::ROOT) {
+                m_state = State::MEMBERS;
+                return true;
+            }
+
+            return open(nlohmann::json::object());
+        }
+
+        bool start_array(size_t) {
+            if (m_stack.empty() && m_state == State::MEMBERS && m_parser.is_streamed(m_key)) {
+                m_state = State::STREAMED;
+                return true;
+            }
+
+            return open(nlohmann::json::array());
+        }
+
+        bool key(nlohmann::json::string_t& key) {
+            if (m_stack.empty()) {
+                m_key = std::move(key);
+            } else {
+                m_pending_key = std::move(key);
+            }
+            return true;
+        }
+
+        bool end_object() {
+            if (m_stack.empty()) {
+                m_state = State::DONE;
+                return true;
+            }
+
+            return close();
+        }
+
+        bool end_array() {
+            if (m_stack.empty()) {
+                m_state = State::MEMBERS;
+                return true;
+            }
+
+            return close();
+        }
+
+        bool parse_error(size_t, const std::string&, const nlohmann::json::exception& error) {
+            std::cerr << "[api] failed to parse response body: " << error.what() << "\n";
+            return false;
+        }
+
+        void finish() {
+            m_parser.finish(std::move(m_rest));
+        }
+
+    private:
+        enum class State {
+            ROOT,
+            MEMBERS,  // inside the root object
+            STREAMED, // inside a streamed array
+            DONE
+        };
+
+        // where the next value goes
+        nlohmann::json* slot() {
+            if (m_stack.empty()) {
+                switch (m_state) {
+                    case State::MEMBERS:
+                        return &m_rest[m_key];
+                    case State::STREAMED:
+                        return &m_element;
+                    default:
+                        return &m_rest;
+                }
+            }
+
+            nlohmann::json* parent = m_stack.back();
+
+            if (parent->is_array()) {
+                parent->push_back(nullptr);
+                return &parent->back();
+            }
+
+            return &(*parent)[m_pending_key];
+        }
+
+        bool value(nlohmann::json&& value) {
+            *slot() = std::move(value);
+
+            if (m_stack.empty()) {
+                completed();
+            }
+
+            return true;
+        }
+
+        bool open(nlohmann::json&& container) {
+            nlohmann::json* target = slot();
+            *target = std::move(container);
+            m_stack.push_back(target);
+            return true;
+        }
+
+        bool close() {
+            m_stack.pop_back();
+
+            if (m_stack.empty()) {
+                completed();
+            }
+
+            return true;
+        }
+
+        void completed() {
+            if (m_state == State::STREAMED) {
+                m_parser.consume(m_key, std::move(m_element));
+                m_element = nullptr;
+            }
+        }
+
+        Parser& m_parser;
+        State m_state = State::ROOT;
+        nlohmann::json m_rest = nlohmann::json::object();
+        nlohmann::json m_element;
+        std::string m_key;
+        std::string m_pending_key;
+        std::vector<nlohmann::json*> m_stack;
+    };
+
+    template <typename Input>
+    static bool run(Parser& parser, Input&& input) {
+        Handler handler(parser);
+
+        try {
+            if (!nlohmann::json::sax_parse(std::forward<Input>(input), &handler)) {
+                return false;
+            }
+
+            handler.finish();
+        } catch (const nlohmann::json::exception& error) {
+            std::cerr << "[api] failed to parse response: " << error.what() << "\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    bool Parser::parse(std::istream& input) {
+        reset();
+        return run(*this, input);
+    }
+
+    bool Parser::parse(std::string_view input) {
+        reset();
+        return run(*this, input);
+    }
+} // namespace json_stream
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace json_stream {
+    // bounded byte queue between curl's write callback and the parser thread.
+    // the writer blocks while the parser is behind, so memory stays at max_chunks.
+    class PipeBuffer : public std::streambuf {
+    public:
+        explicit PipeBuffer(size_t max_chunks = 64) : m_max_chunks(max_chunks) {}
+
+        // false once the reader gave up, so the transfer can be aborted
+        bool write(std::string_view data);
+
+        // no more data will come
+        void close();
+
+        // reader side, wakes up a blocked writer
+        void cancel();
+
+    protected:
+        int_type underflow() override;
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<std::string> m_chunks;
+        std::string m_current;
+        size_t m_max_chunks;
+        bool m_closed = false;
+        bool m_cancelled = false;
+    };
+
+    // sax based decoder for a json object. arrays registered as streamed are decoded
+    // element by element (only one element exists as json at a time), everything
+    // else is collected and converted with the regular from_json at the end.
+    class Parser {
+    public:
+        virtual ~Parser() = default;
+
+        bool parse(std::istream& input);
+        bool parse(std::string_view input);
+
+        // drops partial results before another attempt
+        virtual void reset() = 0;
+
+    protected:
+        friend class Handler;
+
+        virtual bool is_streamed(const std::string& key) const = 0;
+        virtual void consume(const std::string& key, nlohmann::json&& element) = 0;
+        virtual void finish(nlohmann::json&& rest) = 0;
+    };
+
+    template <typename T>
+    class Decoder : public Parser {
+    public:
+        template <typename E>
+        Decoder& stream_array(std::string key, std::vector<E> T::*member) {
+            auto items = std::make_shared<std::vector<E>>();
+
+            m_fields.push_back(Field{
+                .key = std::move(key),
+                .consume = [items](nlohmann::json&& element) { items->push_back(element.get<E>()); },
+                .apply = [items, member](T& value) { value.*member = std::move(*items); },
+                .reset = [items]() { items->clear(); },
+            });
+
+            return *this;
+        }
+
+        void reset() override {
+            m_result.reset();
+            for (auto& field : m_fields) {
+                field.reset();
+            }
+        }
+
+        std::optional<T> take() {
+            return std::exchange(m_result, std::nullopt);
+        }
+
+    protected:
+        bool is_streamed(const std::string& key) const override {
+            return find(key) != nullptr;
+        }
+
+        void consume(const std::string& key, nlohmann::json&& element) override {
+            find(key)->consume(std::move(element));
+        }
+
+        void finish(nlohmann::json&& rest) override {
+            T value = rest.get<T>();
+            for (auto& field : m_fields) {
+                field.apply(value);
+            }
+            m_result = std::move(value);
+        }
+
+    private:
+        struct Field {
+            std::string key;
+            std::function<void(nlohmann::json&&)> consume;
+            std::function<void(T&)> apply;
+            std::function<void()> reset;
+        };
+
+        const Field* find(const std::string& key) const {
+            for (const auto& field : m_fields) {
+                if (field.key == key) {
+                    return &field;
+                }
+            }
+            return nullptr;
+        }
+
+        std::vector<Field> m_fields;
+        std::optional<T> m_result;
+    };
+} // namespace json_stream
@@ -0,0 +1,114 @@
+#include "mirror_selector.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+MirrorSelector::MirrorSelector(size_t mirrors, MirrorSelectorOptions options)
+    : m_options(options), m_entries(mirrors) {
+    m_options.alpha = std::clamp(m_options.alpha, 0.01, 1.0);
+    m_options.hedge_percentile = std::clamp(m_options.hedge_percentile, 0.0, 1.0);
+    m_options.latency_window = std::max<size_t>(1, m_options.latency_window);
+}
+
+std::vector<size_t> MirrorSelector::rank() {
+    std::scoped_lock lock(m_mutex);
+
+    std::vector<double> scores(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        scores[i] = score_locked(m_entries[i]);
+    }
+
+    std::vector<size_t> order(m_entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scores[a] < scores[b]; });
+    return order;
+}
+
+double MirrorSelector::score(size_t mirror) {
+    std::scoped_lock lock(m_mutex);
+    return score_locked(m_entries[mirror]);
+}
+
+std::chrono::milliseconds MirrorSelector::hedge_delay(size_t mirror) {
+    std::vector<double> latencies;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        latencies = m_entries[mirror].latencies;
+    }
+
+    if (latencies.size() < std::max<size_t>(1, m_options.min_latency_samples)) {
+        return std::max(m_options.default_hedge_delay, m_options.min_hedge_delay);
+    }
+
+    const auto index = static_cast<size_t>(m_options.hedge_percentile * static_cast<double>(latencies.size() - 1));
+    std::nth_element(latencies.begin(), latencies.begin() + static_cast<std::ptrdiff_t>(index), latencies.end());
+
+    const auto delay = std::chrono::milliseconds(static_cast<int64_t>(latencies[index]));
+    return std::max(delay, m_options.min_hedge_delay);
+}
+
+void MirrorSelector::record_first_byte(size_t mirror, std::chrono::milliseconds latency) {
+    std::scoped_lock lock(m_mutex);
+    Entry& entry = m_entries[mirror];
+    const double sample = static_cast<double>(latency.count());
+
+    entry.stats.latency_ms = average(entry.stats.latency_ms, sample, entry.latencies.empty());
+    entry.stats.samples++;
+
+    if (entry.latencies.size() < m_options.latency_window) {
+        entry.latencies.push_back(sample);
+    } else {
+        entry.latencies[entry.next_latency] = sample;
+        entry.next_latency = (entry.next_latency + 1) % entry.latencies.size();
+    }
+}
+
+void MirrorSelector::record_transfer(size_t mirror, uint64_t bytes, std::chrono::milliseconds duration) {
+    std::scoped_lock lock(m_mutex);
+    Entry& entry = m_entries[mirror];
+
+    entry.stats.failure_rate = average(entry.stats.failure_rate, 0.0, false);
+
+    // tiny bodies mostly measure latency, leave the throughput alone
+    if (bytes < 64 * 1024 || duration.count() <= 0) {
+        return;
+    }
+
+    const double sample = static_cast<double>(bytes) * 1000.0 / static_cast<double>(duration.count());
+    entry.stats.throughput = average(entry.stats.throughput, sample, entry.stats.throughput == 0.0);
+}
+
+void MirrorSelector::record_failure(size_t mirror) {
+    std::scoped_lock lock(m_mutex);
+    Entry& entry = m_entries[mirror];
+    entry.stats.failure_rate = average(entry.stats.failure_rate, 1.0, false);
+    entry.stats.samples++;
+}
+
+MirrorStats MirrorSelector::stats(size_t mirror) {
+    std::scoped_lock lock(m_mutex);
+    return m_entries[mirror].stats;
+}
+
+double MirrorSelector::score_locked(const Entry& entry) const {
+    if (entry.stats.samples == 0) {
+        return 0.0;
+    }
+
+    // failed before sending anything, assume it's as slow as the hedge threshold
+    double expected = entry.latencies.empty() ? static_cast<double>(m_options.default_hedge_delay.count())
+                                              : entry.stats.latency_ms;
+
+    if (entry.stats.throughput > 0.0) {
+        expected += static_cast<double>(m_options.expected_size) * 1000.0 / entry.stats.throughput;
+    }
+
+    // a mirror failing half the time costs about two tries
+    const double success = 1.0 - std::min(entry.stats.failure_rate, 0.95);
+    return std::max(expected, 1.0) / success;
+}
+
+double MirrorSelector::average(double current, double sample, bool first) const {
+    return first ? sample : current + m_options.alpha * (sample - current);
+}
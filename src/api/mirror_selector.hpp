@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct MirrorSelectorOptions {
+    double alpha = 0.3;                              // weight of the newest sample in the averages
+    uint64_t expected_size = 10 * 1024 * 1024;       // typical .osz, turns throughput into time
+    size_t latency_window = 32;                      // samples kept for the hedge percentile
+    size_t min_latency_samples = 4;                  // below this the default delay is used
+    double hedge_percentile = 0.9;
+    std::chrono::milliseconds default_hedge_delay{1000};
+    std::chrono::milliseconds min_hedge_delay{50};
+};
+
+struct MirrorStats {
+    double latency_ms = 0.0;  // time to first byte
+    double throughput = 0.0;  // bytes/s
+    double failure_rate = 0.0;
+    uint32_t samples = 0;
+};
+
+// keeps a health score per mirror from the downloads that went through it.
+// mirrors are ranked by the expected time of a typical download, unknown ones
+// first so every mirror gets measured at least once.
+class MirrorSelector {
+public:
+    explicit MirrorSelector(size_t mirrors, MirrorSelectorOptions options = {});
+
+    // mirror indices, best first. ties keep the configured order
+    std::vector<size_t> rank();
+
+    // expected time in ms for options.expected_size bytes, 0 while unknown
+    double score(size_t mirror);
+
+    // how long to wait for the first byte before racing another mirror
+    std::chrono::milliseconds hedge_delay(size_t mirror);
+
+    void record_first_byte(size_t mirror, std::chrono::milliseconds latency);
+    void record_transfer(size_t mirror, uint64_t bytes, std::chrono::milliseconds duration);
+    void record_failure(size_t mirror);
+
+    MirrorStats stats(size_t mirror);
+
+private:
+    struct Entry {
+        MirrorStats stats;
+        std::vector<double> latencies; // ring buffer
+        size_t next_latency = 0;
+    };
+
+    double score_locked(const Entry& entry) const;
+    double average(double current, double sample, bool first) const;
+
+    std::mutex m_mutex;
+    MirrorSelectorOptions m_options;
+    std::vector<Entry> m_entries;
+};
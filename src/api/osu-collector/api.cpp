@@ -1,20 +1,22 @@
 #include "detail.hpp"
 
 #include <string>
+#include <utility>
 
 static void add_pagination_parameters(query::Parameters& parameters, const OsuCollectorRecentRequest& request) {
     query::add_parameter(parameters, "cursor", request.cursor);
     query::add_parameter(parameters, "perPage", request.per_page);
 }
 
-OsuCollectorAPI::OsuCollectorAPI()
-    : OAuthApi("https://osucollector.com/api", OAuthAuthType::CLIENT_CREDENTIALS_GRANT) {}
+OsuCollectorAPI::OsuCollectorAPI() : OsuCollectorAPI("https://osucollector.com/api") {}
+
+OsuCollectorAPI::OsuCollectorAPI(std::string url) : OAuthApi(std::move(url), OAuthAuthType::CLIENT_CREDENTIALS_GRANT) {}
 
 std::optional<OsuCollectorCollectionsPage>
-OsuCollectorAPI::get_recent_collections(const OsuCollectorRecentRequest& request) {
+OsuCollectorAPI::get_recent_collections(const OsuCollectorRecentRequest& request, const std::atomic<bool>* cancel) {
     query::Parameters parameters;
     add_pagination_parameters(parameters, request);
-    return get<OsuCollectorCollectionsPage>("/collections/recent", parameters, false);
+    return get<OsuCollectorCollectionsPage>("/collections/recent", parameters, false, cancel);
 }
 
 std::optional<OsuCollectorCollectionsPage>
@@ -26,28 +28,35 @@ OsuCollectorAPI::get_popular_collections(const OsuCollectorPopularCollectionsReq
 }
 
 std::optional<OsuCollectorCollectionsPage>
-OsuCollectorAPI::search_collections(const OsuCollectorSearchRequest& request) {
+OsuCollectorAPI::search_collections(const OsuCollectorSearchRequest& request, const std::atomic<bool>* cancel) {
     query::Parameters parameters;
     add_pagination_parameters(parameters, request);
     query::add_parameter(parameters, "search", request.search);
     query::add_parameter(parameters, "sortBy", request.sort_by);
     query::add_parameter(parameters, "orderBy", request.order_by);
-    return get<OsuCollectorCollectionsPage>("/collections/search", parameters, false);
+    return get<OsuCollectorCollectionsPage>("/collections/search", parameters, false, cancel);
 }
 
 std::optional<OsuCollectorCollection> OsuCollectorAPI::get_collection(const OsuCollectorCollectionRequest& request) {
     query::Parameters parameters;
     query::add_parameter(parameters, "withBeatmapsets", request.with_beatmapsets);
-    return get<OsuCollectorCollection>("/collections/" + std::to_string(request.id), parameters, false);
+
+    json_stream::Decoder<OsuCollectorCollection> decoder;
+    decoder.stream_array("beatmapsets", &OsuCollectorCollection::beatmapsets);
+    return get_streamed("/collections/" + std::to_string(request.id), parameters, decoder, false);
 }
 
 std::optional<OsuCollectorCollectionBeatmapsResponse>
 OsuCollectorAPI::get_collection_beatmaps(const OsuCollectorCollectionBeatmapsRequest& request) {
     query::Parameters parameters;
     query::add_parameter(parameters, "perPage", request.per_page);
-    return get<OsuCollectorCollectionBeatmapsResponse>(
-        "/collections/" + std::to_string(request.id) + "/beatmapsv3", parameters, false
-    );
+
+    // these can hold tens of thousands of maps, decode them as they arrive
+    json_stream::Decoder<OsuCollectorCollectionBeatmapsResponse> decoder;
+    decoder.stream_array("beatmaps", &OsuCollectorCollectionBeatmapsResponse::beatmaps)
+        .stream_array("beatmapsets", &OsuCollectorCollectionBeatmapsResponse::beatmapsets);
+
+    return get_streamed("/collections/" + std::to_string(request.id) + "/beatmapsv3", parameters, decoder, false);
 }
 
 std::optional<OsuCollectorTournamentsPage>
@@ -58,15 +67,51 @@ OsuCollectorAPI::get_recent_tournaments(const OsuCollectorRecentRequest& request
 }
 
 std::optional<OsuCollectorTournamentsPage>
-OsuCollectorAPI::search_tournaments(const OsuCollectorSearchRequest& request) {
+OsuCollectorAPI::search_tournaments(const OsuCollectorSearchRequest& request, const std::atomic<bool>* cancel) {
     query::Parameters parameters;
     add_pagination_parameters(parameters, request);
     query::add_parameter(parameters, "search", request.search);
     query::add_parameter(parameters, "sortBy", request.sort_by);
     query::add_parameter(parameters, "orderBy", request.order_by);
-    return get<OsuCollectorTournamentsPage>("/tournaments/search", parameters, false);
+    return get<OsuCollectorTournamentsPage>("/tournaments/search", parameters, false, cancel);
 }
 
 std::optional<OsuCollectorTournament> OsuCollectorAPI::get_tournament(const OsuCollectorTournamentRequest& request) {
     return get<OsuCollectorTournament>("/tournaments/" + std::to_string(request.id), {}, false);
 }
+
+std::unique_ptr<OsuCollectorCollectionPager>
+OsuCollectorAPI::page_recent_collections(const OsuCollectorRecentRequest& request, size_t prefetch) {
+    return std::make_unique<OsuCollectorCollectionPager>(
+        [this, request](std::optional<int32_t> cursor, const std::atomic<bool>& cancel) {
+            auto page_request = request;
+            page_request.cursor = cursor;
+            return get_recent_collections(page_request, &cancel);
+        },
+        &OsuCollectorCollectionsPage::collections, prefetch, request.cursor
+    );
+}
+
+std::unique_ptr<OsuCollectorCollectionPager>
+OsuCollectorAPI::page_search_collections(const OsuCollectorSearchRequest& request, size_t prefetch) {
+    return std::make_unique<OsuCollectorCollectionPager>(
+        [this, request](std::optional<int32_t> cursor, const std::atomic<bool>& cancel) {
+            auto page_request = request;
+            page_request.cursor = cursor;
+            return search_collections(page_request, &cancel);
+        },
+        &OsuCollectorCollectionsPage::collections, prefetch, request.cursor
+    );
+}
+
+std::unique_ptr<OsuCollectorTournamentPager>
+OsuCollectorAPI::page_search_tournaments(const OsuCollectorSearchRequest& request, size_t prefetch) {
+    return std::make_unique<OsuCollectorTournamentPager>(
+        [this, request](std::optional<int32_t> cursor, const std::atomic<bool>& cancel) {
+            auto page_request = request;
+            page_request.cursor = cursor;
+            return search_tournaments(page_request, &cancel);
+        },
+        &OsuCollectorTournamentsPage::tournaments, prefetch, request.cursor
+    );
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../api.hpp"
+#include "pager.hpp"
 
 #include <cstdint>
 #include <nlohmann/json.hpp>
@@ -660,20 +661,37 @@ inline void to_json(nlohmann::json& j, const OsuCollectorTournamentRequest& valu
     j = {{"id", value.id}};
 }
 
+using OsuCollectorCollectionPager = CursorPager<OsuCollectorCollectionsPage, OsuCollectorCollectionSummary>;
+using OsuCollectorTournamentPager = CursorPager<OsuCollectorTournamentsPage, OsuCollectorTournamentSummary>;
+
 class OsuCollectorAPI : public OAuthApi {
 public:
     OsuCollectorAPI();
+    explicit OsuCollectorAPI(std::string url);
     ~OsuCollectorAPI() = default;
 
-    std::optional<OsuCollectorCollectionsPage> get_recent_collections(const OsuCollectorRecentRequest& request = {});
+    // cancel aborts the request once set (used by the pagers)
+    std::optional<OsuCollectorCollectionsPage>
+    get_recent_collections(const OsuCollectorRecentRequest& request = {}, const std::atomic<bool>* cancel = nullptr);
     std::optional<OsuCollectorCollectionsPage>
     get_popular_collections(const OsuCollectorPopularCollectionsRequest& request = {});
-    std::optional<OsuCollectorCollectionsPage> search_collections(const OsuCollectorSearchRequest& request);
+    std::optional<OsuCollectorCollectionsPage>
+    search_collections(const OsuCollectorSearchRequest& request, const std::atomic<bool>* cancel = nullptr);
     std::optional<OsuCollectorCollection> get_collection(const OsuCollectorCollectionRequest& request);
     std::optional<OsuCollectorCollectionBeatmapsResponse>
     get_collection_beatmaps(const OsuCollectorCollectionBeatmapsRequest& request);
 
     std::optional<OsuCollectorTournamentsPage> get_recent_tournaments(const OsuCollectorRecentRequest& request = {});
-    std::optional<OsuCollectorTournamentsPage> search_tournaments(const OsuCollectorSearchRequest& request);
+    std::optional<OsuCollectorTournamentsPage>
+    search_tournaments(const OsuCollectorSearchRequest& request, const std::atomic<bool>* cancel = nullptr);
     std::optional<OsuCollectorTournament> get_tournament(const OsuCollectorTournamentRequest& request);
+
+    // item by item walks over every page, `prefetch` pages are kept ready ahead of the consumer.
+    // the api must outlive the pager.
+    std::unique_ptr<OsuCollectorCollectionPager>
+    page_recent_collections(const OsuCollectorRecentRequest& request = {}, size_t prefetch = 3);
+    std::unique_ptr<OsuCollectorCollectionPager>
+    page_search_collections(const OsuCollectorSearchRequest& request, size_t prefetch = 3);
+    std::unique_ptr<OsuCollectorTournamentPager>
+    page_search_tournaments(const OsuCollectorSearchRequest& request, size_t prefetch = 3);
 };
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// walks a cursor paginated endpoint on a background thread, keeping up to `prefetch`
+// pages buffered ahead of the consumer. every cursor comes from the previous page,
+// so requests are still sequential, but they overlap with whatever the consumer does
+// and a page boundary only waits when the consumer is faster than the network.
+// destroying the pager sets `cancel`, the fetch is expected to abort on it.
+template <typename Page, typename Item>
+class CursorPager {
+public:
+    using Fetch = std::function<std::optional<Page>(std::optional<int32_t> cursor, const std::atomic<bool>& cancel)>;
+    using Items = std::vector<Item> Page::*;
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Item;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Item*;
+        using reference = Item&;
+
+        iterator() = default;
+        explicit iterator(CursorPager* pager) : m_pager(pager) {
+            advance();
+        }
+
+        reference operator*() {
+            return *m_current;
+        }
+
+        pointer operator->() {
+            return &*m_current;
+        }
+
+        iterator& operator++() {
+            advance();
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const {
+            return m_pager == other.m_pager;
+        }
+
+    private:
+        void advance() {
+            m_current = m_pager->next();
+            if (!m_current.has_value()) {
+                m_pager = nullptr;
+            }
+        }
+
+        CursorPager* m_pager = nullptr;
+        std::optional<Item> m_current;
+    };
+
+    CursorPager(Fetch fetch, Items items, size_t prefetch = 3, std::optional<int32_t> cursor = std::nullopt)
+        : m_fetch(std::move(fetch)), m_items(items), m_prefetch(prefetch == 0 ? 1 : prefetch), m_cursor(cursor) {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    ~CursorPager() {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_stop = true;
+        }
+
+        // don't sit through the timeouts / retries of a request nobody wants anymore
+        m_cancel = true;
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    CursorPager(const CursorPager&) = delete;
+    CursorPager& operator=(const CursorPager&) = delete;
+
+    // blocks until the next page arrived, nullopt once there are no more pages
+    std::optional<std::vector<Item>> next_page() {
+        std::unique_lock lock(m_mutex);
+
+        if (m_current_index < m_current.size()) {
+            // hand out what's left of a page next() already started
+            std::vector<Item> rest(
+                std::make_move_iterator(m_current.begin() + static_cast<std::ptrdiff_t>(m_current_index)),
+                std::make_move_iterator(m_current.end())
+            );
+            m_current.clear();
+            m_current_index = 0;
+            return rest;
+        }
+
+        m_cv.wait(lock, [this] { return !m_pages.empty() || m_done; });
+
+        if (m_pages.empty()) {
+            return std::nullopt;
+        }
+
+        std::vector<Item> page = std::move(m_pages.front());
+        m_pages.pop_front();
+        m_cv.notify_all();
+        return page;
+    }
+
+    std::optional<Item> next() {
+        std::unique_lock lock(m_mutex);
+
+        while (m_current_index >= m_current.size()) {
+            m_cv.wait(lock, [this] { return !m_pages.empty() || m_done; });
+
+            if (m_pages.empty()) {
+                return std::nullopt;
+            }
+
+            m_current = std::move(m_pages.front());
+            m_current_index = 0;
+            m_pages.pop_front();
+            m_cv.notify_all();
+        }
+
+        return std::move(m_current[m_current_index++]);
+    }
+
+    iterator begin() {
+        return iterator(this);
+    }
+
+    iterator end() {
+        return iterator();
+    }
+
+    // true when the walk stopped because a request failed
+    bool failed() {
+        std::scoped_lock lock(m_mutex);
+        return m_failed;
+    }
+
+    size_t pages_fetched() {
+        std::scoped_lock lock(m_mutex);
+        return m_pages_fetched;
+    }
+
+private:
+    void run() {
+        std::unique_lock lock(m_mutex);
+
+        while (true) {
+            m_cv.wait(lock, [this] { return m_stop || m_pages.size() < m_prefetch; });
+
+            if (m_stop) {
+                break;
+            }
+
+            const auto cursor = m_cursor;
+            lock.unlock();
+            auto page = m_fetch(cursor, m_cancel);
+            lock.lock();
+
+            if (m_stop) {
+                break;
+            }
+
+            if (!page.has_value()) {
+                m_failed = true;
+                break;
+            }
+
+            m_pages_fetched++;
+            m_pages.push_back(std::move((*page).*m_items));
+            m_cv.notify_all();
+
+            if (!page->has_more || !page->next_page_cursor.has_value()) {
+                break;
+            }
+
+            m_cursor = page->next_page_cursor;
+        }
+
+        m_done = true;
+        m_cv.notify_all();
+    }
+
+    Fetch m_fetch;
+    Items m_items;
+    size_t m_prefetch;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::vector<Item>> m_pages;
+    std::vector<Item> m_current;
+    size_t m_current_index = 0;
+    std::optional<int32_t> m_cursor;
+    size_t m_pages_fetched = 0;
+    bool m_done = false;
+    bool m_failed = false;
+    bool m_stop = false;
+    std::atomic<bool> m_cancel = false;
+
+    std::thread m_thread;
+};
@@ -2,8 +2,11 @@
 
 #include <cpr/util.h>
 #include <string>
+#include <utility>
 
-OsuV2API::OsuV2API() : OAuthApi("https://osu.ppy.sh", OAuthAuthType::CLIENT_CREDENTIALS_GRANT) {}
+OsuV2API::OsuV2API() : OsuV2API("https://osu.ppy.sh") {}
+
+OsuV2API::OsuV2API(std::string url) : OAuthApi(std::move(url), OAuthAuthType::CLIENT_CREDENTIALS_GRANT) {}
 
 std::optional<OsuGetBeatmapsResponse> OsuV2API::get_beatmaps(const OsuGetBeatmapsRequest& request) {
     query::Parameters parameters;
@@ -0,0 +1,222 @@
+#include "beatmap_resolver.hpp"
+
+#include <algorithm>
+#include <exception>
+
+BeatmapResolver::BeatmapResolver(OsuV2API& api, BeatmapResolverOptions options)
+    : m_api(api), m_options(options) {
+    m_options.max_batch = std::clamp<size_t>(m_options.max_batch, 1, 50);
+    m_options.max_in_flight = std::clamp<size_t>(m_options.max_in_flight, 1, 16);
+
+    // one slow request only holds up its own thread
+    for (size_t i = 0; i < m_options.max_in_flight; i++) {
+        m_threads.emplace_back([this]() { run(); });
+    }
+}
+
+BeatmapResolver::~BeatmapResolver() {
+    {
+        std::scoped_lock lock(m_mutex);
+        m_stop = true;
+    }
+
+    // whatever is still queued gets sent before the threads exit
+    m_cv.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+std::shared_future<ResolvedBeatmap> BeatmapResolver::resolve(int32_t id) {
+    std::scoped_lock lock(m_mutex);
+
+    if (const auto it = m_ids.find(id); it != m_ids.end()) {
+        return it->second->future;
+    }
+
+    auto pending = std::make_shared<Pending>();
+    m_ids.emplace(id, pending);
+
+    if (m_id_queue.empty()) {
+        m_batch_started = std::chrono::steady_clock::now();
+    }
+
+    m_id_queue.push_back(id);
+
+    if (m_id_queue.size() == 1 || m_id_queue.size() >= m_options.max_batch) {
+        m_cv.notify_one();
+    }
+
+    return pending->future;
+}
+
+std::shared_future<ResolvedBeatmap> BeatmapResolver::resolve_checksum(const std::string& checksum) {
+    std::scoped_lock lock(m_mutex);
+
+    if (const auto it = m_checksums.find(checksum); it != m_checksums.end()) {
+        return it->second->future;
+    }
+
+    auto pending = std::make_shared<Pending>();
+    m_checksums.emplace(checksum, pending);
+    m_checksum_queue.push_back(checksum);
+    m_cv.notify_one();
+
+    return pending->future;
+}
+
+std::vector<ResolvedBeatmap> BeatmapResolver::resolve_all(const std::vector<int32_t>& ids) {
+    std::vector<std::shared_future<ResolvedBeatmap>> futures;
+    futures.reserve(ids.size());
+
+    for (const auto id : ids) {
+        futures.push_back(resolve(id));
+    }
+
+    // nothing else is coming from this caller, the tail doesn't need to wait
+    flush();
+
+    std::vector<ResolvedBeatmap> result;
+    result.reserve(ids.size());
+
+    for (const auto& future : futures) {
+        result.push_back(future.get());
+    }
+
+    return result;
+}
+
+void BeatmapResolver::flush() {
+    {
+        std::scoped_lock lock(m_mutex);
+        if (m_id_queue.empty()) {
+            return;
+        }
+        m_flush = true;
+    }
+
+    m_cv.notify_all();
+}
+
+void BeatmapResolver::run() {
+    std::unique_lock lock(m_mutex);
+
+    while (true) {
+        m_cv.wait(lock, [this] { return m_stop || !m_id_queue.empty() || !m_checksum_queue.empty(); });
+
+        if (!m_id_queue.empty()) {
+            // give other callers a chance to fill the batch
+            m_cv.wait_until(lock, m_batch_started + m_options.window, [this] {
+                return m_stop || m_flush || m_id_queue.size() >= m_options.max_batch;
+            });
+
+            // another thread took the batch while this one waited
+            if (m_id_queue.empty()) {
+                continue;
+            }
+
+            send_batch(lock);
+            continue;
+        }
+
+        if (!m_checksum_queue.empty()) {
+            send_checksum(lock);
+            continue;
+        }
+
+        if (m_stop) {
+            return;
+        }
+    }
+}
+
+void BeatmapResolver::send_batch(std::unique_lock<std::mutex>& lock) {
+    const size_t count = std::min(m_options.max_batch, m_id_queue.size());
+    OsuGetBeatmapsRequest request;
+    request.ids.assign(m_id_queue.begin(), m_id_queue.begin() + static_cast<std::ptrdiff_t>(count));
+    m_id_queue.erase(m_id_queue.begin(), m_id_queue.begin() + static_cast<std::ptrdiff_t>(count));
+
+    if (m_id_queue.empty()) {
+        m_flush = false;
+    }
+
+    // leftovers already waited their window, so they go out on the next pass
+    lock.unlock();
+    std::optional<OsuGetBeatmapsResponse> response;
+    std::exception_ptr error;
+
+    try {
+        response = m_api.get_beatmaps(request);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    lock.lock();
+
+    if (error) {
+        for (const auto id : request.ids) {
+            if (const auto it = m_ids.find(id); it != m_ids.end()) {
+                it->second->promise.set_exception(error);
+                m_ids.erase(it);
+            }
+        }
+        return;
+    }
+
+    std::unordered_map<int32_t, BeatmapExtended*> found;
+
+    if (response.has_value()) {
+        found.reserve(response->beatmaps.size());
+        for (auto& beatmap : response->beatmaps) {
+            found.emplace(beatmap.id, &beatmap);
+        }
+    }
+
+    for (const auto id : request.ids) {
+        const auto it = m_ids.find(id);
+        if (it == m_ids.end()) {
+            continue;
+        }
+
+        // missing ids (deleted / restricted maps) resolve to nothing
+        const auto beatmap = found.find(id);
+        it->second->promise.set_value(
+            beatmap != found.end() ? ResolvedBeatmap(std::move(*beatmap->second)) : std::nullopt
+        );
+        m_ids.erase(it);
+    }
+}
+
+void BeatmapResolver::send_checksum(std::unique_lock<std::mutex>& lock) {
+    const std::string checksum = std::move(m_checksum_queue.front());
+    m_checksum_queue.pop_front();
+
+    OsuBeatmapLookupRequest request;
+    request.checksum = checksum;
+
+    lock.unlock();
+    ResolvedBeatmap beatmap;
+    std::exception_ptr error;
+
+    try {
+        beatmap = m_api.lookup_beatmap(request);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    lock.lock();
+
+    const auto it = m_checksums.find(checksum);
+    if (it == m_checksums.end()) {
+        return;
+    }
+
+    if (error) {
+        it->second->promise.set_exception(error);
+    } else {
+        it->second->promise.set_value(std::move(beatmap));
+    }
+
+    m_checksums.erase(it);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "detail.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct BeatmapResolverOptions {
+    size_t max_batch = 50;                 // /api/v2/beatmaps accepts up to 50 ids
+    std::chrono::milliseconds window{10};  // how long a partial batch waits for more ids
+    size_t max_in_flight = 4;              // requests sent at the same time
+};
+
+using ResolvedBeatmap = std::optional<BeatmapExtended>;
+
+// coalesces single beatmap lookups into /api/v2/beatmaps?ids[] requests.
+// callers get a future right away, background threads send a batch once it is
+// full, the window expired or flush() was called and fan the results back out.
+// lookups for the same id / checksum that are still pending share one request.
+// a request that throws hands the exception to every future in it.
+class BeatmapResolver {
+public:
+    explicit BeatmapResolver(OsuV2API& api, BeatmapResolverOptions options = {});
+    ~BeatmapResolver();
+
+    BeatmapResolver(const BeatmapResolver&) = delete;
+    BeatmapResolver& operator=(const BeatmapResolver&) = delete;
+
+    std::shared_future<ResolvedBeatmap> resolve(int32_t id);
+
+    // the api has no batch endpoint for checksums, these are deduplicated and
+    // sent one by one through the same queue
+    std::shared_future<ResolvedBeatmap> resolve_checksum(const std::string& checksum);
+
+    // results are in the same order as ids
+    std::vector<ResolvedBeatmap> resolve_all(const std::vector<int32_t>& ids);
+
+    // sends whatever is queued right away instead of waiting for the window
+    void flush();
+
+private:
+    struct Pending {
+        std::promise<ResolvedBeatmap> promise;
+        std::shared_future<ResolvedBeatmap> future = promise.get_future().share();
+    };
+
+    void run();
+    void send_batch(std::unique_lock<std::mutex>& lock);
+    void send_checksum(std::unique_lock<std::mutex>& lock);
+
+    OsuV2API& m_api;
+    BeatmapResolverOptions m_options;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    bool m_flush = false;
+
+    // pending until the response arrives, queues only hold what wasn't sent yet
+    std::unordered_map<int32_t, std::shared_ptr<Pending>> m_ids;
+    std::unordered_map<std::string, std::shared_ptr<Pending>> m_checksums;
+    std::deque<int32_t> m_id_queue;
+    std::deque<std::string> m_checksum_queue;
+    std::chrono::steady_clock::time_point m_batch_started{};
+
+    std::vector<std::thread> m_threads;
+};
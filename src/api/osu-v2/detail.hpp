@@ -749,6 +749,7 @@ struct OsuGetMatchResponse {
 class OsuV2API : public OAuthApi {
 public:
     OsuV2API();
+    explicit OsuV2API(std::string url);
     ~OsuV2API() = default;
 
     std::optional<OsuGetBeatmapsResponse> get_beatmaps(const OsuGetBeatmapsRequest& request);
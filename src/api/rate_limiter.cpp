@@ -0,0 +1,317 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+static bool is_success(const cpr::Response& response) {
+    return response.status_code >= 200 && response.status_code < 400;
+}
+
+static bool is_retryable(const cpr::Response& response) {
+    // 0 means curl never got a response (timeout, reset, dns...)
+    switch (response.status_code) {
+        case 0:
+        case 429:
+        case 502:
+        case 503:
+        case 504:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static std::optional<int64_t> header_integer(const cpr::Response& response, const char* key) {
+    const auto it = response.header.find(key);
+
+    if (it == response.header.end()) {
+        return std::nullopt;
+    }
+
+    int64_t value = 0;
+    const auto& text = it->second;
+    const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+
+    if (result.ec != std::errc{}) {
+        return std::nullopt;
+    }
+
+    return value;
+}
+
+// https://howardhinnant.github.io/date_algorithms.html#days_from_civil
+static int64_t days_from_civil(int64_t year, int64_t month, int64_t day) {
+    year -= month <= 2 ? 1 : 0;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yoe = year - era * 400;
+    const int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+std::optional<std::chrono::milliseconds> rate_limit::parse_retry_after(std::string_view value) {
+    while (!value.empty() && value.front() == ' ') {
+        value.remove_prefix(1);
+    }
+
+    if (value.empty()) {
+        return std::nullopt;
+    }
+
+    if (std::isdigit(static_cast<unsigned char>(value.front()))) {
+        int64_t seconds = 0;
+        const auto result = std::from_chars(value.data(), value.data() + value.size(), seconds);
+
+        if (result.ec != std::errc{} || seconds < 0) {
+            return std::nullopt;
+        }
+
+        return std::chrono::seconds(seconds);
+    }
+
+    // IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
+    static constexpr std::string_view MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    char month_name[4] = {};
+    int day = 0, year = 0, hour = 0, minute = 0, second = 0;
+    const std::string text(value);
+
+    if (std::sscanf(text.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, month_name, &year, &hour, &minute, &second) != 6) {
+        return std::nullopt;
+    }
+
+    const size_t month_index = MONTHS.find(std::string_view(month_name, 3));
+
+    if (month_index == std::string_view::npos || month_index % 3 != 0) {
+        return std::nullopt;
+    }
+
+    const int64_t epoch_seconds =
+        days_from_civil(year, static_cast<int64_t>(month_index / 3 + 1), day) * 86400 + hour * 3600 + minute * 60 +
+        second;
+
+    const auto target = std::chrono::system_clock::time_point(std::chrono::seconds(epoch_seconds));
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(target - std::chrono::system_clock::now());
+
+    return std::max(remaining, std::chrono::milliseconds(0));
+}
+
+std::string rate_limit::host_key(std::string_view url) {
+    const size_t scheme = url.find("://");
+
+    if (scheme != std::string_view::npos) {
+        url.remove_prefix(scheme + 3);
+    }
+
+    url = url.substr(0, url.find('/'));
+
+    std::string key(url);
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+
+    return key;
+}
+
+static RateLimiterOptions normalize_options(RateLimiterOptions options) {
+    options.requests_per_second = std::max(0.001, options.requests_per_second);
+    options.min_requests_per_second = std::clamp(options.min_requests_per_second, 0.001, options.requests_per_second);
+    options.burst = std::max(1.0, options.burst);
+    return options;
+}
+
+RateLimiter::RateLimiter(RateLimiterOptions options) {
+    set_options(options);
+}
+
+std::shared_ptr<RateLimiter> RateLimiter::for_host(std::string_view url) {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<RateLimiter>> limiters;
+
+    std::scoped_lock lock(mutex);
+    auto& entry = limiters[rate_limit::host_key(url)];
+    auto limiter = entry.lock();
+
+    // the last api instance for the host is gone, its options go with it
+    if (!limiter) {
+        limiter = std::make_shared<RateLimiter>();
+        entry = limiter;
+    }
+
+    return limiter;
+}
+
+bool rate_limit::sleep_until(std::chrono::steady_clock::time_point until, const std::atomic<bool>* cancel) {
+    if (cancel == nullptr) {
+        std::this_thread::sleep_until(until);
+        return true;
+    }
+
+    constexpr auto slice = std::chrono::milliseconds(50);
+
+    while (!cancel->load(std::memory_order_relaxed)) {
+        const auto now = std::chrono::steady_clock::now();
+
+        if (now >= until) {
+            return true;
+        }
+
+        std::this_thread::sleep_until(std::min(until, now + slice));
+    }
+
+    return false;
+}
+
+bool RateLimiter::acquire(const std::atomic<bool>* cancel) {
+    Clock::time_point start;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        const auto now = Clock::now();
+        refill(now);
+
+        // going into debt reserves a slot in the future, so callers are served in order
+        m_tokens -= 1.0;
+
+        start = now;
+
+        if (m_tokens < 0.0) {
+            start += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-m_tokens / m_rate));
+        }
+
+        start = std::max(start, m_blocked_until);
+    }
+
+    return rate_limit::sleep_until(start, cancel);
+}
+
+std::optional<std::chrono::milliseconds> RateLimiter::on_response(const cpr::Response& response, int attempt) {
+    std::scoped_lock lock(m_mutex);
+    const auto now = Clock::now();
+    refill(now);
+
+    const auto remaining = header_integer(response, "X-RateLimit-Remaining");
+
+    if (remaining.has_value() && *remaining <= 0) {
+        // the server says the window is spent, stop handing out burst tokens
+        m_tokens = std::min(m_tokens, 0.0);
+
+        if (const auto reset = header_integer(response, "X-RateLimit-Reset"); reset.has_value() && *reset > 0) {
+            // some servers send a delta, others an epoch timestamp
+            const int64_t epoch_now = std::chrono::duration_cast<std::chrono::seconds>(
+                                          std::chrono::system_clock::now().time_since_epoch()
+            )
+                                          .count();
+            const int64_t delta = *reset > 1000000000 ? std::max<int64_t>(0, *reset - epoch_now) : *reset;
+            m_blocked_until = std::max(m_blocked_until, now + std::chrono::seconds(delta));
+        }
+    }
+
+    if (is_success(response)) {
+        m_retry_budget = std::min(m_options.max_retry_budget, m_retry_budget + m_options.retry_ratio);
+        // additive increase back to the configured rate
+        m_rate = std::min(m_options.requests_per_second, m_rate + m_options.requests_per_second * 0.05);
+        return std::nullopt;
+    }
+
+    if (!is_retryable(response)) {
+        return std::nullopt;
+    }
+
+    std::optional<std::chrono::milliseconds> retry_after;
+
+    if (const auto it = response.header.find("Retry-After"); it != response.header.end()) {
+        retry_after = rate_limit::parse_retry_after(it->second);
+    }
+
+    if (response.status_code == 429) {
+        // multiplicative decrease, everyone waits for the cooldown
+        m_rate = std::max(m_options.min_requests_per_second, m_rate * 0.5);
+        m_tokens = std::min(m_tokens, 0.0);
+
+        if (retry_after.has_value()) {
+            m_blocked_until = std::max(m_blocked_until, now + *retry_after);
+        }
+    }
+
+    if (attempt + 1 >= m_options.max_attempts || m_retry_budget < 1.0) {
+        return std::nullopt;
+    }
+
+    m_retry_budget -= 1.0;
+
+    const auto delay = backoff(attempt);
+    return retry_after.has_value() ? std::max(delay, *retry_after) : delay;
+}
+
+bool RateLimiter::configure(const RateLimiterOptions& options, const void* owner) {
+    std::scoped_lock lock(m_mutex);
+    const RateLimiterOptions normalized = normalize_options(options);
+
+    if (m_owner != nullptr && m_owner != owner) {
+        if (normalized == m_options) {
+            return true;
+        }
+
+        std::cerr << "[rate-limit] options already set by another instance for this host, keeping them\n";
+        return false;
+    }
+
+    m_owner = owner;
+    apply_options(normalized);
+    return true;
+}
+
+void RateLimiter::release(const void* owner) {
+    std::scoped_lock lock(m_mutex);
+
+    if (m_owner == owner) {
+        m_owner = nullptr;
+    }
+}
+
+void RateLimiter::set_options(const RateLimiterOptions& options) {
+    std::scoped_lock lock(m_mutex);
+    apply_options(normalize_options(options));
+}
+
+void RateLimiter::apply_options(const RateLimiterOptions& options) {
+    m_options = options;
+    m_rate = m_options.requests_per_second;
+    m_tokens = m_options.burst;
+    m_retry_budget = m_options.max_retry_budget;
+    m_last_refill = Clock::now();
+}
+
+RateLimiterOptions RateLimiter::get_options() {
+    std::scoped_lock lock(m_mutex);
+    return m_options;
+}
+
+double RateLimiter::current_rate() {
+    std::scoped_lock lock(m_mutex);
+    return m_rate;
+}
+
+void RateLimiter::refill(Clock::time_point now) {
+    const double elapsed = std::chrono::duration<double>(now - m_last_refill).count();
+
+    if (elapsed > 0.0) {
+        m_tokens = std::min(m_options.burst, m_tokens + elapsed * m_rate);
+        m_last_refill = now;
+    }
+}
+
+std::chrono::milliseconds RateLimiter::backoff(int attempt) {
+    const auto base = m_options.base_backoff.count();
+    const auto cap = std::min<int64_t>(m_options.max_backoff.count(), base << std::min(attempt, 16));
+
+    // equal jitter: half fixed, half random, so retries never collapse to zero
+    std::uniform_int_distribution<int64_t> distribution(cap / 2, std::max<int64_t>(cap / 2, cap));
+    return std::chrono::milliseconds(distribution(m_random));
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cpr/cpr.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+struct RateLimiterOptions {
+    double requests_per_second = 20.0; // osu! api allows 1200 requests per minute
+    double burst = 20.0;
+    double min_requests_per_second = 0.5; // floor for the adaptive rate
+    int max_attempts = 5;                 // first try + retries for a single request
+    double retry_ratio = 0.2;             // retries earned per successful request
+    double max_retry_budget = 10.0;
+    std::chrono::milliseconds base_backoff{500};
+    std::chrono::milliseconds max_backoff{30000};
+
+    bool operator==(const RateLimiterOptions&) const = default;
+};
+
+// token bucket shared by every api instance that talks to the same host.
+// requests wait for their turn instead of failing, and the rate adapts to 429s
+// (halved) and successful responses (slowly restored).
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RateLimiter(RateLimiterOptions options = {});
+
+    // one limiter per host (host:port), shared while anyone holds it
+    static std::shared_ptr<RateLimiter> for_host(std::string_view url);
+
+    // blocks until the request is allowed to go out, false when cancel was set meanwhile
+    bool acquire(const std::atomic<bool>* cancel = nullptr);
+
+    // updates the bucket from the response, returns the delay before retrying
+    // when the request should be sent again (attempt starts at 0)
+    std::optional<std::chrono::milliseconds> on_response(const cpr::Response& response, int attempt);
+
+    // the first owner to configure a shared limiter decides its options. a different owner
+    // asking for different ones is refused (false) instead of silently overriding them
+    bool configure(const RateLimiterOptions& options, const void* owner);
+    // gives up ownership, the next configure() call wins again
+    void release(const void* owner);
+
+    // unconditional, for limiters that aren't shared
+    void set_options(const RateLimiterOptions& options);
+    RateLimiterOptions get_options();
+
+    double current_rate();
+
+private:
+    void refill(Clock::time_point now);
+    std::chrono::milliseconds backoff(int attempt);
+    void apply_options(const RateLimiterOptions& options);
+
+    std::mutex m_mutex;
+    RateLimiterOptions m_options;
+    const void* m_owner = nullptr;
+    double m_rate = 0.0;
+    double m_tokens = 0.0;
+    double m_retry_budget = 0.0;
+    Clock::time_point m_last_refill = Clock::now();
+    Clock::time_point m_blocked_until{};
+    std::mt19937 m_random{std::random_device{}()};
+};
+
+namespace rate_limit {
+    // Retry-After is either delta seconds or an http date
+    std::optional<std::chrono::milliseconds> parse_retry_after(std::string_view value);
+    std::string host_key(std::string_view url);
+
+    // sleeps in short slices so a set cancel flag cuts the wait short (false)
+    bool sleep_until(std::chrono::steady_clock::time_point until, const std::atomic<bool>* cancel);
+} // namespace rate_limit
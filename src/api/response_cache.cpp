@@ -0,0 +1,417 @@
+#include "response_cache.hpp"
+#include "../utils/binary.hpp"
+#include "../utils/gzip.hpp"
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <iostream>
+#include <system_error>
+#include <vector>
+
+static constexpr uint32_t CACHE_MAGIC = 0x4352534F; // "OSRC"
+static constexpr uint8_t CACHE_VERSION = 1;
+
+static int64_t unix_now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+static std::string header_value(const cpr::Response& response, const char* key) {
+    const auto it = response.header.find(key);
+    return it != response.header.end() ? it->second : "";
+}
+
+static std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// how long the response stays fresh, in seconds from now
+static int64_t freshness_lifetime(
+    const cpr::Response& response, const response_cache::CacheControl& control, const ResponseCacheOptions& options
+) {
+    if (control.no_cache) {
+        return 0;
+    }
+
+    if (control.max_age.has_value()) {
+        int64_t age = 0;
+        const std::string age_header = header_value(response, "Age");
+        std::from_chars(age_header.data(), age_header.data() + age_header.size(), age);
+        return *control.max_age - age;
+    }
+
+    if (const std::string expires = header_value(response, "Expires"); !expires.empty()) {
+        // same http date format as Retry-After, invalid dates mean already expired
+        const auto remaining = rate_limit::parse_retry_after(expires);
+        return remaining.has_value() ? std::chrono::duration_cast<std::chrono::seconds>(*remaining).count() : 0;
+    }
+
+    return options.default_max_age.count();
+}
+
+bool CachedResponse::is_fresh() const {
+    return unix_now() < expires_at;
+}
+
+response_cache::CacheControl response_cache::parse_cache_control(std::string_view value) {
+    CacheControl control;
+
+    while (!value.empty()) {
+        const size_t comma = value.find(',');
+        const std::string_view directive = trim(value.substr(0, comma));
+        value = comma == std::string_view::npos ? std::string_view{} : value.substr(comma + 1);
+
+        std::string name(directive.substr(0, directive.find('=')));
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+
+        if (name == "no-store") {
+            control.no_store = true;
+        } else if (name == "no-cache") {
+            control.no_cache = true;
+        } else if (name == "private") {
+            control.is_private = true;
+        } else if (name == "max-age") {
+            std::string_view argument = trim(directive.substr(std::min(directive.size(), name.size() + 1)));
+            if (!argument.empty() && argument.front() == '"') {
+                argument = argument.substr(1, argument.find('"', 1) - 1);
+            }
+
+            int64_t seconds = 0;
+            const auto result = std::from_chars(argument.data(), argument.data() + argument.size(), seconds);
+            if (result.ec == std::errc{}) {
+                control.max_age = seconds;
+            }
+        }
+    }
+
+    return control;
+}
+
+// percent-encodes everything but the rfc 3986 unreserved characters
+static void append_escaped(std::string& out, std::string_view value) {
+    static constexpr char HEX[] = "0123456789ABCDEF";
+
+    for (const unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~') {
+            out.push_back(static_cast<char>(c));
+        } else {
+            out.push_back('%');
+            out.push_back(HEX[c >> 4]);
+            out.push_back(HEX[c & 0xF]);
+        }
+    }
+}
+
+// a stat that fails counts as 0 instead of uintmax_t(-1)
+static uint64_t file_size_or_zero(const std::filesystem::path& path) {
+    std::error_code error;
+    const uintmax_t size = std::filesystem::file_size(path, error);
+    return error ? 0 : static_cast<uint64_t>(size);
+}
+
+std::string response_cache::make_key(
+    std::string_view method, std::string_view url, const query::Parameters& params, std::string_view identity
+) {
+    std::string key;
+    key.reserve(method.size() + url.size() + params.size() * 16 + identity.size() + 4);
+    key.append(method).append(" ").append(url);
+
+    // escaped, so a '&' or '=' inside a value can't make two parameter sets look the same
+    char separator = '?';
+    for (const auto& [name, value] : params) {
+        key.push_back(separator);
+        append_escaped(key, name);
+        key.push_back('=');
+        append_escaped(key, value);
+        separator = '&';
+    }
+
+    if (!identity.empty()) {
+        key.append(" @").append(identity);
+    }
+
+    return key;
+}
+
+std::string response_cache::hash(std::string_view value) {
+    // fnv-1a, stable across runs and platforms
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (const unsigned char c : value) {
+        hash ^= c;
+        hash *= 0x100000001B3ull;
+    }
+
+    static constexpr char HEX[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        text[static_cast<size_t>(i)] = HEX[hash & 0xF];
+        hash >>= 4;
+    }
+
+    return text;
+}
+
+ResponseCache::ResponseCache(ResponseCacheOptions options) : m_options(std::move(options)) {
+    std::error_code error;
+    std::filesystem::create_directories(m_options.directory, error);
+
+    if (error) {
+        std::cerr << "[api] failed to create cache directory " << m_options.directory.string() << ": "
+                  << error.message() << "\n";
+        return;
+    }
+
+    for (const auto& file : std::filesystem::directory_iterator(m_options.directory, error)) {
+        if (file.path().extension() == ".cache") {
+            m_size += file_size_or_zero(file.path());
+        }
+    }
+
+    if (m_options.max_size > 0 && m_size > m_options.max_size) {
+        evict();
+    }
+}
+
+std::optional<CachedResponse> ResponseCache::load(const std::string& key) {
+    std::vector<uint8_t> buffer;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        const auto location = entry_path(key);
+
+        if (!binary::read_file_buffer(location.string(), buffer)) {
+            return std::nullopt;
+        }
+
+        // the write time doubles as the last use for eviction
+        std::error_code error;
+        std::filesystem::last_write_time(location, std::filesystem::file_time_type::clock::now(), error);
+    }
+
+    CachedResponse entry;
+    std::vector<uint8_t> compressed;
+
+    try {
+        binary::BinaryCursor cursor;
+        binary::set_cursor(cursor, buffer);
+
+        if (binary::read_u32(cursor) != CACHE_MAGIC || binary::read_u8(cursor) != CACHE_VERSION) {
+            return std::nullopt;
+        }
+
+        // file names are hashes, make sure this is really our entry
+        if (binary::read_string2(cursor) != key) {
+            return std::nullopt;
+        }
+
+        entry.stored_at = binary::read_i64(cursor);
+        entry.expires_at = binary::read_i64(cursor);
+        entry.etag = binary::read_string2(cursor);
+        entry.last_modified = binary::read_string2(cursor);
+        compressed.assign(buffer.begin() + static_cast<std::ptrdiff_t>(cursor.offset), buffer.end());
+    } catch (const std::exception& error) {
+        std::cerr << "[api] ignoring corrupted cache entry: " << error.what() << "\n";
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> body;
+    if (!binary::gzip_decompress(compressed, body)) {
+        std::cerr << "[api] ignoring cache entry with invalid body\n";
+        return std::nullopt;
+    }
+
+    entry.body.assign(body.begin(), body.end());
+    return entry;
+}
+
+bool ResponseCache::store(const std::string& key, const cpr::Response& response, bool authorized) {
+    auto entry = make_entry(key, response, authorized);
+    if (!entry.has_value()) {
+        return false;
+    }
+
+    const std::vector<uint8_t> body(response.text.begin(), response.text.end());
+    std::vector<uint8_t> compressed;
+
+    if (!binary::gzip_compress(body, compressed)) {
+        return false;
+    }
+
+    return write_entry(key, *entry, compressed);
+}
+
+bool ResponseCache::store_compressed(
+    const std::string& key, const cpr::Response& response, const std::vector<uint8_t>& body, bool authorized
+) {
+    const auto entry = make_entry(key, response, authorized);
+    return entry.has_value() && write_entry(key, *entry, body);
+}
+
+bool ResponseCache::refresh(const std::string& key, CachedResponse& cached, const cpr::Response& response) {
+    const auto control = response_cache::parse_cache_control(header_value(response, "Cache-Control"));
+
+    if (const std::string etag = header_value(response, "ETag"); !etag.empty()) {
+        cached.etag = etag;
+    }
+
+    if (const std::string last_modified = header_value(response, "Last-Modified"); !last_modified.empty()) {
+        cached.last_modified = last_modified;
+    }
+
+    cached.stored_at = unix_now();
+    cached.expires_at = cached.stored_at + std::max<int64_t>(0, freshness_lifetime(response, control, m_options));
+
+    const std::vector<uint8_t> body(cached.body.begin(), cached.body.end());
+    std::vector<uint8_t> compressed;
+
+    if (!binary::gzip_compress(body, compressed)) {
+        return false;
+    }
+
+    return write_entry(key, cached, compressed);
+}
+
+void ResponseCache::remove(const std::string& key) {
+    std::scoped_lock lock(m_mutex);
+    std::error_code error;
+    const auto location = entry_path(key);
+    const uint64_t size = std::filesystem::file_size(location, error);
+
+    if (!error && std::filesystem::remove(location, error)) {
+        m_size -= std::min(m_size, size);
+    }
+}
+
+void ResponseCache::clear() {
+    std::scoped_lock lock(m_mutex);
+    std::error_code error;
+
+    for (const auto& file : std::filesystem::directory_iterator(m_options.directory, error)) {
+        if (file.path().extension() == ".cache") {
+            std::filesystem::remove(file.path(), error);
+        }
+    }
+
+    m_size = 0;
+}
+
+std::filesystem::path ResponseCache::entry_path(const std::string& key) const {
+    return m_options.directory / (response_cache::hash(key) + ".cache");
+}
+
+std::optional<CachedResponse>
+ResponseCache::make_entry(const std::string& key, const cpr::Response& response, bool authorized) {
+    const auto control = response_cache::parse_cache_control(header_value(response, "Cache-Control"));
+
+    // private data without an identity in the key would be served to anyone
+    if (control.no_store || (control.is_private && !authorized)) {
+        remove(key);
+        return std::nullopt;
+    }
+
+    CachedResponse entry;
+    entry.stored_at = unix_now();
+    entry.expires_at = entry.stored_at + std::max<int64_t>(0, freshness_lifetime(response, control, m_options));
+    entry.etag = header_value(response, "ETag");
+    entry.last_modified = header_value(response, "Last-Modified");
+
+    // nothing to reuse: already stale and no way to revalidate
+    if (!entry.is_fresh() && !entry.has_validators()) {
+        return std::nullopt;
+    }
+
+    return entry;
+}
+
+bool ResponseCache::write_entry(const std::string& key, const CachedResponse& entry, const std::vector<uint8_t>& body) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(body.size() + key.size() + entry.etag.size() + entry.last_modified.size() + 32);
+    binary::write_u32(buffer, CACHE_MAGIC);
+    binary::write_u8(buffer, CACHE_VERSION);
+    binary::write_string2(buffer, key);
+    binary::write_i64(buffer, entry.stored_at);
+    binary::write_i64(buffer, entry.expires_at);
+    binary::write_string2(buffer, entry.etag);
+    binary::write_string2(buffer, entry.last_modified);
+    buffer.insert(buffer.end(), body.begin(), body.end());
+
+    std::scoped_lock lock(m_mutex);
+    const auto location = entry_path(key);
+    auto temp_location = location;
+    temp_location += ".tmp";
+
+    // readers never see a half written entry
+    if (!binary::write_file_buffer(temp_location.string(), buffer)) {
+        std::cerr << "[api] failed to write cache entry " << location.string() << "\n";
+        return false;
+    }
+
+    std::error_code error;
+    const uint64_t replaced = file_size_or_zero(location);
+    std::filesystem::rename(temp_location, location, error);
+
+    if (error) {
+        std::cerr << "[api] failed to write cache entry " << location.string() << ": " << error.message() << "\n";
+        std::filesystem::remove(temp_location, error);
+        return false;
+    }
+
+    // explicit, the time the kernel stamps on writes is too coarse to order entries by
+    std::filesystem::last_write_time(location, std::filesystem::file_time_type::clock::now(), error);
+    m_size = m_size - std::min(m_size, replaced) + buffer.size();
+
+    if (m_options.max_size > 0 && m_size > m_options.max_size) {
+        evict();
+    }
+
+    return true;
+}
+
+void ResponseCache::evict() {
+    struct Entry {
+        std::filesystem::file_time_type used;
+        std::filesystem::path path;
+        uint64_t size = 0;
+    };
+
+    std::vector<Entry> entries;
+    std::error_code error;
+    uint64_t total = 0;
+
+    for (const auto& file : std::filesystem::directory_iterator(m_options.directory, error)) {
+        if (file.path().extension() != ".cache") {
+            continue;
+        }
+
+        Entry entry{file.last_write_time(error), file.path(), file_size_or_zero(file.path())};
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+
+    // a bit of headroom so the next few stores don't scan the directory again
+    const uint64_t target = m_options.max_size / 4 * 3;
+
+    for (const auto& entry : entries) {
+        if (total <= target) {
+            break;
+        }
+
+        if (std::filesystem::remove(entry.path, error)) {
+            total -= entry.size;
+        }
+    }
+
+    m_size = total;
+}
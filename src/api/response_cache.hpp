@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../utils/query.hpp"
+
+#include <chrono>
+#include <cpr/cpr.h>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ResponseCacheOptions {
+    std::filesystem::path directory;         // empty disables the cache
+    std::chrono::seconds default_max_age{0}; // freshness when the server sends no Cache-Control / Expires
+    bool serve_stale_on_error = true;        // fall back to the cached body when the server is unreachable
+    uint64_t max_size = 256ull * 1024 * 1024; // bytes on disk, least recently used entries go past it. 0 = no limit
+};
+
+struct CachedResponse {
+    int64_t stored_at = 0;  // unix seconds
+    int64_t expires_at = 0; // fresh until this point, revalidated after
+    std::string etag;
+    std::string last_modified;
+    std::string body;
+
+    bool is_fresh() const;
+    bool has_validators() const {
+        return !etag.empty() || !last_modified.empty();
+    }
+};
+
+// on-disk cache for GET responses. bodies are stored gzip compressed, one file per
+// key, and entries past their max-age are revalidated with If-None-Match /
+// If-Modified-Since instead of being downloaded again. authorized requests carry the
+// caller's identity in the key, so one login never sees another one's responses.
+class ResponseCache {
+public:
+    explicit ResponseCache(ResponseCacheOptions options);
+
+    std::optional<CachedResponse> load(const std::string& key);
+
+    // stores a successful response, false when it isn't cacheable. Cache-Control: private
+    // is only kept for authorized requests (their key is per identity)
+    bool store(const std::string& key, const cpr::Response& response, bool authorized);
+
+    // same, for bodies that were gzip compressed while streaming (response.text is unused)
+    bool store_compressed(
+        const std::string& key, const cpr::Response& response, const std::vector<uint8_t>& body, bool authorized
+    );
+
+    // a 304 only carries new headers, the cached body stays
+    bool refresh(const std::string& key, CachedResponse& cached, const cpr::Response& response);
+
+    void remove(const std::string& key);
+    void clear();
+
+    const ResponseCacheOptions& get_options() const {
+        return m_options;
+    }
+
+private:
+    std::filesystem::path entry_path(const std::string& key) const;
+    std::optional<CachedResponse> make_entry(const std::string& key, const cpr::Response& response, bool authorized);
+    bool write_entry(const std::string& key, const CachedResponse& entry, const std::vector<uint8_t>& body);
+    // drops the least recently used entries until the cache is back under 3/4 of max_size
+    void evict();
+
+    std::mutex m_mutex;
+    ResponseCacheOptions m_options;
+    uint64_t m_size = 0; // bytes of every entry on disk
+};
+
+namespace response_cache {
+    struct CacheControl {
+        bool no_store = false;
+        bool no_cache = false;
+        bool is_private = false;
+        std::optional<int64_t> max_age;
+    };
+
+    CacheControl parse_cache_control(std::string_view value);
+
+    // method + url + parameters (in request order, ids[] depends on it) + who asked. identity
+    // is empty for anonymous requests
+    std::string make_key(
+        std::string_view method, std::string_view url, const query::Parameters& params, std::string_view identity = {}
+    );
+
+    // stable hex hash, for identities that shouldn't end up on disk as they are (tokens)
+    std::string hash(std::string_view value);
+} // namespace response_cache
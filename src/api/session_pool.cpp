@@ -0,0 +1,116 @@
+#include "session_pool.hpp"
+
+#include <algorithm>
+#include <cpr/http_version.h>
+#include <iostream>
+
+SessionPool::SessionPool(SessionPoolOptions options) : m_options(options) {
+    m_options.max_concurrent_streams = std::max<size_t>(1, m_options.max_concurrent_streams);
+    m_share = curl_share_init();
+
+    if (m_share == nullptr) {
+        std::cerr << "[api] failed to create curl share handle, dns / tls sessions won't be shared\n";
+        return;
+    }
+
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &SessionPool::lock_share);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &SessionPool::unlock_share);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+SessionPool::~SessionPool() {
+    // easy handles must detach from the share before it can be released
+    m_idle.clear();
+
+    if (m_share != nullptr) {
+        curl_share_cleanup(m_share);
+    }
+}
+
+SessionPool::Lease SessionPool::acquire() {
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_in_use < m_options.max_concurrent_streams; });
+
+    m_in_use++;
+
+    if (!m_idle.empty()) {
+        auto session = std::move(m_idle.back());
+        m_idle.pop_back();
+        return Lease(this, std::move(session));
+    }
+
+    m_created++;
+    lock.unlock();
+
+    return Lease(this, create_session());
+}
+
+void SessionPool::set_options(const SessionPoolOptions& options) {
+    {
+        std::scoped_lock lock(m_mutex);
+        m_options = options;
+        m_options.max_concurrent_streams = std::max<size_t>(1, m_options.max_concurrent_streams);
+
+        // idle sessions were configured with the old options
+        m_idle.clear();
+    }
+
+    m_cv.notify_all();
+}
+
+SessionPoolOptions SessionPool::get_options() {
+    std::scoped_lock lock(m_mutex);
+    return m_options;
+}
+
+size_t SessionPool::created_sessions() {
+    std::scoped_lock lock(m_mutex);
+    return m_created;
+}
+
+std::unique_ptr<cpr::Session> SessionPool::create_session() {
+    SessionPoolOptions options = get_options();
+    auto session = std::make_unique<cpr::Session>();
+    CURL* handle = session->GetCurlHolder()->handle;
+
+    if (options.http2) {
+        session->SetHttpVersion(cpr::HttpVersion{cpr::HttpVersionCode::VERSION_2_0_TLS});
+    }
+
+    if (options.keep_alive) {
+        curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    } else {
+        curl_easy_setopt(handle, CURLOPT_FORBID_REUSE, 1L);
+    }
+
+    if (m_share != nullptr) {
+        curl_easy_setopt(handle, CURLOPT_SHARE, m_share);
+    }
+
+    return session;
+}
+
+void SessionPool::release(std::unique_ptr<cpr::Session> session, bool discard) {
+    {
+        std::scoped_lock lock(m_mutex);
+        m_in_use--;
+
+        if (!discard && m_idle.size() < m_options.max_concurrent_streams) {
+            m_idle.push_back(std::move(session));
+        }
+    }
+
+    m_cv.notify_one();
+}
+
+void SessionPool::lock_share(CURL*, curl_lock_data data, curl_lock_access, void* user) {
+    auto* pool = static_cast<SessionPool*>(user);
+    pool->m_share_locks[static_cast<size_t>(data) % pool->m_share_locks.size()].lock();
+}
+
+void SessionPool::unlock_share(CURL*, curl_lock_data data, void* user) {
+    auto* pool = static_cast<SessionPool*>(user);
+    pool->m_share_locks[static_cast<size_t>(data) % pool->m_share_locks.size()].unlock();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cpr/session.h>
+#include <cstddef>
+#include <curl/curl.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct SessionPoolOptions {
+    size_t max_concurrent_streams = 8; // sessions handed out at once (one in-flight request each)
+    bool keep_alive = true;
+    // negotiated through ALPN, falls back to http/1.1. every session drives its own transfer
+    // with curl_easy_perform, so this is one request per connection, not multiplexing
+    bool http2 = true;
+};
+
+// keeps reusable cpr sessions for a single base url. a session keeps its own connection
+// alive between requests, so a request on a pooled session skips the tcp / tls handshake.
+// dns results and tls sessions are shared between sessions, curl doesn't support sharing
+// the connection cache between handles used on different threads.
+class SessionPool {
+public:
+    class Lease {
+    public:
+        Lease(SessionPool* pool, std::unique_ptr<cpr::Session> session)
+            : m_pool(pool), m_session(std::move(session)) {}
+        Lease(Lease&& other) noexcept = default;
+        Lease& operator=(Lease&& other) noexcept = delete;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ~Lease() {
+            if (m_pool != nullptr && m_session) {
+                m_pool->release(std::move(m_session), m_discard);
+            }
+        }
+
+        cpr::Session& operator*() const {
+            return *m_session;
+        }
+
+        cpr::Session* operator->() const {
+            return m_session.get();
+        }
+
+        // cpr keeps the body / payload around between calls, so sessions used for a
+        // body request are dropped instead of going back to the pool, their connection
+        // closes with them.
+        void discard() {
+            m_discard = true;
+        }
+
+    private:
+        SessionPool* m_pool = nullptr;
+        std::unique_ptr<cpr::Session> m_session;
+        bool m_discard = false;
+    };
+
+    explicit SessionPool(SessionPoolOptions options = {});
+    ~SessionPool();
+
+    SessionPool(const SessionPool&) = delete;
+    SessionPool& operator=(const SessionPool&) = delete;
+
+    // blocks while max_concurrent_streams sessions are already in use
+    Lease acquire();
+
+    void set_options(const SessionPoolOptions& options);
+    SessionPoolOptions get_options();
+
+    size_t created_sessions();
+
+private:
+    std::unique_ptr<cpr::Session> create_session();
+    void release(std::unique_ptr<cpr::Session> session, bool discard);
+
+    static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* user);
+    static void unlock_share(CURL* handle, curl_lock_data data, void* user);
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::unique_ptr<cpr::Session>> m_idle;
+    SessionPoolOptions m_options;
+    size_t m_in_use = 0;
+    size_t m_created = 0;
+
+    CURLSH* m_share = nullptr;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> m_share_locks;
+};
@@ -233,24 +233,28 @@ void ClientBase::rebuild_beatmapsets_from_beatmaps() {
     m_beatmapsets.clear();
 
     for (auto& [_, beatmap] : m_beatmaps) {
-        if (beatmap->beatmap_id <= 0) {
-            continue;
-        }
+        add_to_beatmapset(beatmap.get());
+    }
+}
 
-        auto& beatmapset = m_beatmapsets[beatmap->beatmap_id];
-
-        if (!beatmapset) {
-            beatmapset = std::make_unique<OsuBeatmapSet>(OsuBeatmapSet{
-                .artist = beatmap->artist,
-                .artist_unicode = beatmap->artist_unicode,
-                .title = beatmap->title,
-                .title_unicode = beatmap->title_unicode,
-                .creator = beatmap->creator,
-                .beatmapset_id = beatmap->beatmap_id,
-                .beatmaps = {},
-            });
-        }
+void ClientBase::add_to_beatmapset(OsuBeatmap* beatmap) {
+    if (beatmap->beatmap_id <= 0) {
+        return;
+    }
 
-        beatmapset->beatmaps.push_back(beatmap.get());
+    auto& beatmapset = m_beatmapsets[beatmap->beatmap_id];
+
+    if (!beatmapset) {
+        beatmapset = std::make_unique<OsuBeatmapSet>(OsuBeatmapSet{
+            .artist = beatmap->artist,
+            .artist_unicode = beatmap->artist_unicode,
+            .title = beatmap->title,
+            .title_unicode = beatmap->title_unicode,
+            .creator = beatmap->creator,
+            .beatmapset_id = beatmap->beatmap_id,
+            .beatmaps = {},
+        });
     }
+
+    beatmapset->beatmaps.push_back(beatmap);
 }
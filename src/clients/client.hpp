@@ -7,6 +7,7 @@
 #include "../utils/binary.hpp"
 #include "./detail.hpp"
 
+#include <algorithm>
 #include <format>
 #include <optional>
 #include <string>
@@ -27,8 +28,8 @@ struct OsuBeatmap {
           tags(b.tags), searchable(""), artist_unicode(b.artist_unicode), title_unicode(b.title_unicode),
           duration(b.duration), approach_rate(b.approach_rate), circle_size(b.circle_size),
           overall_difficulty(b.overall_difficulty), hp_drain(b.hp_drain), slider_velocity(b.slider_velocity),
-          last_modification_time(b.last_modification_time), hitcircle(b.hitcircle), sliders(b.sliders),
-          spinners(b.spinners), drain_time(b.drain_time), total_time(b.total_time),
+          star_rating(b.star_rating), last_modification_time(b.last_modification_time), hitcircle(b.hitcircle),
+          sliders(b.sliders), spinners(b.spinners), drain_time(b.drain_time), total_time(b.total_time),
           audio_preview_time(b.audio_preview_time), difficulty_id(b.difficulty_id), beatmap_id(b.beatmap_id),
           mode((BeatmapGamemode)b.mode), status((BeatmapStatus)b.status) {}
 
@@ -49,6 +50,7 @@ struct OsuBeatmap {
           overall_difficulty(b.Difficulty ? b.Difficulty->OverallDifficulty.detach() : 0.0),
           hp_drain(b.Difficulty ? b.Difficulty->DrainRate.detach() : 0.0),
           slider_velocity(b.Difficulty ? b.Difficulty->SliderMultiplier.detach() : 0.0),
+          star_rating(std::max(0.0, b.StarRating.detach())),
           last_modification_time(client_detail::detach_time_ms(b.LastLocalUpdate)), hitcircle(0),
           sliders((int)b.EndTimeObjectCount.detach()), spinners(0), drain_time((int)b.Length.detach()),
           total_time((int)b.Length.detach()),
@@ -74,6 +76,7 @@ struct OsuBeatmap {
     double overall_difficulty = 0.0;
     double hp_drain = 0.0;
     double slider_velocity = 0.0;
+    double star_rating = 0.0; // nomod, 0 when it wasn't calculated yet
     int64_t last_modification_time = 0;
     int hitcircle = 0;
     int sliders = 0;
@@ -145,6 +148,7 @@ protected:
     [[nodiscard]] virtual bool matches_filter(const OsuBeatmap& beatmap) const;
 
     void rebuild_beatmapsets_from_beatmaps();
+    void add_to_beatmapset(OsuBeatmap* beatmap);
 
     // shared data for osu related stuff
     std::unordered_map<std::string, std::unique_ptr<OsuCollection>> m_collections;
@@ -0,0 +1,390 @@
+#include "osz_importer.hpp"
+#include "songs_scanner.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <system_error>
+#include <utility>
+
+namespace {
+    constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+    constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+    constexpr uint32_t END_OF_CENTRAL_SIGNATURE = 0x06054b50;
+    constexpr uint32_t DESCRIPTOR_SIGNATURE = 0x08074b50;
+    constexpr size_t LOCAL_HEADER_SIZE = 30;
+
+    constexpr uint16_t FLAG_DATA_DESCRIPTOR = 0x08;
+    constexpr uint16_t METHOD_STORED = 0;
+    constexpr uint16_t METHOD_DEFLATE = 8;
+
+    uint16_t read_u16(const uint8_t* data) {
+        return static_cast<uint16_t>(data[0] | (data[1] << 8));
+    }
+
+    uint32_t read_u32(const uint8_t* data) {
+        return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+               (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    bool ends_with_osu(std::string_view name) {
+        if (name.size() < 4) {
+            return false;
+        }
+
+        std::string extension(name.substr(name.size() - 4));
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+        return extension == ".osu";
+    }
+
+    // entries can't leave the beatmap folder
+    bool is_safe_entry(const std::string& name) {
+        if (name.empty() || name.front() == '/' || name.find(':') != std::string::npos) {
+            return false;
+        }
+
+        size_t start = 0;
+        while (start <= name.size()) {
+            const size_t end = std::min(name.find('/', start), name.size());
+            if (name.compare(start, end - start, "..") == 0 && end - start == 2) {
+                return false;
+            }
+            start = end + 1;
+        }
+
+        return true;
+    }
+} // namespace
+
+OszImporter::OszImporter(std::filesystem::path folder, OnBeatmap on_beatmap, size_t write_buffer)
+    : m_folder(std::move(folder)), m_on_beatmap(std::move(on_beatmap)),
+      m_write_buffer_size(std::max<size_t>(64 * 1024, write_buffer)) {
+    m_buffer.reserve(m_write_buffer_size);
+    m_inflated.resize(256 * 1024);
+}
+
+OszImporter::~OszImporter() {
+    close_entry();
+}
+
+void OszImporter::reset() {
+    close_entry();
+
+    m_state = State::HEADER;
+    m_pending.clear();
+    m_entry = {};
+    m_buffer.clear();
+    m_beatmap_text.clear();
+    m_files.clear();
+    m_error.clear();
+}
+
+bool OszImporter::write(const char* data, size_t size) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+
+    while (m_state != State::DONE && m_state != State::FAILED) {
+        const State before = m_state;
+        size_t used = 0;
+
+        switch (m_state) {
+            case State::HEADER:
+                used = read_header(bytes, size);
+                break;
+            case State::DATA:
+                used = read_data(bytes, size);
+                break;
+            case State::DESCRIPTOR:
+                used = read_descriptor(bytes, size);
+                break;
+            default:
+                break;
+        }
+
+        bytes += used;
+        size -= used;
+
+        // waiting for the next chunk
+        if (used == 0 && m_state == before) {
+            break;
+        }
+    }
+
+    return m_state != State::FAILED;
+}
+
+bool OszImporter::finish() {
+    if (m_state == State::FAILED) {
+        return false;
+    }
+
+    // some tools skip the central directory, a clean entry boundary is fine too
+    if (m_state == State::DONE || (m_state == State::HEADER && m_pending.empty() && !m_files.empty())) {
+        m_state = State::DONE;
+        return true;
+    }
+
+    return fail("archive ended in the middle of " + (m_entry.name.empty() ? "a header" : m_entry.name));
+}
+
+size_t OszImporter::read_header(const uint8_t* data, size_t size) {
+    size_t needed = 4;
+
+    if (m_pending.size() >= 4) {
+        const uint32_t signature = read_u32(m_pending.data());
+
+        if (signature == CENTRAL_HEADER_SIGNATURE || signature == END_OF_CENTRAL_SIGNATURE) {
+            // every entry was extracted, the rest is the index
+            m_pending.clear();
+            m_state = State::DONE;
+            return 0;
+        }
+
+        if (signature != LOCAL_HEADER_SIGNATURE) {
+            fail("not a zip archive");
+            return 0;
+        }
+
+        needed = LOCAL_HEADER_SIZE;
+
+        if (m_pending.size() >= LOCAL_HEADER_SIZE) {
+            needed += read_u16(m_pending.data() + 26) + read_u16(m_pending.data() + 28);
+        }
+    }
+
+    if (m_pending.size() < needed) {
+        const size_t take = std::min(needed - m_pending.size(), size);
+        m_pending.insert(m_pending.end(), data, data + take);
+        return take;
+    }
+
+    const uint8_t* header = m_pending.data();
+
+    m_entry = {};
+    m_entry.flags = read_u16(header + 6);
+    m_entry.method = read_u16(header + 8);
+    m_entry.crc = read_u32(header + 14);
+    m_entry.compressed_size = read_u32(header + 18);
+    m_entry.name.assign(reinterpret_cast<const char*>(header + LOCAL_HEADER_SIZE), read_u16(header + 26));
+    m_pending.clear();
+
+    if (m_entry.compressed_size == 0xFFFFFFFF) {
+        fail("zip64 archives aren't supported");
+        return 0;
+    }
+
+    if (begin_entry()) {
+        m_state = State::DATA;
+    }
+
+    return 0;
+}
+
+size_t OszImporter::read_data(const uint8_t* data, size_t size) {
+    if (m_entry.method == METHOD_STORED) {
+        const size_t take = static_cast<size_t>(std::min<uint64_t>(m_entry.remaining, size));
+
+        if (!emit(data, take)) {
+            return 0;
+        }
+
+        m_entry.remaining -= take;
+
+        if (m_entry.remaining == 0) {
+            end_entry();
+        }
+
+        return take;
+    }
+
+    m_stream.next_in = const_cast<unsigned char*>(data);
+    m_stream.avail_in = static_cast<mz_uint32>(size);
+
+    while (true) {
+        m_stream.next_out = m_inflated.data();
+        m_stream.avail_out = static_cast<mz_uint32>(m_inflated.size());
+
+        const int status = mz_inflate(&m_stream, MZ_SYNC_FLUSH);
+        const size_t produced = m_inflated.size() - m_stream.avail_out;
+
+        if (status != MZ_OK && status != MZ_STREAM_END && status != MZ_BUF_ERROR) {
+            fail("corrupted data in " + m_entry.name);
+            return 0;
+        }
+
+        if (produced > 0 && !emit(m_inflated.data(), produced)) {
+            return 0;
+        }
+
+        if (status == MZ_STREAM_END) {
+            const size_t used = size - m_stream.avail_in;
+            end_entry();
+            return used;
+        }
+
+        // everything consumed and nothing left to flush, wait for more input
+        if (m_stream.avail_in == 0 && m_stream.avail_out > 0) {
+            return size;
+        }
+    }
+}
+
+size_t OszImporter::read_descriptor(const uint8_t* data, size_t size) {
+    size_t needed = 4;
+
+    if (m_pending.size() >= 4) {
+        // the signature is optional
+        needed = read_u32(m_pending.data()) == DESCRIPTOR_SIGNATURE ? 16 : 12;
+    }
+
+    if (m_pending.size() < needed) {
+        const size_t take = std::min(needed - m_pending.size(), size);
+        m_pending.insert(m_pending.end(), data, data + take);
+        return take;
+    }
+
+    m_entry.crc = read_u32(m_pending.data() + (needed == 16 ? 4 : 0));
+    m_pending.clear();
+
+    if (complete_entry()) {
+        m_state = State::HEADER;
+    }
+
+    return 0;
+}
+
+bool OszImporter::begin_entry() {
+    std::replace(m_entry.name.begin(), m_entry.name.end(), '\\', '/');
+
+    if (!is_safe_entry(m_entry.name)) {
+        return fail("unsafe entry name: " + m_entry.name);
+    }
+
+    if (m_entry.method == METHOD_STORED) {
+        if (m_entry.flags & FLAG_DATA_DESCRIPTOR) {
+            return fail("stored entry without a size: " + m_entry.name);
+        }
+        m_entry.remaining = m_entry.compressed_size;
+    } else if (m_entry.method == METHOD_DEFLATE) {
+        m_stream = {};
+        if (mz_inflateInit2(&m_stream, -MZ_DEFAULT_WINDOW_BITS) != MZ_OK) {
+            return fail("failed to start inflating " + m_entry.name);
+        }
+        m_inflating = true;
+    } else {
+        return fail("unsupported compression method " + std::to_string(m_entry.method) + " for " + m_entry.name);
+    }
+
+    const std::filesystem::path path = m_folder / std::filesystem::path(m_entry.name);
+    std::error_code error;
+
+    if (m_entry.name.back() == '/') {
+        m_entry.is_directory = true;
+        std::filesystem::create_directories(path, error);
+        return !error || fail("failed to create " + path.string());
+    }
+
+    std::filesystem::create_directories(path.parent_path(), error);
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+
+    if (!m_file.is_open()) {
+        return fail("failed to create " + path.string());
+    }
+
+    m_entry.is_beatmap = ends_with_osu(m_entry.name);
+    m_beatmap_text.clear();
+    m_files.push_back(m_entry.name);
+    return true;
+}
+
+bool OszImporter::emit(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return true;
+    }
+
+    m_entry.actual_crc = mz_crc32(m_entry.actual_crc, data, size);
+
+    if (m_entry.is_directory) {
+        return true;
+    }
+
+    if (m_entry.is_beatmap) {
+        m_beatmap_text.append(reinterpret_cast<const char*>(data), size);
+    }
+
+    m_buffer.insert(m_buffer.end(), reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data) + size);
+    return m_buffer.size() < m_write_buffer_size || flush();
+}
+
+bool OszImporter::end_entry() {
+    if (!flush()) {
+        return false;
+    }
+
+    close_entry();
+
+    if (m_entry.flags & FLAG_DATA_DESCRIPTOR) {
+        m_state = State::DESCRIPTOR;
+        return true;
+    }
+
+    if (complete_entry()) {
+        m_state = State::HEADER;
+        return true;
+    }
+
+    return false;
+}
+
+bool OszImporter::complete_entry() {
+    if (m_entry.actual_crc != m_entry.crc) {
+        return fail("crc mismatch in " + m_entry.name);
+    }
+
+    if (!m_entry.is_beatmap) {
+        return true;
+    }
+
+    const std::string file_name = std::filesystem::path(m_entry.name).filename().string();
+    LegacyBeatmap beatmap;
+
+    if (!songs_scanner::build_beatmap(m_beatmap_text, m_folder.filename().string(), file_name, beatmap)) {
+        // a broken difficulty shouldn't throw away the rest of the set
+        std::cerr << "[import] failed to parse " << m_entry.name << "\n";
+    } else if (m_on_beatmap) {
+        m_on_beatmap(beatmap);
+    }
+
+    m_beatmap_text.clear();
+    return true;
+}
+
+bool OszImporter::flush() {
+    if (m_buffer.empty()) {
+        return true;
+    }
+
+    m_file.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+    m_buffer.clear();
+    return static_cast<bool>(m_file) || fail("failed to write " + m_entry.name);
+}
+
+void OszImporter::close_entry() {
+    if (m_inflating) {
+        mz_inflateEnd(&m_stream);
+        m_inflating = false;
+    }
+
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+}
+
+bool OszImporter::fail(std::string message) {
+    close_entry();
+    m_error = std::move(message);
+    m_state = State::FAILED;
+    std::cerr << "[import] " << m_error << "\n";
+    return false;
+}
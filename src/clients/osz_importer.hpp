@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../api/download_manager.hpp"
+#include "../parser/legacy/legacy.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <miniz.h>
+#include <string>
+#include <vector>
+
+// extracts an .osz while it's still downloading. the archive is read front to back
+// through its local headers (the central directory at the end is never needed), every
+// entry goes straight to disk and each .osu is parsed once it's complete, so the new
+// difficulties can be registered without unzipping and rescanning the folder later.
+//
+// stable: folder is "Songs/<set folder>". lazer imports the .osz on its own, point
+// the download directory at the exports folder and don't attach an importer.
+class OszImporter : public DownloadSink {
+public:
+    // called from the thread that feeds the importer
+    using OnBeatmap = std::function<void(const LegacyBeatmap&)>;
+
+    OszImporter(std::filesystem::path folder, OnBeatmap on_beatmap, size_t write_buffer = 1024 * 1024);
+    ~OszImporter() override;
+
+    OszImporter(const OszImporter&) = delete;
+    OszImporter& operator=(const OszImporter&) = delete;
+
+    void reset() override;
+    bool write(const char* data, size_t size) override;
+    bool finish() override;
+
+    const std::string& error() const {
+        return m_error;
+    }
+
+    // entry names written so far, relative to the folder
+    const std::vector<std::string>& files() const {
+        return m_files;
+    }
+
+private:
+    enum class State {
+        HEADER,
+        DATA,
+        DESCRIPTOR,
+        DONE,
+        FAILED
+    };
+
+    struct Entry {
+        std::string name;
+        uint16_t flags = 0;
+        uint16_t method = 0;
+        uint32_t crc = 0;
+        uint64_t compressed_size = 0;
+        uint64_t remaining = 0; // compressed bytes left, stored entries only
+        mz_ulong actual_crc = MZ_CRC32_INIT;
+        bool is_beatmap = false;
+        bool is_directory = false;
+    };
+
+    size_t read_header(const uint8_t* data, size_t size);
+    size_t read_data(const uint8_t* data, size_t size);
+    size_t read_descriptor(const uint8_t* data, size_t size);
+
+    bool begin_entry();
+    bool emit(const uint8_t* data, size_t size);
+    bool end_entry();
+    // checks the crc and hands a finished .osu to the callback
+    bool complete_entry();
+    bool flush();
+    void close_entry();
+    bool fail(std::string message);
+
+    std::filesystem::path m_folder;
+    OnBeatmap m_on_beatmap;
+    size_t m_write_buffer_size;
+
+    State m_state = State::HEADER;
+    std::vector<uint8_t> m_pending; // header / descriptor bytes split across writes
+    Entry m_entry;
+    std::ofstream m_file;
+    std::vector<char> m_buffer;
+    std::string m_beatmap_text;
+    std::vector<uint8_t> m_inflated;
+    mz_stream m_stream{};
+    bool m_inflating = false;
+
+    std::vector<std::string> m_files;
+    std::string m_error;
+};
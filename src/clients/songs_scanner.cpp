@@ -0,0 +1,247 @@
+#include "songs_scanner.hpp"
+#include "../parser/beatmap/beatmap.hpp"
+#include "../utils/md5.hpp"
+#include "../utils/thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <system_error>
+
+// .NET ticks of the unix epoch, osu!.db stores dates as ticks
+static constexpr int64_t UNIX_EPOCH_TICKS = 621355968000000000;
+
+static bool is_beatmap_file(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    return extension == ".osu";
+}
+
+static int leading_int(std::string_view value) {
+    value = trim_view(value);
+    int result = 0;
+    std::from_chars(value.data(), value.data() + value.size(), result);
+    return result;
+}
+
+// object counts and the first / last object time straight from the [HitObjects] lines,
+// indexing doesn't need curves or samples so nothing past the 6th field is looked at.
+// lines are trimmed and the section header matched like split_sections in the parser does
+static void tally_hit_objects(std::string_view content, LegacyBeatmap& beatmap, int& first_object, int& last_object) {
+    bool in_section = false;
+    bool first = true;
+    size_t start = 0;
+
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+
+        if (end == std::string_view::npos) {
+            end = content.size();
+        }
+
+        const auto line = trim_view(content.substr(start, end - start));
+        start = end + 1;
+
+        if (line.empty()) {
+            continue;
+        }
+
+        if (line[0] == '[') {
+            // the parser keeps the first block of a repeated section, so stop at the next header
+            if (in_section) {
+                break;
+            }
+
+            in_section = line == "[HitObjects]";
+            continue;
+        }
+
+        if (!in_section || line[0] == '/') {
+            continue;
+        }
+
+        // x,y,time,type,hit_sound,end_time / curve,...
+        std::array<std::string_view, 6> fields{};
+        size_t count = 0;
+        size_t position = 0;
+
+        while (count < fields.size()) {
+            const size_t comma = line.find(',', position);
+            fields[count++] = line.substr(position, comma - position);
+
+            if (comma == std::string_view::npos) {
+                break;
+            }
+
+            position = comma + 1;
+        }
+
+        if (count < 5) {
+            continue;
+        }
+
+        const int time = leading_int(fields[2]);
+        const int type = leading_int(fields[3]);
+        int end_time = 0;
+
+        if (type & 1) {
+            beatmap.hitcircle++;
+        } else if (type & (2 | 128)) {
+            beatmap.sliders++;
+        } else if (type & 8) {
+            beatmap.spinners++;
+        }
+
+        // spinners end at field 6, holds at "end_time:sample", slider ends aren't stored
+        if (!(type & 2) && (type & (8 | 128)) && count > 5) {
+            end_time = leading_int(fields[5]);
+        }
+
+        if (first) {
+            first_object = time;
+            first = false;
+        }
+
+        last_object = std::max({last_object, time, end_time});
+    }
+}
+
+static SongsScanResult scan_folders(const std::vector<std::filesystem::path>& folders) {
+    SongsScanResult result;
+    std::string content;
+
+    for (const auto& folder : folders) {
+        std::error_code error;
+        const std::string folder_name = folder.filename().string();
+
+        for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+            if (!entry.is_regular_file(error) || !is_beatmap_file(entry.path())) {
+                continue;
+            }
+
+            LegacyBeatmap beatmap;
+
+            if (!read_file_text(entry.path().string(), content) ||
+                !songs_scanner::build_beatmap(content, folder_name, entry.path().filename().string(), beatmap)) {
+                result.failed++;
+                continue;
+            }
+
+            result.beatmaps.push_back(std::move(beatmap));
+        }
+
+        result.folders++;
+    }
+
+    return result;
+}
+
+SongsScanResult songs_scanner::scan(const std::filesystem::path& songs_directory, const SongsScanOptions& options) {
+    SongsScanResult result;
+    std::error_code error;
+    std::vector<std::filesystem::path> folders;
+
+    for (const auto& entry : std::filesystem::directory_iterator(songs_directory, error)) {
+        if (entry.is_directory(error)) {
+            folders.push_back(entry.path());
+        }
+    }
+
+    if (error) {
+        std::cerr << "[scanner] failed to read " << songs_directory.string() << ": " << error.message() << "\n";
+        return result;
+    }
+
+    g_thread_pool.initialize();
+
+    const size_t batch_size = std::max<size_t>(1, options.folders_per_task);
+    std::vector<std::future<SongsScanResult>> tasks;
+    tasks.reserve(folders.size() / batch_size + 1);
+
+    for (size_t start = 0; start < folders.size(); start += batch_size) {
+        const size_t end = std::min(start + batch_size, folders.size());
+        std::vector<std::filesystem::path> batch(folders.begin() + static_cast<std::ptrdiff_t>(start),
+                                                 folders.begin() + static_cast<std::ptrdiff_t>(end));
+        tasks.push_back(g_thread_pool.enqueue([batch = std::move(batch)]() { return scan_folders(batch); }));
+    }
+
+    for (auto& task : tasks) {
+        SongsScanResult partial = task.get();
+
+        if (result.beatmaps.empty()) {
+            result.beatmaps = std::move(partial.beatmaps);
+        } else {
+            result.beatmaps.insert(result.beatmaps.end(), std::make_move_iterator(partial.beatmaps.begin()),
+                                   std::make_move_iterator(partial.beatmaps.end()));
+        }
+
+        result.folders += partial.folders;
+        result.failed += partial.failed;
+    }
+
+    return result;
+}
+
+bool songs_scanner::build_beatmap(
+    std::string_view content, const std::string& folder_name, const std::string& file_name, LegacyBeatmap& beatmap
+) {
+    // one parser per pool worker / download thread, its scratch survives between files
+    thread_local BeatmapParser parser;
+    ParsedBeatmap parsed;
+
+    // hit objects are only counted, see tally_hit_objects
+    if (!parser.parse_header_content(content, parsed)) {
+        return false;
+    }
+
+    beatmap = {};
+    beatmap.md5 = binary::md5_hex(content);
+    beatmap.folder_name = folder_name;
+    beatmap.osu_file_name = file_name;
+
+    beatmap.artist = parsed.metadata.artist;
+    beatmap.artist_unicode = parsed.metadata.artist_unicode;
+    beatmap.title = parsed.metadata.title;
+    beatmap.title_unicode = parsed.metadata.title_unicode;
+    beatmap.creator = parsed.metadata.creator;
+    beatmap.difficulty = parsed.metadata.version;
+    beatmap.source = parsed.metadata.source;
+    beatmap.tags = parsed.metadata.tags;
+    beatmap.difficulty_id = parsed.metadata.beatmap_id;
+    beatmap.beatmap_id = parsed.metadata.beatmap_set_id;
+
+    beatmap.audio_file_name = parsed.general.audio_filename;
+    beatmap.audio_preview_time = parsed.general.preview_time;
+    beatmap.stack_leniency = parsed.general.stack_leniency;
+    beatmap.mode = parsed.general.mode;
+
+    beatmap.approach_rate = parsed.difficulty.approach_rate;
+    beatmap.circle_size = parsed.difficulty.circle_size;
+    beatmap.hp_drain = parsed.difficulty.hp_drain_rate;
+    beatmap.overall_difficulty = parsed.difficulty.overall_difficulty;
+    beatmap.slider_velocity = parsed.difficulty.slider_multiplier;
+
+    int first_object = 0;
+    int last_object = 0;
+    tally_hit_objects(content, beatmap, first_object, last_object);
+
+    int break_time = 0;
+    for (const auto& event_break : parsed.breaks) {
+        break_time += std::max(0, event_break.end_time - event_break.start_time);
+    }
+
+    beatmap.total_time = last_object;
+    beatmap.drain_time = std::max(0, last_object - first_object - break_time) / 1000;
+
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    );
+    beatmap.last_modification_time = UNIX_EPOCH_TICKS + now.count() * 10000;
+    return true;
+}
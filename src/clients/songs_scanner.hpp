@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../parser/legacy/legacy.hpp"
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SongsScanOptions {
+    size_t folders_per_task = 32; // set folders handed to a pool worker at once
+};
+
+struct SongsScanResult {
+    std::vector<LegacyBeatmap> beatmaps;
+    size_t folders = 0;
+    size_t failed = 0; // .osu files that couldn't be read or parsed
+};
+
+namespace songs_scanner {
+    // indexes every "<Songs>/<set folder>/*.osu" on g_thread_pool, for when osu!.db is
+    // missing or out of date. blocks until done, don't call it from a pool task
+    SongsScanResult scan(const std::filesystem::path& songs_directory, const SongsScanOptions& options = {});
+
+    // osu!.db style entry for a .osu file, folder_name / file_name relative to Songs
+    bool build_beatmap(
+        std::string_view content, const std::string& folder_name, const std::string& file_name, LegacyBeatmap& beatmap
+    );
+} // namespace songs_scanner
@@ -1,5 +1,6 @@
 #include "stable.hpp"
 #include "../parser/legacy/legacy_collection.hpp"
+#include "songs_scanner.hpp"
 
 #include <utility>
 
@@ -11,7 +12,11 @@ StableClient::StableClient(ClientOptions options) : m_options(std::move(options)
 
     const std::filesystem::path osu_path(m_options.osu_path);
 
-    load_beatmaps(osu_path / "osu!.db");
+    if (!load_beatmaps(osu_path / "osu!.db")) {
+        // missing or unreadable database, index the folder instead
+        rescan_songs();
+    }
+
     load_collections(osu_path / "collection.db");
     rebuild_beatmapsets_from_beatmaps();
 }
@@ -73,12 +78,56 @@ bool StableClient::update_collection() {
     return legacy_collection_parser::write(output_path.string(), &database);
 }
 
-void StableClient::load_beatmaps(const std::filesystem::path& database_path) {
+OsuBeatmap* StableClient::add_beatmap(const LegacyBeatmap& legacy_beatmap) {
+    if (legacy_beatmap.md5.empty() || m_beatmaps.find(legacy_beatmap.md5) != m_beatmaps.end()) {
+        return nullptr;
+    }
+
+    auto beatmap = std::make_unique<OsuBeatmap>(legacy_beatmap);
+    beatmap->build_search();
+
+    OsuBeatmap* result = beatmap.get();
+    m_beatmaps.emplace(result->md5, std::move(beatmap));
+    add_to_beatmapset(result);
+    return result;
+}
+
+bool StableClient::rescan_songs() {
+    if (m_options.osu_path.empty()) {
+        return false;
+    }
+
+    const std::filesystem::path songs_path = std::filesystem::path(m_options.osu_path) / "Songs";
+
+    if (!std::filesystem::is_directory(songs_path)) {
+        return false;
+    }
+
+    SongsScanResult result = songs_scanner::scan(songs_path);
+
+    if (result.failed > 0) {
+        std::cout << "warn: failed to index " << result.failed << " beatmaps" << "\n";
+    }
+
+    m_beatmaps.clear();
+    m_beatmaps.reserve(result.beatmaps.size());
+
+    for (const auto& legacy_beatmap : result.beatmaps) {
+        auto beatmap = std::make_unique<OsuBeatmap>(legacy_beatmap);
+        beatmap->build_search();
+        m_beatmaps.emplace(beatmap->md5, std::move(beatmap));
+    }
+
+    rebuild_beatmapsets_from_beatmaps();
+    return true;
+}
+
+bool StableClient::load_beatmaps(const std::filesystem::path& database_path) {
     OsuLegacyDatabase database;
     std::filesystem::path mutable_path = database_path;
 
     if (!legacy_parser::parse(mutable_path, &database)) {
-        return;
+        return false;
     }
 
     m_player_name = database.player_name;
@@ -88,6 +137,8 @@ void StableClient::load_beatmaps(const std::filesystem::path& database_path) {
         beatmap->build_search();
         m_beatmaps.emplace(beatmap->md5, std::move(beatmap));
     }
+
+    return true;
 }
 
 void StableClient::load_collections(const std::filesystem::path& database_path) {
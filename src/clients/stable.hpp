@@ -14,8 +14,15 @@ public:
     fetch_missing_beatmaps_from_collections(std::string_view collection_name) override;
     [[nodiscard]] bool update_collection() override;
 
+    // registers a freshly imported difficulty without reloading osu!.db, nullptr when the
+    // md5 is already known. not thread safe, call it from the thread that owns the client
+    OsuBeatmap* add_beatmap(const LegacyBeatmap& legacy_beatmap);
+
+    // replaces the beatmaps from osu!.db with whatever is in the Songs folder
+    bool rescan_songs();
+
 private:
-    void load_beatmaps(const std::filesystem::path& database_path);
+    bool load_beatmaps(const std::filesystem::path& database_path);
     void load_collections(const std::filesystem::path& database_path);
 
     ClientOptions m_options;
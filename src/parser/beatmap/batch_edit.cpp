@@ -0,0 +1,435 @@
+#include "batch_edit.hpp"
+#include "../../utils/binary.hpp"
+#include "../../utils/md5.hpp"
+#include "../../utils/thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+    struct WorkerResult {
+        std::vector<std::pair<size_t, BatchEditChange>> changes;
+        size_t matched = 0;
+        size_t failed = 0;
+    };
+
+    using SectionLines = std::array<std::vector<std::string_view>, SECTION_COUNT>;
+
+    // what changed in one section between two serializer outputs
+    struct SectionEdit {
+        bool changed = false;
+        std::vector<std::pair<std::string_view, std::string_view>> keys; // key -> new line, empty removes the key
+        std::vector<std::string_view> lines;                              // the whole list for list sections
+    };
+
+    using SectionEdits = std::array<SectionEdit, SECTION_COUNT>;
+
+    bool is_key_value_section(size_t section) {
+        return section != Events && section != TimingPoints && section != HitObjects;
+    }
+
+    std::string_view line_key(std::string_view line) {
+        return trim_view(line.substr(0, line.find(':')));
+    }
+
+    // lines the parser turns into ParsedBeatmap fields. storyboard events, comments and
+    // whatever else the parser skips are kept when a list section is rewritten
+    bool is_parsed_line(size_t section, std::string_view raw, std::string_view line) {
+        if (line.starts_with("//")) {
+            return false;
+        }
+
+        if (section != Events) {
+            return true;
+        }
+
+        // storyboard commands are indented
+        if (raw[0] == ' ' || raw[0] == '_') {
+            return false;
+        }
+
+        const auto type = trim_view(line.substr(0, line.find(',')));
+        return type == "0" || type == "1" || type == "Video" || type == "2" || type == "Break";
+    }
+
+    // serializer output has no comments or repeated sections, so a plain split is enough
+    void split_serialized(std::string_view text, SectionLines& sections) {
+        for (auto& lines : sections) {
+            lines.clear();
+        }
+
+        size_t current = SECTION_COUNT;
+        size_t start = 0;
+
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+
+            if (end == std::string_view::npos) {
+                end = text.size();
+            }
+
+            const auto line = trim_view(text.substr(start, end - start));
+            start = end + 1;
+
+            if (line.empty()) {
+                continue;
+            }
+
+            if (line[0] == '[') {
+                current = find_section(line);
+            } else if (current < SECTION_COUNT) {
+                sections[current].push_back(line);
+            }
+        }
+    }
+
+    void diff_sections(const SectionLines& before, const SectionLines& after, SectionEdits& edits) {
+        const auto find_key = [](const std::vector<std::string_view>& lines, std::string_view key) {
+            return std::find_if(lines.begin(), lines.end(), [key](std::string_view line) {
+                return line_key(line) == key;
+            });
+        };
+
+        for (size_t section = 0; section < SECTION_COUNT; section++) {
+            auto& edit = edits[section];
+            edit = {};
+
+            if (before[section] == after[section]) {
+                continue;
+            }
+
+            edit.changed = true;
+
+            if (!is_key_value_section(section)) {
+                edit.lines = after[section];
+                continue;
+            }
+
+            for (const auto line : after[section]) {
+                const auto key = line_key(line);
+                const auto it = find_key(before[section], key);
+
+                if (it == before[section].end() || *it != line) {
+                    edit.keys.emplace_back(key, line);
+                }
+            }
+
+            for (const auto line : before[section]) {
+                const auto key = line_key(line);
+
+                if (find_key(after[section], key) == after[section].end()) {
+                    edit.keys.emplace_back(key, std::string_view{});
+                }
+            }
+        }
+    }
+
+    // the original text with only the edited lines swapped, every other byte (comments,
+    // storyboards, [Variables], unknown keys, line endings) is copied as is. like the
+    // parser, only the first block of a repeated section is edited
+    void patch_content(std::string_view original, const SectionEdits& edits, std::string& out) {
+        const std::string_view eol = original.find("\r\n") != std::string_view::npos ? "\r\n" : "\n";
+
+        out.clear();
+        out.reserve(original.size() + 256);
+
+        std::array<bool, SECTION_COUNT> seen{};
+        std::vector<bool> written; // keys of the current section that got their new line
+        bool lines_written = false;
+        size_t current = SECTION_COUNT;
+        size_t insert_at = 0; // after the last non empty line of the current section
+
+        const auto append_lines = [&](std::string& target, size_t section) {
+            if (!is_key_value_section(section)) {
+                for (const auto line : edits[section].lines) {
+                    target.append(line).append(eol);
+                }
+                return;
+            }
+
+            for (size_t i = 0; i < edits[section].keys.size(); i++) {
+                const auto line = edits[section].keys[i].second;
+
+                if (!line.empty() && (written.empty() || !written[i])) {
+                    target.append(line).append(eol);
+                }
+            }
+        };
+
+        // new keys go at the end of their section, a list section without a single parsed line gets its list there
+        const auto close_section = [&]() {
+            if (current >= SECTION_COUNT || !edits[current].changed) {
+                return;
+            }
+
+            if (!is_key_value_section(current) && lines_written) {
+                return;
+            }
+
+            std::string tail;
+            append_lines(tail, current);
+
+            if (tail.empty()) {
+                return;
+            }
+
+            if (insert_at > 0 && out[insert_at - 1] != '\n') {
+                tail.insert(0, eol);
+            }
+
+            out.insert(insert_at, tail);
+        };
+
+        // sections the original doesn't have are added before the first one that follows them
+        const auto add_missing = [&](size_t until) {
+            written.clear();
+
+            for (size_t section = 0; section < until; section++) {
+                if (seen[section] || !edits[section].changed) {
+                    continue;
+                }
+
+                seen[section] = true;
+                std::string block;
+                append_lines(block, section);
+
+                if (block.empty()) {
+                    continue;
+                }
+
+                if (!out.empty() && out.back() != '\n') {
+                    out.append(eol);
+                }
+
+                out.append("[").append(SECTION_NAMES[section]).append("]").append(eol);
+                out.append(block).append(eol);
+            }
+        };
+
+        size_t start = 0;
+
+        while (start < original.size()) {
+            size_t end = original.find('\n', start);
+            end = end == std::string_view::npos ? original.size() : end + 1;
+
+            const auto raw = original.substr(start, end - start);
+            const auto line = trim_view(raw);
+            start = end;
+
+            if (!line.empty() && line[0] == '[') {
+                close_section();
+
+                const size_t section = find_section(line);
+                current = SECTION_COUNT;
+
+                if (section < SECTION_COUNT && !seen[section]) {
+                    add_missing(section);
+                    seen[section] = true;
+                    current = section;
+                    written.assign(edits[section].keys.size(), false);
+                    lines_written = false;
+                }
+
+                out.append(raw);
+                insert_at = out.size();
+                continue;
+            }
+
+            if (line.empty() || current >= SECTION_COUNT || !edits[current].changed || line.starts_with("//")) {
+                out.append(raw);
+                insert_at = line.empty() ? insert_at : out.size();
+                continue;
+            }
+
+            const auto& edit = edits[current];
+
+            if (is_key_value_section(current)) {
+                const auto key = line_key(line);
+                const auto it = std::find_if(edit.keys.begin(), edit.keys.end(), [key](const auto& entry) {
+                    return entry.first == key;
+                });
+
+                if (it == edit.keys.end()) {
+                    out.append(raw);
+                    insert_at = out.size();
+                    continue;
+                }
+
+                // a repeated key is dropped, the first one gets the new value
+                const size_t index = static_cast<size_t>(it - edit.keys.begin());
+
+                if (!it->second.empty() && !written[index]) {
+                    const size_t ending = raw.find_last_not_of("\r\n") + 1;
+                    out.append(it->second).append(raw.substr(ending));
+                    written[index] = true;
+                    insert_at = out.size();
+                }
+
+                continue;
+            }
+
+            if (!is_parsed_line(current, raw, line)) {
+                out.append(raw);
+                insert_at = out.size();
+                continue;
+            }
+
+            // the new list replaces the first parsed line, the others are dropped
+            if (!lines_written) {
+                append_lines(out, current);
+                lines_written = true;
+                insert_at = out.size();
+            }
+        }
+
+        close_section();
+        add_missing(SECTION_COUNT);
+    }
+
+    WorkerResult run_worker(
+        const std::vector<std::filesystem::path>& files, std::atomic<size_t>& next,
+        const beatmap_batch::Predicate& predicate, const beatmap_batch::Transform& transform
+    ) {
+        WorkerResult result;
+        BeatmapParser parser;
+        ParsedBeatmap beatmap;
+        std::string content;
+        std::string before;
+        std::string output;
+        SectionLines before_lines;
+        SectionLines after_lines;
+        SectionEdits edits;
+
+        for (size_t index = next++; index < files.size(); index = next++) {
+            const auto& path = files[index];
+
+            // a throwing predicate / transform fails its file, the other files keep going
+            try {
+                if (!parser.parse_header(path.string(), beatmap)) {
+                    std::cerr << "[batch] failed to read " << path.string() << "\n";
+                    result.failed++;
+                    continue;
+                }
+
+                if (predicate && !predicate(beatmap)) {
+                    continue;
+                }
+
+                result.matched++;
+
+                if (!read_file_text(path.string(), content) || !parser.parse_content(content, beatmap)) {
+                    std::cerr << "[batch] failed to parse " << path.string() << "\n";
+                    result.failed++;
+                    continue;
+                }
+
+                // the serializer normalizes formatting, so both sides of the diff go through it
+                before = parser.serialize(beatmap);
+                transform(beatmap);
+                const std::string& after = parser.serialize(beatmap);
+
+                if (after == before) {
+                    continue;
+                }
+
+                split_serialized(before, before_lines);
+                split_serialized(after, after_lines);
+                diff_sections(before_lines, after_lines, edits);
+                patch_content(content, edits, output);
+
+                if (output == content) {
+                    continue;
+                }
+
+                if (!binary::write_file_atomic(path.string(), output)) {
+                    std::cerr << "[batch] failed to replace " << path.string() << "\n";
+                    result.failed++;
+                    continue;
+                }
+
+                result.changes.push_back({index, {path, binary::md5_hex(content), binary::md5_hex(output)}});
+            } catch (const std::exception& e) {
+                std::cerr << "[batch] failed to edit " << path.string() << ": " << e.what() << "\n";
+                result.failed++;
+            } catch (...) {
+                std::cerr << "[batch] failed to edit " << path.string() << "\n";
+                result.failed++;
+            }
+        }
+
+        return result;
+    }
+} // namespace
+
+BatchEditResult beatmap_batch::edit(
+    const std::vector<std::filesystem::path>& files, const Predicate& predicate, const Transform& transform,
+    const BatchEditOptions& options
+) {
+    BatchEditResult result;
+
+    if (files.empty() || !transform) {
+        return result;
+    }
+
+    g_thread_pool.initialize();
+
+    // every worker pulls the next file, so at most max_in_flight files are open at once
+    const size_t worker_count = std::clamp<size_t>(options.max_in_flight, 1, files.size());
+    std::atomic<size_t> next = 0;
+    std::vector<std::future<WorkerResult>> workers;
+    workers.reserve(worker_count);
+
+    for (size_t i = 0; i < worker_count; i++) {
+        workers.push_back(g_thread_pool.enqueue([&files, &next, &predicate, &transform]() {
+            return run_worker(files, next, predicate, transform);
+        }));
+    }
+
+    std::vector<std::pair<size_t, BatchEditChange>> changes;
+
+    for (auto& worker : workers) {
+        WorkerResult partial = worker.get();
+        result.matched += partial.matched;
+        result.failed += partial.failed;
+        changes.insert(changes.end(), std::make_move_iterator(partial.changes.begin()),
+                       std::make_move_iterator(partial.changes.end()));
+    }
+
+    std::sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    result.changes.reserve(changes.size());
+
+    for (auto& change : changes) {
+        result.changes.push_back(std::move(change.second));
+    }
+
+    return result;
+}
+
+size_t beatmap_batch::apply(OsuLegacyDatabase& database, const BatchEditResult& result) {
+    std::unordered_map<std::string_view, const BatchEditChange*> by_md5;
+    by_md5.reserve(result.changes.size());
+
+    for (const auto& change : result.changes) {
+        by_md5.emplace(change.old_md5, &change);
+    }
+
+    size_t updated = 0;
+
+    for (auto& beatmap : database.beatmaps) {
+        const auto it = by_md5.find(beatmap.md5);
+
+        if (it == by_md5.end()) {
+            continue;
+        }
+
+        beatmap.md5 = it->second->new_md5;
+        updated++;
+    }
+
+    return updated;
+}
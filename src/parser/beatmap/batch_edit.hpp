@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../legacy/legacy.hpp"
+#include "beatmap.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BatchEditOptions {
+    size_t max_in_flight = 8; // upper bound of files being read, parsed or written at once
+};
+
+struct BatchEditChange {
+    std::filesystem::path path;
+    std::string old_md5;
+    std::string new_md5;
+};
+
+struct BatchEditResult {
+    std::vector<BatchEditChange> changes; // in input order
+    size_t matched = 0;                   // files the predicate accepted, changed or not
+    size_t failed = 0;                    // couldn't be read, parsed or replaced
+};
+
+namespace beatmap_batch {
+    // sees a header only parse ([General] to [Events]), so non matching files cost
+    // the first few KB of a read
+    using Predicate = std::function<bool(const ParsedBeatmap&)>;
+    // gets the full map, called from pool workers at the same time
+    using Transform = std::function<void(ParsedBeatmap&)>;
+
+    // parse -> transform -> write for every matching file on g_thread_pool. only the lines
+    // whose value the transform changed are replaced, the rest of the file (storyboard,
+    // comments, keys the parser doesn't know) stays byte for byte. each file is replaced
+    // through binary::write_file_atomic, files whose text didn't change are left alone
+    // and a throwing predicate / transform counts as a failed file.
+    // blocks until done, don't call it from a pool task
+    BatchEditResult edit(
+        const std::vector<std::filesystem::path>& files, const Predicate& predicate, const Transform& transform,
+        const BatchEditOptions& options = {}
+    );
+
+    // points osu!.db entries at the rewritten files, returns how many were updated.
+    // collections store md5s too, they need the same old -> new mapping
+    size_t apply(OsuLegacyDatabase& database, const BatchEditResult& result);
+} // namespace beatmap_batch
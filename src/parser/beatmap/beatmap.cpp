@@ -3,9 +3,9 @@
 #include "writer.hpp"
 
 #include <algorithm>
+#include <array>
 #include <climits>
 #include <fstream>
-#include <functional>
 #include <string_view>
 #include <unordered_set>
 
@@ -20,19 +20,9 @@ static const std::unordered_set<std::string>& get_image_extensions() {
     return extensions;
 }
 
-static std::string_view trim_view(std::string_view s) {
-    size_t start = s.find_first_not_of(" \t\r\n");
-
-    if (start == std::string_view::npos) {
-        return "";
-    }
-
-    size_t end = s.find_last_not_of(" \t\r\n");
-    return s.substr(start, end - start + 1);
-}
-
-static std::vector<std::string_view> split_view(std::string_view s, char delim) {
-    std::vector<std::string_view> result;
+// fills a scratch vector owned by the parser instead of returning a new one
+static void split_view(std::string_view s, char delim, std::vector<std::string_view>& result) {
+    result.clear();
     size_t start = 0;
     size_t end = s.find(delim);
 
@@ -43,7 +33,6 @@ static std::vector<std::string_view> split_view(std::string_view s, char delim)
     }
 
     result.push_back(s.substr(start));
-    return result;
 }
 
 static std::string normalize_path(const std::string& path) {
@@ -84,50 +73,85 @@ static std::pair<std::string_view, std::string_view> split_key_value(std::string
     return {trim_view(line.substr(0, delim)), trim_view(line.substr(delim + 1))};
 }
 
-static void iterate_lines(std::string_view content, const std::function<void(std::string_view)>& callback) {
-    size_t start = 0;
-    size_t end = content.find('\n');
-
-    while (end != std::string_view::npos) {
-        callback(trim_view(content.substr(start, end - start)));
-        start = end + 1;
-        end = content.find('\n', start);
+// one pass over the file, every non empty line goes to the section it belongs to.
+// comments and unknown sections are dropped, a repeated section keeps its first block
+static void split_sections(std::string_view content, std::array<std::vector<std::string_view>, SECTION_COUNT>& sections) {
+    for (auto& lines : sections) {
+        lines.clear();
     }
 
-    if (start < content.size()) {
-        callback(trim_view(content.substr(start)));
-    }
-}
+    std::array<bool, SECTION_COUNT> seen{};
+    std::vector<std::string_view>* current = nullptr;
+    size_t start = 0;
 
-static std::vector<std::string_view> get_section(std::string_view content, std::string_view section_name) {
-    std::vector<std::string_view> result;
-    std::string target = "[" + std::string(section_name) + "]";
-    bool in_section = false;
-    bool done = false;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
 
-    iterate_lines(content, [&](std::string_view line) {
-        if (done) {
-            return;
+        if (end == std::string_view::npos) {
+            end = content.size();
         }
+
+        const auto line = trim_view(content.substr(start, end - start));
+        start = end + 1;
+
         if (line.empty()) {
-            return;
+            continue;
         }
 
         if (line[0] == '[') {
-            if (in_section) {
-                done = true;
-                return;
+            const size_t section = find_section(line);
+            current = nullptr;
+
+            if (section < SECTION_COUNT && !seen[section]) {
+                seen[section] = true;
+                current = &sections[section];
             }
-            in_section = (line == target);
-            return;
+
+            continue;
         }
 
-        if (in_section && line[0] != '/') {
-            result.push_back(line);
+        if (current != nullptr && line[0] != '/') {
+            current->push_back(line);
         }
-    });
+    }
+}
 
-    return result;
+// the sections parse_header needs, everything after them is skipped
+static constexpr std::array<size_t, 4> HEADER_SECTIONS = {General, Metadata, Difficulty, Events};
+static constexpr size_t HEADER_CHUNK_SIZE = 16 * 1024;
+
+struct HeaderScan {
+    size_t offset = 0; // start of the first line that wasn't looked at yet
+    size_t current = SECTION_COUNT;
+    std::array<bool, SECTION_COUNT> closed{};
+};
+
+// walks the complete lines that arrived since the last call and returns where the
+// header ends: the first section header after every HEADER_SECTIONS entry was closed
+static size_t find_header_end(std::string_view content, HeaderScan& scan) {
+    size_t end = content.find('\n', scan.offset);
+
+    while (end != std::string_view::npos) {
+        const size_t start = scan.offset;
+        const auto line = trim_view(content.substr(start, end - start));
+        scan.offset = end + 1;
+
+        if (!line.empty() && line[0] == '[') {
+            if (scan.current < SECTION_COUNT) {
+                scan.closed[scan.current] = true;
+            }
+
+            if (std::all_of(HEADER_SECTIONS.begin(), HEADER_SECTIONS.end(), [&](size_t i) { return scan.closed[i]; })) {
+                return start;
+            }
+
+            scan.current = find_section(line);
+        }
+
+        end = content.find('\n', scan.offset);
+    }
+
+    return std::string_view::npos;
 }
 
 static GeneralSection parse_general(const std::vector<std::string_view>& lines) {
@@ -179,14 +203,15 @@ static GeneralSection parse_general(const std::vector<std::string_view>& lines)
     return s;
 }
 
-static EditorSection parse_editor(const std::vector<std::string_view>& lines) {
+static EditorSection parse_editor(const std::vector<std::string_view>& lines, std::vector<std::string_view>& parts) {
     EditorSection s;
 
     for (const auto& line : lines) {
         auto [key, val] = split_key_value(line);
 
         if (key == "Bookmarks") {
-            for (const auto& p : split_view(val, ',')) {
+            split_view(val, ',', parts);
+            for (const auto& p : parts) {
                 auto t = trim_view(p);
                 if (!t.empty()) {
                     s.bookmarks.push_back(binary::convert_to<int>(t, 0));
@@ -259,12 +284,12 @@ static DifficultySection parse_difficulty(const std::vector<std::string_view>& l
     return s;
 }
 
-void parse_events(
-    const std::vector<std::string_view>& lines, std::optional<EventBackground>& bg, std::optional<EventVideo>& vid,
-    std::vector<EventBreak>& breaks
+static void parse_events(
+    const std::vector<std::string_view>& lines, std::vector<std::string_view>& parts, std::optional<EventBackground>& bg,
+    std::optional<EventVideo>& vid, std::vector<EventBreak>& breaks
 ) {
     for (const auto& line : lines) {
-        auto parts = split_view(line, ',');
+        split_view(line, ',', parts);
         if (parts.empty()) {
             continue;
         }
@@ -303,12 +328,13 @@ void parse_events(
     }
 }
 
-static std::vector<TimingPoint> parse_timing_points(const std::vector<std::string_view>& lines) {
-    std::vector<TimingPoint> points;
+static void parse_timing_points(
+    const std::vector<std::string_view>& lines, std::vector<std::string_view>& parts, std::vector<TimingPoint>& points
+) {
     points.reserve(lines.size());
 
     for (const auto& line : lines) {
-        auto parts = split_view(line, ',');
+        split_view(line, ',', parts);
         if (parts.size() < 2) {
             continue;
         }
@@ -325,16 +351,14 @@ static std::vector<TimingPoint> parse_timing_points(const std::vector<std::strin
 
         points.push_back(tp);
     }
-
-    return points;
 }
 
-static ColourSection parse_colours(const std::vector<std::string_view>& lines) {
+static ColourSection parse_colours(const std::vector<std::string_view>& lines, std::vector<std::string_view>& parts) {
     ColourSection s;
 
     for (const auto& line : lines) {
         auto [key, val] = split_key_value(line);
-        auto parts = split_view(val, ',');
+        split_view(val, ',', parts);
 
         if (parts.size() < 3) {
             continue;
@@ -357,29 +381,40 @@ static ColourSection parse_colours(const std::vector<std::string_view>& lines) {
     return s;
 }
 
-static HitSample parse_hit_sample(std::string_view str) {
+static HitSample parse_hit_sample(std::string_view str, std::vector<std::string_view>& parts, std::string& files) {
     HitSample hs;
-    auto parts = split_view(str, ':');
+    split_view(str, ':', parts);
 
     if (!parts.empty()) hs.normal_set = binary::convert_to<int>(parts[0], 0);
     if (parts.size() > 1) hs.addition_set = binary::convert_to<int>(parts[1], 0);
     if (parts.size() > 2) hs.index = binary::convert_to<int>(parts[2], 0);
     if (parts.size() > 3) hs.volume = binary::convert_to<int>(parts[3], 0);
-    if (parts.size() > 4) hs.filename = std::string(trim_view(parts[4]));
+
+    if (parts.size() > 4) {
+        const auto filename = trim_view(parts[4]);
+        hs.filename_offset = static_cast<uint32_t>(files.size());
+        hs.filename_size = static_cast<uint32_t>(filename.size());
+        files.append(filename);
+    }
 
     return hs;
 }
 
+// same as "0:0:0:0:"
 static HitSample default_hit_sample() {
-    return parse_hit_sample("0:0:0:0:");
+    return HitSample{};
 }
 
-static std::vector<HitObject> parse_hit_objects(const std::vector<std::string_view>& lines) {
-    std::vector<HitObject> objects;
-    objects.reserve(lines.size());
+// parts holds the object's fields, fields / values the nested curve, edge and sample lists.
+// appends to list, which is expected to be cleared
+static void parse_hit_objects(
+    const std::vector<std::string_view>& lines, std::vector<std::string_view>& parts,
+    std::vector<std::string_view>& fields, std::vector<std::string_view>& values, HitObjectList& list
+) {
+    list.objects.reserve(lines.size());
 
     for (const auto& line : lines) {
-        auto parts = split_view(line, ',');
+        split_view(line, ',', parts);
         if (parts.size() < 5) {
             continue;
         }
@@ -397,86 +432,91 @@ static std::vector<HitObject> parse_hit_objects(const std::vector<std::string_vi
         bool is_hold = (ho.type & 128) != 0;
 
         if (is_slider && parts.size() >= 8) {
-            auto curve_parts = split_view(parts[5], '|');
+            split_view(parts[5], '|', fields);
+            ho.curve_offset = static_cast<uint32_t>(list.curve_points.size());
 
-            if (!curve_parts.empty()) {
-                auto type_str = trim_view(curve_parts[0]);
+            if (!fields.empty()) {
+                auto type_str = trim_view(fields[0]);
                 if (!type_str.empty()) {
                     ho.curve_type = type_str[0];
                 }
 
-                for (size_t i = 1; i < curve_parts.size(); i++) {
-                    auto point = split_view(curve_parts[i], ':');
-                    if (point.size() >= 2) {
-                        ho.curve_points.push_back(
-                            {binary::convert_to<int>(point[0], 0), binary::convert_to<int>(point[1], 0)}
+                for (size_t i = 1; i < fields.size(); i++) {
+                    split_view(fields[i], ':', values);
+                    if (values.size() >= 2) {
+                        list.curve_points.push_back(
+                            {binary::convert_to<int>(values[0], 0), binary::convert_to<int>(values[1], 0)}
                         );
                     }
                 }
             }
 
+            ho.curve_count = static_cast<uint32_t>(list.curve_points.size() - ho.curve_offset);
             ho.slides = std::max(0, binary::convert_to<int>(parts[6], 1));
             ho.length = binary::convert_to<double>(parts[7], 0.0);
             size_t edge_count = static_cast<size_t>(ho.slides) + 1;
 
+            ho.edge_sounds_offset = static_cast<uint32_t>(list.edge_sounds.size());
+
             if (parts.size() > 8) {
-                for (const auto& s : split_view(parts[8], '|')) {
-                    ho.edge_sounds.push_back(binary::convert_to<int>(s, 0));
+                split_view(parts[8], '|', fields);
+                for (const auto& s : fields) {
+                    list.edge_sounds.push_back(binary::convert_to<int>(s, 0));
                 }
             } else {
-                ho.edge_sounds.assign(edge_count, 0);
+                list.edge_sounds.insert(list.edge_sounds.end(), edge_count, 0);
             }
 
+            ho.edge_sounds_count = static_cast<uint32_t>(list.edge_sounds.size() - ho.edge_sounds_offset);
+            ho.edge_sets_offset = static_cast<uint32_t>(list.edge_sets.size());
+
             if (parts.size() > 9) {
-                for (const auto& ep : split_view(parts[9], '|')) {
-                    auto set = split_view(ep, ':');
-                    if (set.size() >= 2) {
-                        ho.edge_sets.push_back(
-                            {binary::convert_to<int>(set[0], 0), binary::convert_to<int>(set[1], 0)}
+                split_view(parts[9], '|', fields);
+                for (const auto& ep : fields) {
+                    split_view(ep, ':', values);
+                    if (values.size() >= 2) {
+                        list.edge_sets.push_back(
+                            {binary::convert_to<int>(values[0], 0), binary::convert_to<int>(values[1], 0)}
                         );
                     }
                 }
             } else {
-                ho.edge_sets.assign(edge_count, {0, 0});
+                list.edge_sets.insert(list.edge_sets.end(), edge_count, {0, 0});
             }
 
+            ho.edge_sets_count = static_cast<uint32_t>(list.edge_sets.size() - ho.edge_sets_offset);
+
             if (parts.size() > 10) {
-                ho.sample = parse_hit_sample(parts[10]);
+                ho.sample = parse_hit_sample(parts[10], values, list.sample_files);
             } else {
                 ho.sample = default_hit_sample();
             }
         } else if (is_spinner && parts.size() >= 6) {
             ho.end_time = binary::convert_to<int>(parts[5], 0);
             if (parts.size() > 6) {
-                ho.sample = parse_hit_sample(parts[6]);
+                ho.sample = parse_hit_sample(parts[6], values, list.sample_files);
             } else {
                 ho.sample = default_hit_sample();
             }
         } else if (is_hold && parts.size() >= 6) {
-            auto hold_parts = split_view(parts[5], ':');
-            if (!hold_parts.empty()) {
-                ho.end_time = binary::convert_to<int>(hold_parts[0], 0);
-            }
-            if (hold_parts.size() > 1) {
-                std::string sample_str;
-                for (size_t i = 1; i < hold_parts.size(); i++) {
-                    if (i > 1) sample_str += ":";
-                    sample_str += std::string(hold_parts[i]);
-                }
-                ho.sample = parse_hit_sample(sample_str);
+            // "end_time:sample", the sample is everything after the first colon
+            const auto hold = parts[5];
+            const size_t colon = hold.find(':');
+            ho.end_time = binary::convert_to<int>(hold.substr(0, colon), 0);
+
+            if (colon != std::string_view::npos) {
+                ho.sample = parse_hit_sample(hold.substr(colon + 1), values, list.sample_files);
             } else {
                 ho.sample = default_hit_sample();
             }
         } else if (is_circle && parts.size() >= 6) {
-            ho.sample = parse_hit_sample(parts[5]);
+            ho.sample = parse_hit_sample(parts[5], values, list.sample_files);
         } else if (is_circle) {
             ho.sample = default_hit_sample();
         }
 
-        objects.push_back(ho);
+        list.objects.push_back(ho);
     }
-
-    return objects;
 }
 
 static int parse_version(std::string_view content) {
@@ -491,7 +531,7 @@ static int parse_version(std::string_view content) {
     return 14;
 }
 
-static bool read_file_text(const std::string& location, std::string& out) {
+bool read_file_text(const std::string& location, std::string& out) {
     std::ifstream file(location, std::ios::binary | std::ios::ate);
 
     if (!file.is_open()) {
@@ -515,212 +555,285 @@ static bool read_file_text(const std::string& location, std::string& out) {
     return true;
 }
 
-static std::string serialize_hit_sample(const HitSample& hs) {
-    return std::to_string(hs.normal_set) + ":" + std::to_string(hs.addition_set) + ":" + std::to_string(hs.index) +
-           ":" + std::to_string(hs.volume) + ":" + hs.filename;
+static void put_hit_sample(BeatmapWriter& writer, const HitSample& hs, const HitObjectList& list) {
+    writer.put_int(hs.normal_set).put(':').put_int(hs.addition_set).put(':').put_int(hs.index).put(':');
+    writer.put_int(hs.volume).put(':').put(list.sample_file(hs));
 }
 
-static std::string serialize_curve(const HitObject& ho) {
-    std::ostringstream ss;
-    ss << ho.curve_type;
-    for (const auto& pt : ho.curve_points) {
-        ss << "|" << pt.first << ":" << pt.second;
+static void put_curve(BeatmapWriter& writer, const HitObject& ho, const HitObjectList& list) {
+    writer.put(ho.curve_type);
+    for (const auto& pt : list.curve(ho)) {
+        writer.put('|').put_int(pt.first).put(':').put_int(pt.second);
     }
-    return ss.str();
 }
 
-bool beatmap_parser::parse(std::string location) {
-    if (data == nullptr) {
-        last_error = "parser data is null";
+static void put_colour(BeatmapWriter& writer, const std::array<int, 3>& c) {
+    writer.put_int(c[0]).put(',').put_int(c[1]).put(',').put_int(c[2]).end_line();
+}
+
+// rough upper bound of the output, one reserve instead of regrowing the buffer
+static size_t estimate_size(const ParsedBeatmap& beatmap) {
+    const auto& objects = beatmap.hit_objects;
+    return 4096 + beatmap.metadata.tags.size() + beatmap.timing_points.size() * 64 + objects.size() * 48 +
+           objects.curve_points.size() * 12 + (objects.edge_sounds.size() + objects.edge_sets.size()) * 12 +
+           objects.sample_files.size();
+}
+
+bool BeatmapParser::parse(const std::string& location, ParsedBeatmap& beatmap) {
+    if (!read_file_text(location, m_content)) {
+        m_last_error = "failed to read file";
         return false;
     }
 
-    beatmap_parser::location = std::move(location);
-    std::string content;
+    return parse_content(m_content, beatmap);
+}
+
+bool BeatmapParser::parse_content(std::string_view content, ParsedBeatmap& beatmap) {
+    parse_sections(content, beatmap, false);
+    return true;
+}
 
-    if (!read_file_text(beatmap_parser::location, content)) {
-        last_error = "failed to read file";
+bool BeatmapParser::parse_header(const std::string& location, ParsedBeatmap& beatmap) {
+    std::ifstream file(location, std::ios::binary);
+
+    if (!file.is_open()) {
+        m_last_error = "failed to read file";
         return false;
     }
 
-    const int parsed_version = parse_version(content);
+    HeaderScan scan;
+    size_t end = std::string::npos;
+    m_content.clear();
 
-    *data = ParsedBeatmap();
-    data->version = parsed_version;
-    data->general = parse_general(get_section(content, "General"));
-    data->editor = parse_editor(get_section(content, "Editor"));
-    data->metadata = parse_metadata(get_section(content, "Metadata"));
-    data->difficulty = parse_difficulty(get_section(content, "Difficulty"));
+    // most maps have their header in the first chunk, storyboard heavy [Events] take a few more
+    while (end == std::string::npos && file) {
+        const size_t size = m_content.size();
+        m_content.resize(size + HEADER_CHUNK_SIZE);
+        file.read(m_content.data() + size, HEADER_CHUNK_SIZE);
+        m_content.resize(size + static_cast<size_t>(file.gcount()));
+        end = find_header_end(m_content, scan);
+    }
 
-    auto events = get_section(content, "Events");
-    parse_events(events, data->background, data->video, data->breaks);
+    if (file.bad()) {
+        m_last_error = "failed to read file";
+        return false;
+    }
 
-    data->timing_points = parse_timing_points(get_section(content, "TimingPoints"));
-    data->colours = parse_colours(get_section(content, "Colours"));
-    data->hit_objects = parse_hit_objects(get_section(content, "HitObjects"));
+    parse_sections(std::string_view(m_content).substr(0, std::min(end, m_content.size())), beatmap, true);
+    return true;
+}
 
-    data->version = parsed_version;
-    last_error.clear();
+bool BeatmapParser::parse_header_content(std::string_view content, ParsedBeatmap& beatmap) {
+    HeaderScan scan;
+    const size_t end = find_header_end(content, scan);
+    parse_sections(content.substr(0, std::min(end, content.size())), beatmap, true);
     return true;
 }
 
-bool beatmap_parser::write() {
-    if (data == nullptr || location.empty()) {
-        last_error = data == nullptr ? "parser data is null" : "location is empty";
+void BeatmapParser::parse_sections(std::string_view content, ParsedBeatmap& beatmap, bool header_only) {
+    // keep the big arrays' capacity when the caller reuses the same ParsedBeatmap
+    HitObjectList hit_objects = std::move(beatmap.hit_objects);
+    std::vector<TimingPoint> timing_points = std::move(beatmap.timing_points);
+    hit_objects.clear();
+    timing_points.clear();
+
+    beatmap = ParsedBeatmap();
+    beatmap.hit_objects = std::move(hit_objects);
+    beatmap.timing_points = std::move(timing_points);
+    beatmap.version = parse_version(content);
+    split_sections(content, m_sections);
+
+    beatmap.general = parse_general(m_sections[General]);
+    beatmap.editor = parse_editor(m_sections[Editor], m_parts);
+    beatmap.metadata = parse_metadata(m_sections[Metadata]);
+    beatmap.difficulty = parse_difficulty(m_sections[Difficulty]);
+
+    parse_events(m_sections[Events], m_parts, beatmap.background, beatmap.video, beatmap.breaks);
+
+    if (header_only) {
+        m_last_error.clear();
+        return;
+    }
+
+    parse_timing_points(m_sections[TimingPoints], m_parts, beatmap.timing_points);
+    beatmap.colours = parse_colours(m_sections[Colours], m_parts);
+    parse_hit_objects(m_sections[HitObjects], m_parts, m_fields, m_values, beatmap.hit_objects);
+
+    m_last_error.clear();
+}
+
+bool BeatmapParser::write(const ParsedBeatmap& beatmap, const std::string& location) {
+    if (location.empty()) {
+        m_last_error = "location is empty";
         return false;
     }
 
-    BeatmapWriter writer;
+    const std::string& payload = serialize(beatmap);
+    std::ofstream file(location, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open()) {
+        m_last_error = "failed to write file";
+        return false;
+    }
+
+    file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
 
-    writer.line("osu file format v" + std::to_string(data->version));
+    if (!file.good()) {
+        m_last_error = "failed to write file";
+        return false;
+    }
+
+    m_last_error.clear();
+    return true;
+}
+
+const std::string& BeatmapParser::serialize(const ParsedBeatmap& beatmap) {
+    BeatmapWriter& writer = m_writer;
+    writer.clear();
+    writer.reserve(estimate_size(beatmap));
+
+    writer.put("osu file format v").put_int(beatmap.version).end_line();
     writer.blank();
 
     writer.section("General");
-    writer.key_value("AudioFilename", data->general.audio_filename);
-    writer.key_value("AudioLeadIn", data->general.audio_lead_in);
+    writer.key_value("AudioFilename", beatmap.general.audio_filename);
+    writer.key_value("AudioLeadIn", beatmap.general.audio_lead_in);
 
-    if (!data->general.audio_hash.empty()) {
-        writer.key_value("AudioHash", data->general.audio_hash);
+    if (!beatmap.general.audio_hash.empty()) {
+        writer.key_value("AudioHash", beatmap.general.audio_hash);
     }
 
-    writer.key_value("PreviewTime", data->general.preview_time);
-    writer.key_value("Countdown", data->general.countdown);
-    writer.key_value("SampleSet", data->general.sample_set);
-    writer.key_value_double("StackLeniency", data->general.stack_leniency);
-    writer.key_value("Mode", data->general.mode);
-    writer.key_value("LetterboxInBreaks", data->general.letterbox_in_breaks);
-    writer.key_value("StoryFireInFront", data->general.story_fire_in_front);
-    writer.key_value("UseSkinSprites", data->general.use_skin_sprites);
-    writer.key_value("AlwaysShowPlayfield", data->general.always_show_playfield);
-    writer.key_value("OverlayPosition", data->general.overlay_position);
+    writer.key_value("PreviewTime", beatmap.general.preview_time);
+    writer.key_value("Countdown", beatmap.general.countdown);
+    writer.key_value("SampleSet", beatmap.general.sample_set);
+    writer.key_value_double("StackLeniency", beatmap.general.stack_leniency);
+    writer.key_value("Mode", beatmap.general.mode);
+    writer.key_value("LetterboxInBreaks", beatmap.general.letterbox_in_breaks);
+    writer.key_value("StoryFireInFront", beatmap.general.story_fire_in_front);
+    writer.key_value("UseSkinSprites", beatmap.general.use_skin_sprites);
+    writer.key_value("AlwaysShowPlayfield", beatmap.general.always_show_playfield);
+    writer.key_value("OverlayPosition", beatmap.general.overlay_position);
 
-    if (!data->general.skin_preference.empty()) {
-        writer.key_value("SkinPreference", data->general.skin_preference);
+    if (!beatmap.general.skin_preference.empty()) {
+        writer.key_value("SkinPreference", beatmap.general.skin_preference);
     }
 
-    writer.key_value("EpilepsyWarning", data->general.epilepsy_warning);
-    writer.key_value("CountdownOffset", data->general.countdown_offset);
-    writer.key_value("SpecialStyle", data->general.special_style);
-    writer.key_value("WidescreenStoryboard", data->general.widescreen_storyboard);
-    writer.key_value("SamplesMatchPlaybackRate", data->general.samples_match_playback_rate);
+    writer.key_value("EpilepsyWarning", beatmap.general.epilepsy_warning);
+    writer.key_value("CountdownOffset", beatmap.general.countdown_offset);
+    writer.key_value("SpecialStyle", beatmap.general.special_style);
+    writer.key_value("WidescreenStoryboard", beatmap.general.widescreen_storyboard);
+    writer.key_value("SamplesMatchPlaybackRate", beatmap.general.samples_match_playback_rate);
 
     writer.blank();
 
     writer.section("Editor");
 
-    if (!data->editor.bookmarks.empty()) {
-        writer.key_value("Bookmarks", BeatmapWriter::join_ints(data->editor.bookmarks, ','));
+    if (!beatmap.editor.bookmarks.empty()) {
+        writer.put("Bookmarks:").put_ints(beatmap.editor.bookmarks, ',').end_line();
     }
 
-    writer.key_value_double("DistanceSpacing", data->editor.distance_spacing);
-    writer.key_value("BeatDivisor", data->editor.beat_divisor);
-    writer.key_value("GridSize", data->editor.grid_size);
-    writer.key_value_double("TimelineZoom", data->editor.timeline_zoom);
+    writer.key_value_double("DistanceSpacing", beatmap.editor.distance_spacing);
+    writer.key_value("BeatDivisor", beatmap.editor.beat_divisor);
+    writer.key_value("GridSize", beatmap.editor.grid_size);
+    writer.key_value_double("TimelineZoom", beatmap.editor.timeline_zoom);
 
     writer.blank();
 
     writer.section("Metadata");
-    writer.key_value("Title", data->metadata.title);
+    writer.key_value("Title", beatmap.metadata.title);
 
-    if (!data->metadata.title_unicode.empty()) {
-        writer.key_value("TitleUnicode", data->metadata.title_unicode);
+    if (!beatmap.metadata.title_unicode.empty()) {
+        writer.key_value("TitleUnicode", beatmap.metadata.title_unicode);
     }
 
-    writer.key_value("Artist", data->metadata.artist);
+    writer.key_value("Artist", beatmap.metadata.artist);
 
-    if (!data->metadata.artist_unicode.empty()) {
-        writer.key_value("ArtistUnicode", data->metadata.artist_unicode);
+    if (!beatmap.metadata.artist_unicode.empty()) {
+        writer.key_value("ArtistUnicode", beatmap.metadata.artist_unicode);
     }
 
-    writer.key_value("Creator", data->metadata.creator);
-    writer.key_value("Version", data->metadata.version);
+    writer.key_value("Creator", beatmap.metadata.creator);
+    writer.key_value("Version", beatmap.metadata.version);
 
-    if (!data->metadata.source.empty()) {
-        writer.key_value("Source", data->metadata.source);
+    if (!beatmap.metadata.source.empty()) {
+        writer.key_value("Source", beatmap.metadata.source);
     }
 
-    if (!data->metadata.tags.empty()) {
-        writer.key_value("Tags", data->metadata.tags);
+    if (!beatmap.metadata.tags.empty()) {
+        writer.key_value("Tags", beatmap.metadata.tags);
     }
 
-    writer.key_value("BeatmapID", data->metadata.beatmap_id);
-    writer.key_value("BeatmapSetID", data->metadata.beatmap_set_id);
+    writer.key_value("BeatmapID", beatmap.metadata.beatmap_id);
+    writer.key_value("BeatmapSetID", beatmap.metadata.beatmap_set_id);
 
     writer.blank();
 
     writer.section("Difficulty");
 
-    writer.key_value_double("HPDrainRate", data->difficulty.hp_drain_rate);
-    writer.key_value_double("CircleSize", data->difficulty.circle_size);
-    writer.key_value_double("OverallDifficulty", data->difficulty.overall_difficulty);
-    writer.key_value_double("ApproachRate", data->difficulty.approach_rate);
-    writer.key_value_double("SliderMultiplier", data->difficulty.slider_multiplier);
-    writer.key_value_double("SliderTickRate", data->difficulty.slider_tick_rate);
+    writer.key_value_double("HPDrainRate", beatmap.difficulty.hp_drain_rate);
+    writer.key_value_double("CircleSize", beatmap.difficulty.circle_size);
+    writer.key_value_double("OverallDifficulty", beatmap.difficulty.overall_difficulty);
+    writer.key_value_double("ApproachRate", beatmap.difficulty.approach_rate);
+    writer.key_value_double("SliderMultiplier", beatmap.difficulty.slider_multiplier);
+    writer.key_value_double("SliderTickRate", beatmap.difficulty.slider_tick_rate);
 
     writer.blank();
 
     writer.section("Events");
 
-    if (data->video.has_value()) {
-        const auto& v = data->video.value();
-        writer.line(
-            "Video," + std::to_string(v.start_time) + ",\"" + v.filename + "\"," + std::to_string(v.x_offset) + "," +
-            std::to_string(v.y_offset)
-        );
+    if (beatmap.video.has_value()) {
+        const auto& v = beatmap.video.value();
+        writer.put("Video,").put_int(v.start_time).put(",\"").put(v.filename).put("\",");
+        writer.put_int(v.x_offset).put(',').put_int(v.y_offset).end_line();
     }
 
-    if (data->background.has_value()) {
-        const auto& b = data->background.value();
-        writer.line("0,0,\"" + b.filename + "\"," + std::to_string(b.x_offset) + "," + std::to_string(b.y_offset));
+    if (beatmap.background.has_value()) {
+        const auto& b = beatmap.background.value();
+        writer.put("0,0,\"").put(b.filename).put("\",").put_int(b.x_offset).put(',').put_int(b.y_offset).end_line();
     }
 
-    for (const auto& br : data->breaks) {
-        writer.line("2," + std::to_string(br.start_time) + "," + std::to_string(br.end_time));
+    for (const auto& br : beatmap.breaks) {
+        writer.put("2,").put_int(br.start_time).put(',').put_int(br.end_time).end_line();
     }
 
     writer.blank();
 
     writer.section("TimingPoints");
 
-    for (const auto& tp : data->timing_points) {
-        writer.line(
-            std::to_string(tp.time) + "," + BeatmapWriter::format_double(tp.beat_length) + "," +
-            std::to_string(tp.meter) + "," + std::to_string(tp.sample_set) + "," + std::to_string(tp.sample_index) +
-            "," + std::to_string(tp.volume) + "," + std::to_string(tp.uninherited) + "," + std::to_string(tp.effects)
-        );
+    for (const auto& tp : beatmap.timing_points) {
+        writer.put_int(tp.time).put(',').put_double(tp.beat_length).put(',').put_int(tp.meter).put(',');
+        writer.put_int(tp.sample_set).put(',').put_int(tp.sample_index).put(',').put_int(tp.volume).put(',');
+        writer.put_int(tp.uninherited).put(',').put_int(tp.effects).end_line();
     }
 
     writer.blank();
 
     writer.section("Colours");
 
-    for (size_t i = 0; i < data->colours.combos.size(); i++) {
-        const auto& c = data->colours.combos[i];
-        writer.line(
-            "Combo" + std::to_string(i + 1) + " : " + std::to_string(c[0]) + "," + std::to_string(c[1]) + "," +
-            std::to_string(c[2])
-        );
+    for (size_t i = 0; i < beatmap.colours.combos.size(); i++) {
+        writer.put("Combo").put_int(static_cast<long long>(i + 1)).put(" : ");
+        put_colour(writer, beatmap.colours.combos[i]);
     }
 
-    if (data->colours.slider_track_override.has_value()) {
-        const auto& c = data->colours.slider_track_override.value();
-        writer.line(
-            "SliderTrackOverride : " + std::to_string(c[0]) + "," + std::to_string(c[1]) + "," + std::to_string(c[2])
-        );
+    if (beatmap.colours.slider_track_override.has_value()) {
+        writer.put("SliderTrackOverride : ");
+        put_colour(writer, beatmap.colours.slider_track_override.value());
     }
 
-    if (data->colours.slider_border.has_value()) {
-        const auto& c = data->colours.slider_border.value();
-        writer.line("SliderBorder : " + std::to_string(c[0]) + "," + std::to_string(c[1]) + "," + std::to_string(c[2]));
+    if (beatmap.colours.slider_border.has_value()) {
+        writer.put("SliderBorder : ");
+        put_colour(writer, beatmap.colours.slider_border.value());
     }
 
     writer.blank();
 
     writer.section("HitObjects");
 
-    for (const auto& ho : data->hit_objects) {
-        std::ostringstream line;
-        line << ho.x << "," << ho.y << "," << ho.time << "," << ho.type << "," << ho.hit_sound;
+    const auto& objects = beatmap.hit_objects;
+
+    for (const auto& ho : objects) {
+        writer.put_int(ho.x).put(',').put_int(ho.y).put(',').put_int(ho.time).put(',');
+        writer.put_int(ho.type).put(',').put_int(ho.hit_sound);
 
         bool is_circle = (ho.type & 1) != 0;
         bool is_slider = (ho.type & 2) != 0;
@@ -735,51 +848,49 @@ bool beatmap_parser::write() {
             }
 
             const int edge_count = std::max(1, static_cast<int>(slides_plus));
-            std::vector<int> edge_sounds = ho.edge_sounds;
+            const auto edge_sounds = objects.edge_sounds_of(ho);
+            const auto edge_sets = objects.edge_sets_of(ho);
+
+            // lists that don't match the slide count are written as defaults
+            const bool keep_sounds = static_cast<int>(edge_sounds.size()) == edge_count;
+            const bool keep_sets = static_cast<int>(edge_sets.size()) == edge_count;
 
-            if (static_cast<int>(edge_sounds.size()) != edge_count) {
-                edge_sounds.assign(edge_count, 0);
+            writer.put(',');
+            put_curve(writer, ho, objects);
+            writer.put(',').put_int(ho.slides).put(',').put_double(ho.length).put(',');
+
+            for (int i = 0; i < edge_count; i++) {
+                if (i > 0) {
+                    writer.put('|');
+                }
+                writer.put_int(keep_sounds ? edge_sounds[i] : 0);
             }
 
-            std::vector<std::pair<int, int>> edge_sets = ho.edge_sets;
+            writer.put(',');
 
-            if (static_cast<int>(edge_sets.size()) != edge_count) {
-                edge_sets.assign(edge_count, {0, 0});
+            for (int i = 0; i < edge_count; i++) {
+                const auto set = keep_sets ? edge_sets[i] : std::pair<int, int>{0, 0};
+                if (i > 0) {
+                    writer.put('|');
+                }
+                writer.put_int(set.first).put(':').put_int(set.second);
             }
 
-            line << "," << serialize_curve(ho);
-            line << "," << ho.slides;
-            line << "," << BeatmapWriter::format_double(ho.length);
-            line << "," << BeatmapWriter::join_ints(edge_sounds, '|');
-            line << "," << BeatmapWriter::join_pairs(edge_sets, '|');
-            line << "," << serialize_hit_sample(ho.sample);
+            writer.put(',');
+            put_hit_sample(writer, ho.sample, objects);
         } else if (is_spinner) {
-            line << "," << ho.end_time;
-            line << "," << serialize_hit_sample(ho.sample);
+            writer.put(',').put_int(ho.end_time).put(',');
+            put_hit_sample(writer, ho.sample, objects);
         } else if (is_hold) {
-            line << "," << ho.end_time << ":" << serialize_hit_sample(ho.sample);
+            writer.put(',').put_int(ho.end_time).put(':');
+            put_hit_sample(writer, ho.sample, objects);
         } else if (is_circle) {
-            line << "," << serialize_hit_sample(ho.sample);
+            writer.put(',');
+            put_hit_sample(writer, ho.sample, objects);
         }
 
-        writer.line(line.str());
+        writer.end_line();
     }
 
-    std::ofstream file(location, std::ios::binary | std::ios::trunc);
-
-    if (!file.is_open()) {
-        last_error = "failed to write file";
-        return false;
-    }
-
-    const std::string payload = writer.str();
-    file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
-
-    if (!file.good()) {
-        last_error = "failed to write file";
-        return false;
-    }
-
-    last_error.clear();
-    return true;
+    return writer.str();
 }
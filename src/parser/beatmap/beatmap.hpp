@@ -1,8 +1,13 @@
 #pragma once
 
+#include "writer.hpp"
+
 #include <array>
+#include <cstdint>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -18,6 +23,43 @@ enum OSU_SECTIONS {
     HitObjects
 };
 
+inline constexpr size_t SECTION_COUNT = HitObjects + 1;
+
+inline constexpr std::array<std::string_view, SECTION_COUNT> SECTION_NAMES = {
+    "General", "Editor", "Metadata", "Difficulty", "Events", "TimingPoints", "Colours", "HitObjects",
+};
+
+inline std::string_view trim_view(std::string_view s) {
+    const size_t start = s.find_first_not_of(" \t\r\n");
+
+    if (start == std::string_view::npos) {
+        return "";
+    }
+
+    const size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+// out keeps its capacity, so a reused buffer only grows it for bigger files
+bool read_file_text(const std::string& location, std::string& out);
+
+// index into SECTION_NAMES for a trimmed "[Name]" line, SECTION_COUNT for anything else
+inline size_t find_section(std::string_view line) {
+    if (line.size() < 2 || line.front() != '[' || line.back() != ']') {
+        return SECTION_COUNT;
+    }
+
+    const auto name = line.substr(1, line.size() - 2);
+
+    for (size_t i = 0; i < SECTION_COUNT; i++) {
+        if (SECTION_NAMES[i] == name) {
+            return i;
+        }
+    }
+
+    return SECTION_COUNT;
+}
+
 struct GeneralSection {
     std::string audio_filename;
     int audio_lead_in = 0;
@@ -110,9 +152,11 @@ struct HitSample {
     int addition_set = 0;
     int index = 0;
     int volume = 0;
-    std::string filename;
+    uint32_t filename_offset = 0; // into HitObjectList::sample_files
+    uint32_t filename_size = 0;
 };
 
+// fixed size, the variable length parts are ranges of the shared arrays in HitObjectList
 struct HitObject {
     int x = 0; // 0-512 (playfield coords)
     int y = 0; // 0-384
@@ -122,13 +166,71 @@ struct HitObject {
     HitSample sample;
 
     char curve_type = 'L'; // B=bezier, C=catmull, L=linear, P=perfect circle
-    std::vector<std::pair<int, int>> curve_points;
+    uint32_t curve_offset = 0;
+    uint32_t curve_count = 0;
     int slides = 1;
     double length = 0.0;
+    uint32_t edge_sounds_offset = 0;
+    uint32_t edge_sounds_count = 0;
+    uint32_t edge_sets_offset = 0;
+    uint32_t edge_sets_count = 0;
+
+    int end_time = 0;
+};
+
+// a map's hit objects plus the curve points, edge data and sample file names they
+// point into. parsing a map only grows these few arrays, and reusing the list for the
+// next map keeps their capacity
+struct HitObjectList {
+    std::vector<HitObject> objects;
+    std::vector<std::pair<int, int>> curve_points;
     std::vector<int> edge_sounds;
     std::vector<std::pair<int, int>> edge_sets;
+    std::string sample_files;
 
-    int end_time = 0;
+    size_t size() const {
+        return objects.size();
+    }
+
+    bool empty() const {
+        return objects.empty();
+    }
+
+    const HitObject& operator[](size_t index) const {
+        return objects[index];
+    }
+
+    std::vector<HitObject>::const_iterator begin() const {
+        return objects.begin();
+    }
+
+    std::vector<HitObject>::const_iterator end() const {
+        return objects.end();
+    }
+
+    std::span<const std::pair<int, int>> curve(const HitObject& object) const {
+        return {curve_points.data() + object.curve_offset, object.curve_count};
+    }
+
+    std::span<const int> edge_sounds_of(const HitObject& object) const {
+        return {edge_sounds.data() + object.edge_sounds_offset, object.edge_sounds_count};
+    }
+
+    std::span<const std::pair<int, int>> edge_sets_of(const HitObject& object) const {
+        return {edge_sets.data() + object.edge_sets_offset, object.edge_sets_count};
+    }
+
+    std::string_view sample_file(const HitSample& sample) const {
+        return std::string_view(sample_files).substr(sample.filename_offset, sample.filename_size);
+    }
+
+    void clear() {
+        objects.clear();
+        curve_points.clear();
+        edge_sounds.clear();
+        edge_sets.clear();
+        sample_files.clear();
+    }
 };
 
 struct ParsedBeatmap {
@@ -142,7 +244,7 @@ struct ParsedBeatmap {
     std::vector<EventBreak> breaks;
     std::vector<TimingPoint> timing_points;
     ColourSection colours;
-    std::vector<HitObject> hit_objects;
+    HitObjectList hit_objects;
 };
 
 inline const std::unordered_map<std::string, std::string>& key_to_section() {
@@ -200,11 +302,35 @@ inline const std::unordered_set<std::string>& get_special_keys() {
     return set;
 }
 
-namespace beatmap_parser {
-    bool parse(std::string location);
-    bool write();
+// .osu reader / writer. an instance keeps its file buffer and line scratch between
+// calls, so one parser per thread can go through a whole Songs folder without
+// reallocating. separate instances don't share anything and can run concurrently
+class BeatmapParser {
+public:
+    bool parse(const std::string& location, ParsedBeatmap& beatmap);
+    // same as parse, for .osu contents that are already in memory (archives, downloads)
+    bool parse_content(std::string_view content, ParsedBeatmap& beatmap);
+    // [General], [Editor], [Metadata], [Difficulty] and [Events] only. reads the file in
+    // small chunks and stops at the first section after those, timing points, colours
+    // and hit objects are left empty
+    bool parse_header(const std::string& location, ParsedBeatmap& beatmap);
+    bool parse_header_content(std::string_view content, ParsedBeatmap& beatmap);
+    bool write(const ParsedBeatmap& beatmap, const std::string& location);
+    // the text write() would produce, valid until the next serialize / write
+    const std::string& serialize(const ParsedBeatmap& beatmap);
+
+    const std::string& last_error() const {
+        return m_last_error;
+    }
 
-    inline ParsedBeatmap* data;
-    inline std::string location;
-    inline std::string last_error;
-}; // namespace beatmap_parser
+private:
+    void parse_sections(std::string_view content, ParsedBeatmap& beatmap, bool header_only);
+
+    std::string m_content;
+    std::array<std::vector<std::string_view>, SECTION_COUNT> m_sections; // lines of each OSU_SECTIONS entry
+    std::vector<std::string_view> m_parts;
+    std::vector<std::string_view> m_fields;
+    std::vector<std::string_view> m_values;
+    BeatmapWriter m_writer{0}; // grows on the first write, reused after that
+    std::string m_last_error;
+};
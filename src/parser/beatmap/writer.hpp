@@ -1,86 +1,124 @@
 #pragma once
 
-#include <iomanip>
-#include <sstream>
+#include <charconv>
+#include <span>
 #include <string>
+#include <string_view>
 #include <utility>
-#include <vector>
 
+// builds a whole .osu in one flat buffer. numbers go through std::to_chars, clear()
+// keeps the capacity so a writer reused across files stops allocating
 struct BeatmapWriter {
 public:
-    void section(const std::string& name) {
-        out << "[" << name << "]\n";
+    explicit BeatmapWriter(size_t reserve = 64 * 1024) {
+        out.reserve(reserve);
+    }
+
+    void clear() {
+        out.clear();
+    }
+
+    void reserve(size_t size) {
+        out.reserve(size);
+    }
+
+    void section(std::string_view name) {
+        put('[').put(name).put("]\n");
     }
 
     void blank() {
-        out << "\n";
+        put('\n');
     }
 
-    void line(const std::string& value) {
-        out << value << "\n";
+    void line(std::string_view value) {
+        put(value).put('\n');
     }
 
-    void key_value(const std::string& key, const std::string& value) {
-        out << key << ":" << value << "\n";
+    void key_value(std::string_view key, std::string_view value) {
+        put(key).put(':').put(value).put('\n');
     }
 
-    void key_value(const std::string& key, const char* value) {
-        out << key << ":" << value << "\n";
+    void key_value(std::string_view key, int value) {
+        put(key).put(':').put_int(value).put('\n');
     }
 
-    void key_value(const std::string& key, int value) {
-        out << key << ":" << value << "\n";
+    void key_value_double(std::string_view key, double value) {
+        put(key).put(':').put_double(value).put('\n');
     }
 
-    void key_value_double(const std::string& key, double value) {
-        out << key << ":" << format_double(value) << "\n";
+    // pieces of a line, finish it with end_line()
+    BeatmapWriter& put(std::string_view value) {
+        out.append(value);
+        return *this;
     }
 
-    std::string str() const {
-        return out.str();
+    BeatmapWriter& put(char value) {
+        out.push_back(value);
+        return *this;
     }
 
-    static std::string format_double(double value) {
-        std::ostringstream ss;
-        ss << std::fixed << std::setprecision(15) << value;
-        std::string out = ss.str();
-        auto pos = out.find('.');
-        if (pos != std::string::npos) {
-            while (!out.empty() && out.back() == '0') {
-                out.pop_back();
-            }
-            if (!out.empty() && out.back() == '.') {
-                out.pop_back();
-            }
-        }
-        if (out.empty()) {
-            out = "0";
-        }
-        return out;
+    BeatmapWriter& put_int(long long value) {
+        char buffer[24];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+        return *this;
     }
 
-    static std::string join_ints(const std::vector<int>& values, char delim) {
-        std::ostringstream ss;
+    BeatmapWriter& put_double(double value) {
+        char buffer[DOUBLE_BUFFER_SIZE];
+        out.append(buffer, format_double(value, buffer));
+        return *this;
+    }
+
+    BeatmapWriter& put_ints(std::span<const int> values, char delim) {
         for (size_t i = 0; i < values.size(); i++) {
             if (i > 0) {
-                ss << delim;
+                put(delim);
             }
-            ss << values[i];
+            put_int(values[i]);
         }
-        return ss.str();
+        return *this;
     }
 
-    static std::string join_pairs(const std::vector<std::pair<int, int>>& values, char delim) {
-        std::ostringstream ss;
-        for (size_t i = 0; i < values.size(); i++) {
-            if (i > 0) {
-                ss << delim;
+    void end_line() {
+        put('\n');
+    }
+
+    const std::string& str() const {
+        return out;
+    }
+
+    static std::string format_double(double value) {
+        char buffer[DOUBLE_BUFFER_SIZE];
+        return std::string(buffer, format_double(value, buffer));
+    }
+
+private:
+    // fixed notation of the largest double plus sign, point and 15 decimals
+    static constexpr size_t DOUBLE_BUFFER_SIZE = 352;
+
+    // fixed with 15 decimals, trailing zeros trimmed. not the shortest round trip form,
+    // files written by older versions have to come out byte for byte the same
+    static size_t format_double(double value, char* buffer) {
+        const auto result = std::to_chars(buffer, buffer + DOUBLE_BUFFER_SIZE, value, std::chars_format::fixed, 15);
+        char* end = result.ptr;
+
+        if (std::string_view(buffer, end - buffer).find('.') != std::string_view::npos) {
+            while (end > buffer && end[-1] == '0') {
+                end--;
+            }
+            if (end > buffer && end[-1] == '.') {
+                end--;
             }
-            ss << values[i].first << ":" << values[i].second;
         }
-        return ss.str();
+
+        if (end == buffer) {
+            *buffer = '0';
+            end++;
+        }
+
+        return static_cast<size_t>(end - buffer);
     }
 
-private:
-    std::ostringstream out;
+    std::string out;
 };
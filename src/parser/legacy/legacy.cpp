@@ -2,52 +2,107 @@
 #include "../../utils/binary.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
 #include <stdexcept>
+#include <system_error>
 
-static LegacyFloatPair read_int_float_pair(binary::BinaryCursor& cursor, bool use_float) {
-    LegacyFloatPair pair;
+// bpm, offset, inherited
+static constexpr size_t TIMING_POINT_SIZE = 2 * sizeof(double) + 1;
 
-    uint8_t marker = binary::read_u8(cursor);
+// marker + mod combination + marker + star rating
+static size_t int_float_pair_size(bool use_float) {
+    return 1 + sizeof(int32_t) + 1 + (use_float ? sizeof(float) : sizeof(double));
+}
+
+static bool uses_float_star(int version) {
+    return version >= 20250107;
+}
+
+static uint64_t next_raw_id() {
+    static std::atomic<uint64_t> next = 1;
+    return next++;
+}
+
+// the pairs stay in the file buffer, only the markers are checked and the nomod rating
+// pulled out. the rest is decoded when someone asks for it
+static LegacyRange read_star_ratings(binary::BinaryCursor& cursor, bool use_float, double& nomod) {
+    LegacyRange range;
+    int count = binary::read_i32(cursor);
 
-    if (marker != 0x08) {
-        throw std::runtime_error("invalid int-float pair marker");
+    if (count < 0) {
+        throw std::runtime_error("invalid star rating count");
     }
 
-    pair.mod_combination = static_cast<int>(binary::read_i32(cursor));
+    range.offset = cursor.offset;
+    range.count = static_cast<uint32_t>(count);
 
-    uint8_t float_marker = binary::read_u8(cursor);
+    if (count == 0) {
+        return range;
+    }
 
-    if (use_float) {
-        if (float_marker != 0x0C) {
-            throw std::runtime_error("invalid float marker");
+    // the whole list is checked once, a count past the end of the file fails here
+    auto reader = cursor.reserve(static_cast<size_t>(count) * int_float_pair_size(use_float));
+    const uint8_t float_marker = use_float ? 0x0C : 0x0D;
+    bool found_nomod = false;
+
+    for (int i = 0; i < count; i++) {
+        if (reader.read_u8() != 0x08) {
+            throw std::runtime_error("invalid int-float pair marker");
         }
-        pair.star_rating = static_cast<double>(binary::read_f32(cursor));
-    } else {
-        if (float_marker != 0x0D) {
-            throw std::runtime_error("invalid double marker");
+
+        const int mod_combination = reader.read_i32();
+
+        if (reader.read_u8() != float_marker) {
+            throw std::runtime_error(use_float ? "invalid float marker" : "invalid double marker");
+        }
+
+        if (mod_combination != 0 || found_nomod) {
+            reader.skip(use_float ? sizeof(float) : sizeof(double));
+            continue;
         }
-        pair.star_rating = binary::read_f64(cursor);
+
+        nomod = use_float ? static_cast<double>(reader.read_f32()) : reader.read_f64();
+        found_nomod = true;
     }
 
-    return pair;
+    return range;
 }
 
-static std::vector<LegacyFloatPair> read_star_ratings(binary::BinaryCursor& cursor, bool use_float) {
-    std::vector<LegacyFloatPair> ratings;
-    int count = binary::read_i32(cursor);
-
-    if (count < 0) {
-        throw std::runtime_error("invalid star rating count");
+// nullptr when the range points into another database's raw or doesn't fit in this one
+static const uint8_t* range_data(const OsuLegacyDatabase& data, const LegacyRange& range, size_t element_size) {
+    if (range.count == 0 || range.source == 0 || range.source != data.raw_id || range.offset > data.raw.size() ||
+        static_cast<size_t>(range.count) * element_size > data.raw.size() - range.offset) {
+        return nullptr;
     }
 
-    if (count == 0) {
+    return data.raw.data() + range.offset;
+}
+
+static size_t range_count(const OsuLegacyDatabase& data, const LegacyRange& range, size_t element_size) {
+    return range_data(data, range, element_size) != nullptr ? range.count : 0;
+}
+
+static std::vector<LegacyFloatPair> decode_star_ratings(const OsuLegacyDatabase& data, const LegacyRange& range) {
+    const bool use_float = uses_float_star(data.raw_version);
+    std::vector<LegacyFloatPair> ratings(range_count(data, range, int_float_pair_size(use_float)));
+
+    if (ratings.empty()) {
         return ratings;
     }
 
-    ratings.reserve(static_cast<size_t>(count));
+    binary::BinaryCursor cursor;
+    binary::set_cursor(cursor, data.raw);
+    cursor.offset = range.offset;
 
-    for (int i = 0; i < count; i++) {
-        ratings.push_back(read_int_float_pair(cursor, use_float));
+    auto reader = cursor.reserve(ratings.size() * int_float_pair_size(use_float));
+
+    for (auto& pair : ratings) {
+        reader.read_u8();
+        pair.mod_combination = reader.read_i32();
+        reader.read_u8();
+        pair.star_rating = use_float ? static_cast<double>(reader.read_f32()) : reader.read_f64();
     }
 
     return ratings;
@@ -66,23 +121,40 @@ static void write_int_float_pair(std::vector<uint8_t>& buffer, const LegacyFloat
     }
 }
 
-static void
-write_star_ratings(std::vector<uint8_t>& buffer, const std::vector<LegacyFloatPair>& ratings, bool use_float) {
-    binary::write_i32(buffer, static_cast<int>(ratings.size()));
+static void write_star_ratings(
+    std::vector<uint8_t>& buffer, const OsuLegacyDatabase& data, const LegacyRange& range, bool use_float
+) {
+    const bool raw_float = uses_float_star(data.raw_version);
+    const size_t pair_size = int_float_pair_size(raw_float);
+    const uint8_t* bytes = range_data(data, range, pair_size);
+
+    if (bytes == nullptr) {
+        binary::write_i32(buffer, 0);
+        return;
+    }
+
+    binary::write_i32(buffer, static_cast<int>(range.count));
 
-    for (const auto& rating : ratings) {
-        write_int_float_pair(buffer, rating, use_float);
+    // same encoding as the target, the pairs are copied as they are
+    if (raw_float == use_float) {
+        buffer.insert(buffer.end(), bytes, bytes + range.count * pair_size);
+        return;
+    }
+
+    for (const auto& pair : decode_star_ratings(data, range)) {
+        write_int_float_pair(buffer, pair, use_float);
     }
 }
 
-static LegacyBeatmap read_beatmap(binary::BinaryCursor& cursor, int version) {
+static LegacyBeatmap read_beatmap(binary::BinaryCursor& cursor, int version, uint64_t source) {
     LegacyBeatmap beatmap;
 
     const bool has_entry_size = version < 20191106;
     const bool old_diff_format = version < 20140609;
-    const bool use_float_star = version >= 20250107;
+    const bool use_float_star = uses_float_star(version);
 
     size_t entry_start = 0;
+    beatmap.entry_offset = cursor.offset;
 
     if (has_entry_size) {
         beatmap.entry_size = binary::read_i32(cursor);
@@ -98,84 +170,110 @@ static LegacyBeatmap read_beatmap(binary::BinaryCursor& cursor, int version) {
     beatmap.audio_file_name = binary::read_string(cursor);
     beatmap.md5 = binary::read_string(cursor);
     beatmap.osu_file_name = binary::read_string(cursor);
-    beatmap.status = binary::read_u8(cursor);
-    beatmap.hitcircle = binary::read_u16(cursor);
-    beatmap.sliders = binary::read_u16(cursor);
-    beatmap.spinners = binary::read_u16(cursor);
-    beatmap.last_modification_time = binary::read_i64(cursor);
 
-    if (old_diff_format) {
-        beatmap.approach_rate = binary::read_u8(cursor);
-        beatmap.circle_size = binary::read_u8(cursor);
-        beatmap.hp_drain = binary::read_u8(cursor);
-        beatmap.overall_difficulty = binary::read_u8(cursor);
-    } else {
-        beatmap.approach_rate = binary::read_f32(cursor);
-        beatmap.circle_size = binary::read_f32(cursor);
-        beatmap.hp_drain = binary::read_f32(cursor);
-        beatmap.overall_difficulty = binary::read_f32(cursor);
+    // fixed size fields between the strings are checked one block at a time
+    {
+        const size_t difficulty_size = old_diff_format ? 4 : 4 * sizeof(float);
+        auto reader = cursor.reserve(1 + 3 * sizeof(uint16_t) + sizeof(int64_t) + difficulty_size + sizeof(double));
+
+        beatmap.status = reader.read_u8();
+        beatmap.hitcircle = reader.read_u16();
+        beatmap.sliders = reader.read_u16();
+        beatmap.spinners = reader.read_u16();
+        beatmap.last_modification_time = reader.read_i64();
+
+        if (old_diff_format) {
+            beatmap.approach_rate = reader.read_u8();
+            beatmap.circle_size = reader.read_u8();
+            beatmap.hp_drain = reader.read_u8();
+            beatmap.overall_difficulty = reader.read_u8();
+        } else {
+            beatmap.approach_rate = reader.read_f32();
+            beatmap.circle_size = reader.read_f32();
+            beatmap.hp_drain = reader.read_f32();
+            beatmap.overall_difficulty = reader.read_f32();
+        }
+
+        beatmap.slider_velocity = reader.read_f64();
     }
 
-    beatmap.slider_velocity = binary::read_f64(cursor);
+    std::array<double, 4> nomod{};
 
     if (!old_diff_format) {
-        beatmap.star_rating_standard = read_star_ratings(cursor, use_float_star);
-        beatmap.star_rating_taiko = read_star_ratings(cursor, use_float_star);
-        beatmap.star_rating_ctb = read_star_ratings(cursor, use_float_star);
-        beatmap.star_rating_mania = read_star_ratings(cursor, use_float_star);
+        for (size_t mode = 0; mode < beatmap.star_ratings_range.size(); mode++) {
+            beatmap.star_ratings_range[mode] = read_star_ratings(cursor, use_float_star, nomod[mode]);
+            beatmap.star_ratings_range[mode].source = source;
+        }
     }
 
-    beatmap.drain_time = binary::read_i32(cursor);
-    beatmap.total_time = binary::read_i32(cursor);
-    beatmap.audio_preview_time = binary::read_i32(cursor);
+    int timing_count = 0;
 
-    int timing_count = binary::read_i32(cursor);
+    {
+        auto reader = cursor.reserve(4 * sizeof(int32_t));
+        beatmap.drain_time = reader.read_i32();
+        beatmap.total_time = reader.read_i32();
+        beatmap.audio_preview_time = reader.read_i32();
+        timing_count = reader.read_i32();
+    }
 
     if (timing_count < 0) {
         throw std::runtime_error("invalid timing point count");
     }
 
-    beatmap.timing_points.reserve(static_cast<size_t>(std::max(0, timing_count)));
+    beatmap.timing_points_range.offset = cursor.offset;
+    beatmap.timing_points_range.count = static_cast<uint32_t>(timing_count);
+    beatmap.timing_points_range.source = source;
+    binary::skip(cursor, static_cast<size_t>(timing_count) * TIMING_POINT_SIZE);
+
+    {
+        auto reader = cursor.reserve(3 * sizeof(int32_t) + 4 + sizeof(int16_t) + sizeof(float) + 1);
+        beatmap.difficulty_id = reader.read_i32();
+        beatmap.beatmap_id = reader.read_i32();
+        beatmap.thread_id = reader.read_i32();
+        beatmap.grade_standard = reader.read_u8();
+        beatmap.grade_taiko = reader.read_u8();
+        beatmap.grade_ctb = reader.read_u8();
+        beatmap.grade_mania = reader.read_u8();
+        beatmap.local_offset = reader.read_i16();
+        beatmap.stack_leniency = reader.read_f32();
+        beatmap.mode = reader.read_u8();
+    }
 
-    for (int i = 0; i < timing_count; i++) {
-        LegacyTimingPoint tp;
-        tp.bpm = binary::read_f64(cursor);
-        tp.offset = binary::read_f64(cursor);
-        tp.inherited = binary::read_bool(cursor) ? 1 : 0;
-        beatmap.timing_points.push_back(tp);
+    if (beatmap.mode >= 0 && static_cast<size_t>(beatmap.mode) < nomod.size()) {
+        beatmap.star_rating = nomod[static_cast<size_t>(beatmap.mode)];
     }
 
-    beatmap.difficulty_id = binary::read_i32(cursor);
-    beatmap.beatmap_id = binary::read_i32(cursor);
-    beatmap.thread_id = binary::read_i32(cursor);
-    beatmap.grade_standard = binary::read_u8(cursor);
-    beatmap.grade_taiko = binary::read_u8(cursor);
-    beatmap.grade_ctb = binary::read_u8(cursor);
-    beatmap.grade_mania = binary::read_u8(cursor);
-    beatmap.local_offset = binary::read_i16(cursor);
-    beatmap.stack_leniency = binary::read_f32(cursor);
-    beatmap.mode = binary::read_u8(cursor);
     beatmap.source = binary::read_string(cursor);
     beatmap.tags = binary::read_string(cursor);
     beatmap.online_offset = binary::read_i16(cursor);
     beatmap.title_font = binary::read_string(cursor);
-    beatmap.unplayed = binary::read_bool(cursor) ? 1 : 0;
-    beatmap.last_played = binary::read_i64(cursor);
-    beatmap.is_osz2 = binary::read_bool(cursor) ? 1 : 0;
-    beatmap.folder_name = binary::read_string(cursor);
-    beatmap.last_checked = binary::read_i64(cursor);
-    beatmap.ignore_sounds = binary::read_bool(cursor) ? 1 : 0;
-    beatmap.ignore_skin = binary::read_bool(cursor) ? 1 : 0;
-    beatmap.disable_storyboard = binary::read_bool(cursor) ? 1 : 0;
-    beatmap.disable_video = binary::read_bool(cursor) ? 1 : 0;
-    beatmap.visual_override = binary::read_bool(cursor) ? 1 : 0;
 
-    if (old_diff_format) {
-        beatmap.unknown = binary::read_i16(cursor);
+    {
+        auto reader = cursor.reserve(1 + sizeof(int64_t) + 1);
+        beatmap.unplayed = reader.read_bool() ? 1 : 0;
+        beatmap.last_played = reader.read_i64();
+        beatmap.is_osz2 = reader.read_bool() ? 1 : 0;
     }
 
-    beatmap.last_modified = binary::read_i32(cursor);
-    beatmap.mania_scroll_speed = binary::read_u8(cursor);
+    beatmap.folder_name = binary::read_string(cursor);
+
+    {
+        const size_t unknown_size = old_diff_format ? sizeof(int16_t) : 0;
+        auto reader = cursor.reserve(sizeof(int64_t) + 5 + unknown_size + sizeof(int32_t) + 1);
+        beatmap.last_checked = reader.read_i64();
+        beatmap.ignore_sounds = reader.read_bool() ? 1 : 0;
+        beatmap.ignore_skin = reader.read_bool() ? 1 : 0;
+        beatmap.disable_storyboard = reader.read_bool() ? 1 : 0;
+        beatmap.disable_video = reader.read_bool() ? 1 : 0;
+        beatmap.visual_override = reader.read_bool() ? 1 : 0;
+
+        if (old_diff_format) {
+            beatmap.unknown = reader.read_i16();
+        }
+
+        beatmap.last_modified = reader.read_i32();
+        beatmap.mania_scroll_speed = reader.read_u8();
+    }
 
     if (has_entry_size && beatmap.entry_size.has_value()) {
         const size_t bytes_read = cursor.offset - entry_start;
@@ -190,6 +288,7 @@ static LegacyBeatmap read_beatmap(binary::BinaryCursor& cursor, int version) {
         }
     }
 
+    beatmap.entry_length = cursor.offset - beatmap.entry_offset;
     return beatmap;
 }
 
@@ -217,12 +316,20 @@ bool legacy_parser::parse(const std::filesystem::path& location, OsuLegacyDataba
 
         data->beatmaps.clear();
         data->beatmaps.reserve(static_cast<size_t>(std::max(0, data->beatmaps_count)));
+        const uint64_t raw_id = next_raw_id();
 
         for (int i = 0; i < data->beatmaps_count; i++) {
-            data->beatmaps.push_back(read_beatmap(cursor, data->version));
+            data->beatmaps.push_back(read_beatmap(cursor, data->version, raw_id));
         }
 
         data->permissions = binary::read_i32(cursor);
+        data->file_size = buffer.size();
+        data->raw = std::move(buffer);
+        data->raw_version = data->version;
+        data->raw_id = raw_id;
+
+        std::error_code error;
+        data->write_time = std::filesystem::last_write_time(location, error);
 
         return true;
     } catch (const std::exception& e) {
@@ -231,124 +338,386 @@ bool legacy_parser::parse(const std::filesystem::path& location, OsuLegacyDataba
     }
 }
 
+// bytes write_beatmap produces for an entry, without the entry_size prefix
+static size_t beatmap_size(const LegacyBeatmap& beatmap, const OsuLegacyDatabase& data, int version) {
+    const bool old_diff_format = version < 20140609;
+    const bool use_float_star = uses_float_star(version);
+    const size_t raw_pair_size = int_float_pair_size(uses_float_star(data.raw_version));
+
+    size_t size = 0;
+
+    for (const auto* value : {&beatmap.artist, &beatmap.artist_unicode, &beatmap.title, &beatmap.title_unicode,
+                              &beatmap.creator, &beatmap.difficulty, &beatmap.audio_file_name, &beatmap.md5,
+                              &beatmap.osu_file_name, &beatmap.source, &beatmap.tags, &beatmap.title_font,
+                              &beatmap.folder_name}) {
+        size += binary::string_size(*value);
+    }
+
+    // status, object counts, last modification time
+    size += 1 + 3 * sizeof(uint16_t) + sizeof(int64_t);
+    // ar / cs / hp / od, slider velocity
+    size += (old_diff_format ? 4 : 4 * sizeof(float)) + sizeof(double);
+
+    if (!old_diff_format) {
+        for (const auto& range : beatmap.star_ratings_range) {
+            size += sizeof(int32_t) + range_count(data, range, raw_pair_size) * int_float_pair_size(use_float_star);
+        }
+    }
+
+    // drain / total / preview time, timing points
+    size += 3 * sizeof(int32_t);
+    size += sizeof(int32_t) + range_count(data, beatmap.timing_points_range, TIMING_POINT_SIZE) * TIMING_POINT_SIZE;
+
+    // ids, grades, local offset, stack leniency, mode, online offset
+    size += 3 * sizeof(int32_t) + 4 + sizeof(int16_t) + sizeof(float) + 1 + sizeof(int16_t);
+    // unplayed, last played, osz2, last checked, 5 override flags
+    size += 1 + sizeof(int64_t) + 1 + sizeof(int64_t) + 5;
+
+    if (old_diff_format) {
+        size += sizeof(int16_t);
+    }
+
+    // last modified, mania scroll speed
+    size += sizeof(int32_t) + 1;
+    return size;
+}
+
+static void write_beatmap(std::vector<uint8_t>& buffer, const LegacyBeatmap& beatmap, const OsuLegacyDatabase& data,
+                          int version) {
+    const bool has_entry_size = version < 20191106;
+    const bool old_diff_format = version < 20140609;
+    const bool use_float_star = uses_float_star(version);
+
+    size_t entry_start = 0;
+
+    // filled in once the entry is written
+    if (has_entry_size) {
+        binary::write_i32(buffer, 0);
+        entry_start = buffer.size();
+    }
+
+    binary::write_string(buffer, beatmap.artist);
+    binary::write_string(buffer, beatmap.artist_unicode);
+    binary::write_string(buffer, beatmap.title);
+    binary::write_string(buffer, beatmap.title_unicode);
+    binary::write_string(buffer, beatmap.creator);
+    binary::write_string(buffer, beatmap.difficulty);
+    binary::write_string(buffer, beatmap.audio_file_name);
+    binary::write_string(buffer, beatmap.md5);
+    binary::write_string(buffer, beatmap.osu_file_name);
+    binary::write_u8(buffer, static_cast<uint8_t>(beatmap.status));
+    binary::write_u16(buffer, static_cast<uint16_t>(beatmap.hitcircle));
+    binary::write_u16(buffer, static_cast<uint16_t>(beatmap.sliders));
+    binary::write_u16(buffer, static_cast<uint16_t>(beatmap.spinners));
+    binary::write_i64(buffer, beatmap.last_modification_time);
+
+    if (old_diff_format) {
+        binary::write_u8(buffer, static_cast<uint8_t>(beatmap.approach_rate));
+        binary::write_u8(buffer, static_cast<uint8_t>(beatmap.circle_size));
+        binary::write_u8(buffer, static_cast<uint8_t>(beatmap.hp_drain));
+        binary::write_u8(buffer, static_cast<uint8_t>(beatmap.overall_difficulty));
+    } else {
+        binary::write_f32(buffer, static_cast<float>(beatmap.approach_rate));
+        binary::write_f32(buffer, static_cast<float>(beatmap.circle_size));
+        binary::write_f32(buffer, static_cast<float>(beatmap.hp_drain));
+        binary::write_f32(buffer, static_cast<float>(beatmap.overall_difficulty));
+    }
+
+    binary::write_f64(buffer, beatmap.slider_velocity);
+
+    if (!old_diff_format) {
+        for (const auto& range : beatmap.star_ratings_range) {
+            write_star_ratings(buffer, data, range, use_float_star);
+        }
+    }
+
+    binary::write_i32(buffer, beatmap.drain_time);
+    binary::write_i32(buffer, beatmap.total_time);
+    binary::write_i32(buffer, beatmap.audio_preview_time);
+
+    // timing points are the same in every version
+    const auto& timing_range = beatmap.timing_points_range;
+    const uint8_t* timing_data = range_data(data, timing_range, TIMING_POINT_SIZE);
+    binary::write_i32(buffer, timing_data != nullptr ? static_cast<int>(timing_range.count) : 0);
+
+    if (timing_data != nullptr) {
+        buffer.insert(buffer.end(), timing_data, timing_data + timing_range.count * TIMING_POINT_SIZE);
+    }
+
+    binary::write_i32(buffer, beatmap.difficulty_id);
+    binary::write_i32(buffer, beatmap.beatmap_id);
+    binary::write_i32(buffer, beatmap.thread_id);
+    binary::write_u8(buffer, static_cast<uint8_t>(beatmap.grade_standard));
+    binary::write_u8(buffer, static_cast<uint8_t>(beatmap.grade_taiko));
+    binary::write_u8(buffer, static_cast<uint8_t>(beatmap.grade_ctb));
+    binary::write_u8(buffer, static_cast<uint8_t>(beatmap.grade_mania));
+    binary::write_i16(buffer, static_cast<int16_t>(beatmap.local_offset));
+    binary::write_f32(buffer, static_cast<float>(beatmap.stack_leniency));
+    binary::write_u8(buffer, static_cast<uint8_t>(beatmap.mode));
+    binary::write_string(buffer, beatmap.source);
+    binary::write_string(buffer, beatmap.tags);
+    binary::write_i16(buffer, static_cast<int16_t>(beatmap.online_offset));
+    binary::write_string(buffer, beatmap.title_font);
+    binary::write_bool(buffer, beatmap.unplayed != 0);
+    binary::write_i64(buffer, beatmap.last_played);
+    binary::write_bool(buffer, beatmap.is_osz2 != 0);
+    binary::write_string(buffer, beatmap.folder_name);
+    binary::write_i64(buffer, beatmap.last_checked);
+    binary::write_bool(buffer, beatmap.ignore_sounds != 0);
+    binary::write_bool(buffer, beatmap.ignore_skin != 0);
+    binary::write_bool(buffer, beatmap.disable_storyboard != 0);
+    binary::write_bool(buffer, beatmap.disable_video != 0);
+    binary::write_bool(buffer, beatmap.visual_override != 0);
+
+    if (old_diff_format) {
+        binary::write_i16(buffer, static_cast<int16_t>(beatmap.unknown.value_or(0)));
+    }
+
+    binary::write_i32(buffer, beatmap.last_modified);
+    binary::write_u8(buffer, static_cast<uint8_t>(beatmap.mania_scroll_speed));
+
+    if (has_entry_size) {
+        binary::patch_i32(buffer, entry_start - sizeof(int32_t), static_cast<int>(buffer.size() - entry_start));
+    }
+}
+
+static void write_header(std::vector<uint8_t>& buffer, const OsuLegacyDatabase& data) {
+    binary::write_i32(buffer, data.version);
+    binary::write_i32(buffer, data.folder_count);
+    binary::write_bool(buffer, data.account_unlocked != 0);
+    binary::write_i64(buffer, data.account_unlock_time);
+    binary::write_string(buffer, data.player_name);
+    binary::write_i32(buffer, data.beatmaps_count);
+}
+
 bool legacy_parser::write(const std::filesystem::path& location, OsuLegacyDatabase* data) {
     if (data == nullptr || location.empty()) {
         return false;
     }
 
-    std::vector<uint8_t> buffer;
-    buffer.reserve(1024);
-
     const int version = data->version;
     const bool has_entry_size = version < 20191106;
-    const bool old_diff_format = version < 20140609;
-    const bool use_float_star = version >= 20250107;
 
     data->beatmaps_count = static_cast<int>(data->beatmaps.size());
 
-    binary::write_i32(buffer, version);
-    binary::write_i32(buffer, data->folder_count);
-    binary::write_bool(buffer, data->account_unlocked != 0);
-    binary::write_i64(buffer, data->account_unlock_time);
-    binary::write_string(buffer, data->player_name);
-    binary::write_i32(buffer, data->beatmaps_count);
+    // the whole database is sized up front, one allocation however many beatmaps there are
+    size_t size = sizeof(int32_t) * 2 + 1 + sizeof(int64_t) + binary::string_size(data->player_name) +
+                  sizeof(int32_t) * 2;
 
     for (const auto& beatmap : data->beatmaps) {
-        std::vector<uint8_t> entry;
-        entry.reserve(512);
-
-        binary::write_string(entry, beatmap.artist);
-        binary::write_string(entry, beatmap.artist_unicode);
-        binary::write_string(entry, beatmap.title);
-        binary::write_string(entry, beatmap.title_unicode);
-        binary::write_string(entry, beatmap.creator);
-        binary::write_string(entry, beatmap.difficulty);
-        binary::write_string(entry, beatmap.audio_file_name);
-        binary::write_string(entry, beatmap.md5);
-        binary::write_string(entry, beatmap.osu_file_name);
-        binary::write_u8(entry, static_cast<uint8_t>(beatmap.status));
-        binary::write_u16(entry, static_cast<uint16_t>(beatmap.hitcircle));
-        binary::write_u16(entry, static_cast<uint16_t>(beatmap.sliders));
-        binary::write_u16(entry, static_cast<uint16_t>(beatmap.spinners));
-        binary::write_i64(entry, beatmap.last_modification_time);
+        size += beatmap_size(beatmap, *data, version) + (has_entry_size ? sizeof(int32_t) : 0);
+    }
 
-        if (old_diff_format) {
-            binary::write_u8(entry, static_cast<uint8_t>(beatmap.approach_rate));
-            binary::write_u8(entry, static_cast<uint8_t>(beatmap.circle_size));
-            binary::write_u8(entry, static_cast<uint8_t>(beatmap.hp_drain));
-            binary::write_u8(entry, static_cast<uint8_t>(beatmap.overall_difficulty));
-        } else {
-            binary::write_f32(entry, static_cast<float>(beatmap.approach_rate));
-            binary::write_f32(entry, static_cast<float>(beatmap.circle_size));
-            binary::write_f32(entry, static_cast<float>(beatmap.hp_drain));
-            binary::write_f32(entry, static_cast<float>(beatmap.overall_difficulty));
-        }
+    std::vector<uint8_t> buffer;
+    buffer.reserve(size);
 
-        binary::write_f64(entry, beatmap.slider_velocity);
+    write_header(buffer, *data);
 
-        if (!old_diff_format) {
-            write_star_ratings(entry, beatmap.star_rating_standard, use_float_star);
-            write_star_ratings(entry, beatmap.star_rating_taiko, use_float_star);
-            write_star_ratings(entry, beatmap.star_rating_ctb, use_float_star);
-            write_star_ratings(entry, beatmap.star_rating_mania, use_float_star);
-        }
+    for (auto& beatmap : data->beatmaps) {
+        beatmap.entry_offset = buffer.size();
+        write_beatmap(buffer, beatmap, *data, version);
+        beatmap.entry_length = buffer.size() - beatmap.entry_offset;
+    }
 
-        binary::write_i32(entry, beatmap.drain_time);
-        binary::write_i32(entry, beatmap.total_time);
-        binary::write_i32(entry, beatmap.audio_preview_time);
+    binary::write_i32(buffer, data->permissions);
+
+    if (!binary::write_file_atomic(location.string(), buffer)) {
+        return false;
+    }
+
+    std::error_code error;
+    data->file_size = buffer.size();
+    data->write_time = std::filesystem::last_write_time(location, error);
+    return true;
+}
+
+// entries have to follow each other from the header to the permissions, like they were
+// read. anything added, removed or moved around since then breaks the chain
+static bool has_file_layout(const OsuLegacyDatabase& data) {
+    if (data.file_size < sizeof(int32_t)) {
+        return false;
+    }
 
-        binary::write_i32(entry, static_cast<int>(beatmap.timing_points.size()));
+    const size_t beatmaps_end = data.file_size - sizeof(int32_t);
+    size_t expected = data.beatmaps.empty() ? beatmaps_end : data.beatmaps.front().entry_offset;
 
-        for (const auto& timing : beatmap.timing_points) {
-            binary::write_f64(entry, timing.bpm);
-            binary::write_f64(entry, timing.offset);
-            binary::write_bool(entry, timing.inherited != 0);
+    for (const auto& beatmap : data.beatmaps) {
+        if (beatmap.entry_length == 0 || beatmap.entry_offset != expected) {
+            return false;
         }
+        expected += beatmap.entry_length;
+    }
 
-        binary::write_i32(entry, beatmap.difficulty_id);
-        binary::write_i32(entry, beatmap.beatmap_id);
-        binary::write_i32(entry, beatmap.thread_id);
-        binary::write_u8(entry, static_cast<uint8_t>(beatmap.grade_standard));
-        binary::write_u8(entry, static_cast<uint8_t>(beatmap.grade_taiko));
-        binary::write_u8(entry, static_cast<uint8_t>(beatmap.grade_ctb));
-        binary::write_u8(entry, static_cast<uint8_t>(beatmap.grade_mania));
-        binary::write_i16(entry, static_cast<int16_t>(beatmap.local_offset));
-        binary::write_f32(entry, static_cast<float>(beatmap.stack_leniency));
-        binary::write_u8(entry, static_cast<uint8_t>(beatmap.mode));
-        binary::write_string(entry, beatmap.source);
-        binary::write_string(entry, beatmap.tags);
-        binary::write_i16(entry, static_cast<int16_t>(beatmap.online_offset));
-        binary::write_string(entry, beatmap.title_font);
-        binary::write_bool(entry, beatmap.unplayed != 0);
-        binary::write_i64(entry, beatmap.last_played);
-        binary::write_bool(entry, beatmap.is_osz2 != 0);
-        binary::write_string(entry, beatmap.folder_name);
-        binary::write_i64(entry, beatmap.last_checked);
-        binary::write_bool(entry, beatmap.ignore_sounds != 0);
-        binary::write_bool(entry, beatmap.ignore_skin != 0);
-        binary::write_bool(entry, beatmap.disable_storyboard != 0);
-        binary::write_bool(entry, beatmap.disable_video != 0);
-        binary::write_bool(entry, beatmap.visual_override != 0);
+    return expected == beatmaps_end;
+}
 
-        if (old_diff_format) {
-            binary::write_i16(entry, static_cast<int16_t>(beatmap.unknown.value_or(0)));
+// only touches the pages that actually differ
+static void patch_bytes(uint8_t* destination, const std::vector<uint8_t>& source) {
+    if (std::memcmp(destination, source.data(), source.size()) != 0) {
+        std::memcpy(destination, source.data(), source.size());
+    }
+}
+
+bool legacy_parser::patch(
+    const std::filesystem::path& location, OsuLegacyDatabase* data, const std::vector<size_t>& changed
+) {
+    if (data == nullptr || location.empty()) {
+        return false;
+    }
+
+    data->beatmaps_count = static_cast<int>(data->beatmaps.size());
+
+    std::error_code error;
+    const auto write_time = std::filesystem::last_write_time(location, error);
+
+    // osu! (or anything else) rewrote the file, the offsets don't mean anything anymore
+    if (error || write_time != data->write_time || !has_file_layout(*data)) {
+        return write(location, data);
+    }
+
+    binary::MappedFile file;
+
+    if (!file.open(location.string()) || file.size() != data->file_size) {
+        file.close();
+        return write(location, data);
+    }
+
+    std::vector<uint8_t> scratch;
+    write_header(scratch, *data);
+
+    int32_t file_version = 0;
+    std::memcpy(&file_version, file.data(), sizeof(file_version));
+
+    if (!binary::is_little_endian()) {
+        file_version = binary::byteswap(file_version);
+    }
+
+    const size_t header_size = data->beatmaps.empty() ? data->file_size - sizeof(int32_t)
+                                                      : data->beatmaps.front().entry_offset;
+
+    // a different version changes the layout of every entry, not just the changed ones
+    if (file_version != data->version || scratch.size() != header_size) {
+        file.close();
+        return write(location, data);
+    }
+
+    patch_bytes(file.data(), scratch);
+
+    for (const size_t index : changed) {
+        if (index >= data->beatmaps.size()) {
+            continue;
         }
 
-        binary::write_i32(entry, beatmap.last_modified);
-        binary::write_u8(entry, static_cast<uint8_t>(beatmap.mania_scroll_speed));
+        const auto& beatmap = data->beatmaps[index];
+
+        scratch.clear();
+        write_beatmap(scratch, beatmap, *data, data->version);
 
-        if (has_entry_size) {
-            binary::write_i32(buffer, static_cast<int>(entry.size()));
+        if (scratch.size() != beatmap.entry_length) {
+            file.close();
+            return write(location, data);
         }
 
-        buffer.insert(buffer.end(), entry.begin(), entry.end());
+        patch_bytes(file.data() + beatmap.entry_offset, scratch);
     }
 
-    binary::write_i32(buffer, data->permissions);
+    scratch.clear();
+    binary::write_i32(scratch, data->permissions);
+    patch_bytes(file.data() + data->file_size - sizeof(int32_t), scratch);
 
-    if (!binary::write_file_buffer(location.string(), buffer)) {
+    const bool flushed = file.flush();
+    file.close();
+
+    if (!flushed) {
+        std::cerr << "[legacy] failed to flush " << location.string() << "\n";
         return false;
     }
 
+    data->write_time = std::filesystem::last_write_time(location, error);
     return true;
 }
+
+std::vector<LegacyFloatPair> legacy_parser::star_ratings(
+    const OsuLegacyDatabase& data, const LegacyBeatmap& beatmap, int mode
+) {
+    if (mode < 0 || static_cast<size_t>(mode) >= beatmap.star_ratings_range.size()) {
+        return {};
+    }
+
+    return decode_star_ratings(data, beatmap.star_ratings_range[static_cast<size_t>(mode)]);
+}
+
+std::vector<LegacyTimingPoint> legacy_parser::timing_points(
+    const OsuLegacyDatabase& data, const LegacyBeatmap& beatmap
+) {
+    const auto& range = beatmap.timing_points_range;
+    std::vector<LegacyTimingPoint> points(range_count(data, range, TIMING_POINT_SIZE));
+
+    if (points.empty()) {
+        return points;
+    }
+
+    binary::BinaryCursor cursor;
+    binary::set_cursor(cursor, data.raw);
+    cursor.offset = range.offset;
+
+    auto reader = cursor.reserve(points.size() * TIMING_POINT_SIZE);
+
+    for (auto& point : points) {
+        point.bpm = reader.read_f64();
+        point.offset = reader.read_f64();
+        point.inherited = reader.read_bool() ? 1 : 0;
+    }
+
+    return points;
+}
+
+void legacy_parser::set_star_ratings(
+    OsuLegacyDatabase& data, LegacyBeatmap& beatmap, int mode, const std::vector<LegacyFloatPair>& ratings
+) {
+    if (mode < 0 || static_cast<size_t>(mode) >= beatmap.star_ratings_range.size()) {
+        return;
+    }
+
+    if (data.raw_id == 0) {
+        data.raw_id = next_raw_id();
+    }
+
+    auto& range = beatmap.star_ratings_range[static_cast<size_t>(mode)];
+    range.offset = data.raw.size();
+    range.count = static_cast<uint32_t>(ratings.size());
+    range.source = data.raw_id;
+
+    const bool use_float = uses_float_star(data.raw_version);
+
+    for (const auto& pair : ratings) {
+        write_int_float_pair(data.raw, pair, use_float);
+    }
+
+    if (mode != beatmap.mode) {
+        return;
+    }
+
+    const auto nomod = std::find_if(ratings.begin(), ratings.end(), [](const LegacyFloatPair& pair) {
+        return pair.mod_combination == 0;
+    });
+    beatmap.star_rating = nomod != ratings.end() ? nomod->star_rating : 0.0;
+}
+
+void legacy_parser::set_timing_points(
+    OsuLegacyDatabase& data, LegacyBeatmap& beatmap, const std::vector<LegacyTimingPoint>& points
+) {
+    if (data.raw_id == 0) {
+        data.raw_id = next_raw_id();
+    }
+
+    beatmap.timing_points_range.offset = data.raw.size();
+    beatmap.timing_points_range.count = static_cast<uint32_t>(points.size());
+    beatmap.timing_points_range.source = data.raw_id;
+
+    for (const auto& point : points) {
+        binary::write_f64(data.raw, point.bpm);
+        binary::write_f64(data.raw, point.offset);
+        binary::write_bool(data.raw, point.inherited != 0);
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <filesystem>
 #include <optional>
@@ -17,7 +18,18 @@ struct LegacyTimingPoint {
     int inherited = 0;
 };
 
+// count elements starting at offset in OsuLegacyDatabase::raw. source is the raw_id of
+// the database the bytes live in, a range is empty for any other database
+struct LegacyRange {
+    size_t offset = 0;
+    uint32_t count = 0;
+    uint64_t source = 0;
+};
+
 struct LegacyBeatmap {
+    // where parse() / write() put the entry in the file, entry size included
+    size_t entry_offset = 0;
+    size_t entry_length = 0;
     std::optional<int> entry_size;
     std::string artist;
     std::string artist_unicode;
@@ -38,15 +50,16 @@ struct LegacyBeatmap {
     double hp_drain = 0.0;
     double overall_difficulty = 0.0;
     double slider_velocity = 0.0;
-    std::vector<LegacyFloatPair> star_rating_standard;
-    std::vector<LegacyFloatPair> star_rating_taiko;
-    std::vector<LegacyFloatPair> star_rating_ctb;
-    std::vector<LegacyFloatPair> star_rating_mania;
+    // nomod rating for the beatmap's own mode, 0 when osu! didn't calculate one
+    double star_rating = 0.0;
+    // every mode's ratings (standard, taiko, ctb, mania) and the timing points stay encoded
+    // in the database they came from, legacy_parser::star_ratings / timing_points decode them
+    std::array<LegacyRange, 4> star_ratings_range{};
     int drain_time = 0;
     int total_time = 0;
     std::optional<double> duration;
     int audio_preview_time = 0;
-    std::vector<LegacyTimingPoint> timing_points;
+    LegacyRange timing_points_range;
     int difficulty_id = 0;
     int beatmap_id = 0;
     int thread_id = 0;
@@ -85,6 +98,15 @@ struct OsuLegacyDatabase {
     int beatmaps_count = 0;
     std::vector<LegacyBeatmap> beatmaps;
     int permissions = 0;
+    // the file the entry offsets belong to
+    size_t file_size = 0;
+    std::filesystem::file_time_type write_time{};
+    // the file parse() read, kept for the beatmap ranges. set_star_ratings / set_timing_points
+    // append to it
+    std::vector<uint8_t> raw;
+    int raw_version = 0; // star ratings in raw are floats from 20250107 on, doubles before
+    // new for every parse() (or the first set_* on an empty database), copies share it
+    uint64_t raw_id = 0;
 };
 
 struct LegacyScoreBase {
@@ -135,4 +157,21 @@ struct LegacyReplay : LegacyScoreBase {
 namespace legacy_parser {
     bool parse(const std::filesystem::path& location, OsuLegacyDatabase* data);
     bool write(const std::filesystem::path& location, OsuLegacyDatabase* data);
+    // rewrites the header and the beatmaps at the given indices inside the existing file.
+    // anything that keeps its size is patched in place (ids, grades, offsets, last played,
+    // unplayed, star ratings...), a changed string length, added / removed beatmaps or a
+    // file touched since parse() / write() fall back to write()
+    bool patch(const std::filesystem::path& location, OsuLegacyDatabase* data, const std::vector<size_t>& changed);
+
+    // decoded on every call, mode 0 - 3. empty for beatmaps without ratings
+    std::vector<LegacyFloatPair> star_ratings(const OsuLegacyDatabase& data, const LegacyBeatmap& beatmap, int mode);
+    std::vector<LegacyTimingPoint> timing_points(const OsuLegacyDatabase& data, const LegacyBeatmap& beatmap);
+    // encodes the values into data.raw and points the beatmap at them, the old bytes stay
+    // until the next parse(). star_rating follows when mode is the beatmap's mode
+    void set_star_ratings(
+        OsuLegacyDatabase& data, LegacyBeatmap& beatmap, int mode, const std::vector<LegacyFloatPair>& ratings
+    );
+    void set_timing_points(
+        OsuLegacyDatabase& data, LegacyBeatmap& beatmap, const std::vector<LegacyTimingPoint>& points
+    );
 }; // namespace legacy_parser
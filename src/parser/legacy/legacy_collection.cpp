@@ -38,7 +38,7 @@ bool legacy_collection_parser::parse(const std::string location, OsuLegacyCollec
             collection.beatmap_md5.reserve(static_cast<size_t>(std::max(0, collection.beatmaps_count)));
 
             for (int j = 0; j < collection.beatmaps_count; j++) {
-                collection.beatmap_md5.push_back(binary::read_string(cursor));
+                collection.beatmap_md5.emplace_back(binary::view_string(cursor));
             }
 
             data->collections.push_back(std::move(collection));
@@ -50,13 +50,28 @@ bool legacy_collection_parser::parse(const std::string location, OsuLegacyCollec
     }
 }
 
+// exact size of the serialized file, so the buffer is allocated once
+static size_t collection_db_size(const OsuLegacyCollection& data) {
+    size_t size = sizeof(int32_t) * 2;
+
+    for (const auto& collection : data.collections) {
+        size += binary::string_size(collection.name) + sizeof(int32_t);
+
+        for (const auto& checksum : collection.beatmap_md5) {
+            size += binary::string_size(checksum);
+        }
+    }
+
+    return size;
+}
+
 bool legacy_collection_parser::write(const std::string location, OsuLegacyCollection* data) {
     if (data == nullptr || location.empty()) {
         return false;
     }
 
     std::vector<uint8_t> buffer;
-    buffer.reserve(1024);
+    buffer.reserve(collection_db_size(*data));
 
     data->collections_count = static_cast<int>(data->collections.size());
 
@@ -73,9 +88,6 @@ bool legacy_collection_parser::write(const std::string location, OsuLegacyCollec
         }
     }
 
-    if (!binary::write_file_buffer(location, buffer)) {
-        return false;
-    }
-
-    return true;
+    // osu! loses every collection if this file is cut short, never write it in place
+    return binary::write_file_atomic(location, buffer);
 }
@@ -1,11 +1,20 @@
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
 #include <unordered_map>
 
 #include "../../utils/binary.hpp"
 #include "../../utils/gzip.hpp"
 #include "osdb.hpp"
 
+// how much of the body is built before it's handed to the compressor
+static constexpr size_t WRITE_CHUNK_SIZE = 256 * 1024;
+
 static bool ends_with(const std::string& value, const char* suffix) {
     const size_t suffix_len = std::strlen(suffix);
 
@@ -26,169 +35,231 @@ static int osdb_version_to_code(const std::string& version) {
     return it != version_map.end() ? it->second : 0;
 }
 
-bool osdb_parser::parse(std::string location) {
-    if (data == nullptr) {
-        return false;
-    }
-
-    std::string target_location = std::move(location);
-    std::vector<uint8_t> buffer;
+static OsdbCollection read_collection(binary::BinaryCursor& cursor, int version, bool is_minimal) {
+    OsdbCollection collection;
+    collection.name = binary::read_string2(cursor);
 
-    if (!binary::read_file_buffer(target_location, buffer)) {
-        return false;
+    if (version >= 7) {
+        collection.online_id = binary::read_i32(cursor);
+    } else {
+        collection.online_id = 0;
     }
 
-    try {
-        binary::BinaryCursor cursor;
-        binary::set_cursor(cursor, buffer);
+    const int beatmaps_count = binary::read_i32(cursor);
 
-        const std::string version_string = binary::read_string2(cursor);
-        const int version = osdb_version_to_code(version_string);
+    if (beatmaps_count < 0) {
+        throw std::runtime_error("invalid beatmaps count");
+    }
 
-        if (version == 0) {
-            return false;
-        }
+    collection.beatmaps.reserve(static_cast<size_t>(beatmaps_count));
 
-        const bool is_minimal = ends_with(version_string, "min");
-        OsdbData temp;
+    for (int j = 0; j < beatmaps_count; j++) {
+        OsdbBeatmap beatmap;
 
-        temp.version_string = version_string;
-        std::vector<uint8_t> decompressed;
+        beatmap.difficulty_id = binary::read_i32(cursor);
+        beatmap.beatmapset_id = version >= 2 ? binary::read_i32(cursor) : -1;
 
-        if (version >= 7) {
-            std::vector<uint8_t> compressed(buffer.begin() + static_cast<std::ptrdiff_t>(cursor.offset), buffer.end());
+        if (!is_minimal) {
+            beatmap.artist = binary::read_string2(cursor);
+            beatmap.title = binary::read_string2(cursor);
+            beatmap.difficulty = binary::read_string2(cursor);
+        }
 
-            if (!binary::gzip_decompress(compressed, decompressed)) {
-                return false;
-            }
+        beatmap.checksum = binary::read_string2(cursor);
 
-            binary::set_cursor(cursor, decompressed);
-            binary::read_string2(cursor);
+        if (version >= 4) {
+            beatmap.user_comment = binary::read_string2(cursor);
         }
 
-        temp.save_data = binary::read_i64(cursor);
-        temp.last_editor = binary::read_string2(cursor);
-        temp.count = binary::read_i32(cursor);
+        if (version >= 8 || (version >= 5 && !is_minimal)) {
+            beatmap.mode = binary::read_u8(cursor);
+        }
 
-        if (temp.count < 0) {
-            return false;
+        if (version >= 8 || (version >= 6 && !is_minimal)) {
+            beatmap.difficulty_rating = binary::read_f64(cursor);
         }
 
-        temp.collections.clear();
-        temp.collections.reserve(static_cast<size_t>(temp.count));
+        collection.beatmaps.push_back(std::move(beatmap));
+    }
 
-        for (int i = 0; i < temp.count; i++) {
-            OsdbCollection collection;
-            collection.name = binary::read_string2(cursor);
+    if (version >= 3) {
+        const int hash_count = binary::read_i32(cursor);
 
-            if (version >= 7) {
-                collection.online_id = binary::read_i32(cursor);
-            } else {
-                collection.online_id = 0;
-            }
+        if (hash_count < 0) {
+            throw std::runtime_error("invalid hash count");
+        }
 
-            const int beatmaps_count = binary::read_i32(cursor);
+        collection.hash_only_beatmaps.reserve(static_cast<size_t>(hash_count));
 
-            if (beatmaps_count < 0) {
-                return false;
-            }
+        for (int j = 0; j < hash_count; j++) {
+            collection.hash_only_beatmaps.push_back(binary::read_string2(cursor));
+        }
+    }
 
-            collection.beatmaps.clear();
-            collection.beatmaps.reserve(static_cast<size_t>(beatmaps_count));
+    return collection;
+}
 
-            for (int j = 0; j < beatmaps_count; j++) {
-                OsdbBeatmap beatmap;
+bool OsdbReader::read(const std::string& location, OsdbData& data) {
+    OsdbData temp;
 
-                beatmap.difficulty_id = binary::read_i32(cursor);
-                beatmap.beatmapset_id = version >= 2 ? binary::read_i32(cursor) : -1;
+    const bool ok = read(location, temp, [&temp](OsdbCollection&& collection) {
+        temp.collections.push_back(std::move(collection));
+    });
 
-                if (!is_minimal) {
-                    beatmap.artist = binary::read_string2(cursor);
-                    beatmap.title = binary::read_string2(cursor);
-                    beatmap.difficulty = binary::read_string2(cursor);
-                }
+    if (!ok) {
+        return false;
+    }
 
-                beatmap.checksum = binary::read_string2(cursor);
+    data = std::move(temp);
+    return true;
+}
 
-                if (version >= 4) {
-                    beatmap.user_comment = binary::read_string2(cursor);
-                }
+bool OsdbReader::read(const std::string& location, OsdbData& data, const OnCollection& on_collection) {
+    std::ifstream file(location, std::ios::binary);
 
-                if (version >= 8 || (version >= 5 && !is_minimal)) {
-                    beatmap.mode = binary::read_u8(cursor);
-                }
+    if (!file.is_open()) {
+        return false;
+    }
 
-                if (version >= 8 || (version >= 6 && !is_minimal)) {
-                    beatmap.difficulty_rating = binary::read_f64(cursor);
-                }
+    try {
+        binary::StreamSource raw(file);
+        binary::GzipSource inflated(file);
+        binary::BinaryCursor cursor;
+        raw.attach(cursor);
 
-                collection.beatmaps.push_back(std::move(beatmap));
-            }
+        const std::string version_string = binary::read_string2(cursor);
+        const int version = osdb_version_to_code(version_string);
 
-            if (version >= 3) {
-                const int hash_count = binary::read_i32(cursor);
-                collection.hash_only_beatmaps.clear();
+        if (version == 0) {
+            return false;
+        }
 
-                if (hash_count < 0) {
-                    return false;
-                }
+        const bool is_minimal = ends_with(version_string, "min");
 
-                collection.hash_only_beatmaps.reserve(static_cast<size_t>(hash_count));
+        // everything after the version string is one gzip stream, inflated while it's read
+        if (version >= 7) {
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(raw.position(cursor)));
+            inflated.attach(cursor);
+            binary::read_string2(cursor);
+        }
 
-                for (int j = 0; j < hash_count; j++) {
-                    collection.hash_only_beatmaps.push_back(binary::read_string2(cursor));
-                }
-            }
+        data.version_string = version_string;
+        data.save_data = binary::read_i64(cursor);
+        data.last_editor = binary::read_string2(cursor);
+        data.count = binary::read_i32(cursor);
 
-            temp.collections.push_back(std::move(collection));
+        if (data.count < 0) {
+            return false;
         }
 
-        const std::string footer = binary::read_string2(cursor);
+        data.collections.clear();
 
-        if (footer != "By Piotrekol") {
-            return false;
+        for (int i = 0; i < data.count; i++) {
+            on_collection(read_collection(cursor, version, is_minimal));
         }
 
-        *data = std::move(temp);
-        return true;
+        const std::string footer = binary::read_string2(cursor);
+        return footer == "By Piotrekol";
     } catch (const std::exception& e) {
         return false;
     }
 }
 
-bool osdb_parser::write() {
-    if (data == nullptr || location.empty()) {
+bool OsdbWriter::write(const std::string& location, const OsdbData& data) {
+    if (location.empty()) {
         return false;
     }
 
-    const std::string version_string = data->version_string.empty() ? "o!dm8min" : data->version_string;
+    const std::string version_string = data.version_string.empty() ? "o!dm8min" : data.version_string;
     const int version = osdb_version_to_code(version_string);
 
     if (version == 0) {
         return false;
     }
 
+    // streamed into "<location>.tmp" and renamed over location once complete, a failed
+    // write leaves the old file alone
+    const std::filesystem::path path(location);
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    const bool written = write_to(file, version_string, version, data);
+    file.close();
+
+    std::error_code error;
+
+    if (!written || file.fail()) {
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+
+    std::filesystem::rename(temp, path, error);
+
+    if (error) {
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+
+    return true;
+}
+
+bool OsdbWriter::write_to(std::ofstream& file, const std::string& version_string, int version, const OsdbData& data) {
     const bool is_minimal = ends_with(version_string, "min");
+    std::vector<uint8_t>& content = m_content;
+    content.clear();
+    binary::write_string2(content, version_string);
+    file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    content.clear();
+
+    // the body is compressed into the file as it's built, never held whole
+    const int level = std::clamp(m_options.compression_level, 0, 9);
+    std::unique_ptr<binary::GzipWriter> gzip;
+    std::unique_ptr<binary::ParallelGzipWriter> parallel_gzip;
+
+    if (version >= 7 && m_options.parallel) {
+        parallel_gzip = std::make_unique<binary::ParallelGzipWriter>(file, level);
+    } else if (version >= 7) {
+        gzip = std::make_unique<binary::GzipWriter>(file, level);
+    }
+
+    const auto flush_content = [&]() {
+        bool ok = true;
+
+        if (parallel_gzip) {
+            ok = parallel_gzip->append(content.data(), content.size());
+        } else if (gzip) {
+            ok = gzip->append(content.data(), content.size());
+        } else {
+            file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+        }
+
+        content.clear();
+        return ok && file.good();
+    };
 
-    std::vector<uint8_t> content;
     if (version >= 7) {
         binary::write_string2(content, version_string);
     }
 
-    const int64_t save_time = data->save_data != 0
-                                  ? data->save_data
+    const int64_t save_time = data.save_data != 0
+                                  ? data.save_data
                                   : static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
                                                              std::chrono::system_clock::now().time_since_epoch()
                                     )
                                                              .count());
 
-    data->count = static_cast<int>(data->collections.size());
-
     binary::write_i64(content, save_time);
-    binary::write_string2(content, data->last_editor);
-    binary::write_i32(content, data->count);
+    binary::write_string2(content, data.last_editor);
+    binary::write_i32(content, static_cast<int>(data.collections.size()));
 
-    for (const auto& collection : data->collections) {
+    for (const auto& collection : data.collections) {
         binary::write_string2(content, collection.name);
 
         if (version >= 7) {
@@ -223,6 +294,10 @@ bool osdb_parser::write() {
             if (version >= 8 || (version >= 6 && !is_minimal)) {
                 binary::write_f64(content, beatmap.difficulty_rating);
             }
+
+            if (content.size() >= WRITE_CHUNK_SIZE && !flush_content()) {
+                return false;
+            }
         }
 
         if (version >= 3) {
@@ -231,28 +306,22 @@ bool osdb_parser::write() {
                 binary::write_string2(content, hash);
             }
         }
-    }
 
-    binary::write_string2(content, "By Piotrekol");
-
-    std::vector<uint8_t> buffer;
-    binary::write_string2(buffer, version_string);
-
-    if (version >= 7) {
-        std::vector<uint8_t> compressed;
-
-        if (!binary::gzip_compress(content, compressed)) {
+        if (content.size() >= WRITE_CHUNK_SIZE && !flush_content()) {
             return false;
         }
+    }
 
-        buffer.insert(buffer.end(), compressed.begin(), compressed.end());
-    } else {
-        buffer.insert(buffer.end(), content.begin(), content.end());
+    binary::write_string2(content, "By Piotrekol");
+
+    if (!flush_content()) {
+        return false;
     }
 
-    if (!binary::write_file_buffer(location, buffer)) {
+    if ((gzip && !gzip->finish()) || (parallel_gzip && !parallel_gzip->finish())) {
         return false;
     }
 
-    return true;
+    file.flush();
+    return file.good();
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
@@ -31,10 +33,35 @@ struct OsdbData {
     std::vector<OsdbCollection> collections;
 };
 
-namespace osdb_parser {
-    bool parse(std::string location);
-    bool write();
+struct OsdbWriteOptions {
+    int compression_level = 9; // 0 (stored) to 9, only used by o!dm7 and later
+    bool parallel = false;     // compress in blocks on g_thread_pool, a bit bigger but much faster
+};
+
+// reads .osdb files. instances share nothing, any number of them can run at once
+class OsdbReader {
+public:
+    using OnCollection = std::function<void(OsdbCollection&&)>;
+
+    // everything into data, which is only touched when the whole file is valid
+    bool read(const std::string& location, OsdbData& data);
+    // header fields into data, every collection goes to on_collection as soon as it's
+    // read instead of being kept. a broken file can fail after some were delivered
+    bool read(const std::string& location, OsdbData& data, const OnCollection& on_collection);
+};
 
-    inline OsdbData* data;
-    inline std::string location("");
-}; // namespace osdb_parser
+class OsdbWriter {
+public:
+    explicit OsdbWriter(OsdbWriteOptions options = {}) : m_options(options) {
+    }
+
+    // an empty version_string writes o!dm8min, save_data 0 means now
+    bool write(const std::string& location, const OsdbData& data);
+
+private:
+    // header and body into an open file, the gzip writers are gone once it returns
+    bool write_to(std::ofstream& file, const std::string& version_string, int version, const OsdbData& data);
+
+    OsdbWriteOptions m_options;
+    std::vector<uint8_t> m_content; // body chunk, kept between writes
+};
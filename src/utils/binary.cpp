@@ -0,0 +1,195 @@
+#include "binary.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::FILE* open_for_write(const std::filesystem::path& path) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), L"wb");
+#else
+    return std::fopen(path.c_str(), "wb");
+#endif
+}
+
+static bool sync_file(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// the rename itself lives in the directory entry, flush that too where it's possible
+static void sync_directory(const std::filesystem::path& directory) {
+#ifndef _WIN32
+    const int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#else
+    (void)directory;
+#endif
+}
+
+bool binary::write_file_atomic(const std::string& location, const std::vector<uint8_t>& buffer) {
+    return write_file_atomic(location, std::string_view(reinterpret_cast<const char*>(buffer.data()), buffer.size()));
+}
+
+bool binary::write_file_atomic(const std::string& location, std::string_view buffer) {
+    const std::filesystem::path path(location);
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+
+    std::FILE* file = open_for_write(temp);
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    const bool written = buffer.empty() || std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    const bool synced = written && sync_file(file);
+    const bool closed = std::fclose(file) == 0;
+    std::error_code error;
+
+    if (!written || !synced || !closed) {
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+
+    std::filesystem::rename(temp, path, error);
+
+    if (error) {
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+
+    sync_directory(path.parent_path());
+    return true;
+}
+
+binary::MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+bool binary::MappedFile::open(const std::string& location) {
+    close();
+
+    const std::filesystem::path path(location);
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    m_file = file;
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+        close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+
+    if (m_mapping == nullptr) {
+        close();
+        return false;
+    }
+
+    m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, 0));
+
+    if (m_data == nullptr) {
+        close();
+        return false;
+    }
+
+    m_size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+bool binary::MappedFile::flush() {
+    return m_data != nullptr && FlushViewOfFile(m_data, 0) && FlushFileBuffers(static_cast<HANDLE>(m_file));
+}
+
+void binary::MappedFile::close() {
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != nullptr) {
+        CloseHandle(m_file);
+    }
+
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = nullptr;
+    m_size = 0;
+}
+#else
+bool binary::MappedFile::open(const std::string& location) {
+    close();
+
+    m_fd = ::open(location.c_str(), O_RDWR);
+
+    if (m_fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+
+    // mmap can't map an empty file
+    if (fstat(m_fd, &info) != 0 || info.st_size <= 0) {
+        close();
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+    if (data == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    m_data = static_cast<uint8_t*>(data);
+    m_size = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+bool binary::MappedFile::flush() {
+    return m_data != nullptr && msync(m_data, m_size, MS_SYNC) == 0;
+}
+
+void binary::MappedFile::close() {
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+
+    m_data = nullptr;
+    m_size = 0;
+    m_fd = -1;
+}
+#endif
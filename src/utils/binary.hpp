@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <charconv>
 #include <cstdint>
 #include <cstring>
@@ -14,17 +15,101 @@
 #include <format>
 
 namespace binary {
+    class BinarySource;
+    class ReservedReader;
+
     struct BinaryCursor {
         const std::vector<uint8_t>* buffer = nullptr;
         size_t offset = 0;
+        BinarySource* source = nullptr; // refills buffer when a read runs past its end
+
+        // checks once that `bytes` can be read (throws like any read if they can't), the
+        // returned reader then reads them without checks. don't touch the cursor while
+        // the reader is alive, it moves the offset when it goes away
+        ReservedReader reserve(size_t bytes);
+    };
+
+    // feeds a cursor from data that shouldn't be held in memory at once (a file, an
+    // inflate stream). the cursor only sees a window, reads past its end pull more in
+    class BinarySource {
+    public:
+        explicit BinarySource(size_t window_size = 256 * 1024) : m_window_size(window_size) {
+        }
+
+        virtual ~BinarySource() = default;
+
+        BinarySource(const BinarySource&) = delete;
+        BinarySource& operator=(const BinarySource&) = delete;
+
+        void attach(BinaryCursor& cursor) {
+            m_window.clear();
+            m_dropped = 0;
+            cursor.buffer = &m_window;
+            cursor.offset = 0;
+            cursor.source = this;
+        }
+
+        // drops what the cursor already read and pulls until `bytes` are available
+        bool fill(BinaryCursor& cursor, size_t bytes) {
+            const size_t consumed = std::min(cursor.offset, m_window.size());
+            m_window.erase(m_window.begin(), m_window.begin() + static_cast<std::ptrdiff_t>(consumed));
+            m_dropped += consumed;
+            cursor.offset = 0;
+
+            size_t available = m_window.size();
+            m_window.resize(std::max(m_window_size, bytes));
+
+            while (available < bytes) {
+                const size_t size = read(m_window.data() + available, m_window.size() - available);
+                if (size == 0) {
+                    break;
+                }
+                available += size;
+            }
+
+            m_window.resize(available);
+            return available >= bytes;
+        }
+
+        // where the cursor is counting from the start of the source
+        size_t position(const BinaryCursor& cursor) const {
+            return m_dropped + cursor.offset;
+        }
+
+    protected:
+        // up to size bytes, 0 once the data ended. throws on broken input
+        virtual size_t read(uint8_t* out, size_t size) = 0;
+
+    private:
+        std::vector<uint8_t> m_window;
+        size_t m_window_size;
+        size_t m_dropped = 0;
+    };
+
+    // raw bytes straight from a stream
+    class StreamSource : public BinarySource {
+    public:
+        explicit StreamSource(std::istream& input, size_t window_size = 256 * 1024)
+            : BinarySource(window_size), m_input(input) {
+        }
+
+    protected:
+        size_t read(uint8_t* out, size_t size) override {
+            m_input.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(size));
+            return static_cast<size_t>(m_input.gcount());
+        }
+
+    private:
+        std::istream& m_input;
     };
 
     inline void set_cursor(BinaryCursor& cursor, const std::vector<uint8_t>& data) {
         cursor.buffer = &data;
         cursor.offset = 0;
+        cursor.source = nullptr;
     }
 
-    inline void ensure_range(const BinaryCursor& cursor, size_t bytes) {
+    inline void ensure_range(BinaryCursor& cursor, size_t bytes) {
         if (!cursor.buffer) {
             throw std::runtime_error("binary read out of range");
         }
@@ -34,7 +119,7 @@ namespace binary {
         }
 
         const size_t remaining = cursor.buffer->size() - cursor.offset;
-        if (bytes > remaining) {
+        if (bytes > remaining && (cursor.source == nullptr || !cursor.source->fill(cursor, bytes))) {
             throw std::runtime_error("binary read out of range");
         }
     }
@@ -86,6 +171,85 @@ namespace binary {
         return byteswap(static_cast<T>(value));
     }
 
+    // fixed size reads inside a range BinaryCursor::reserve already checked. reading
+    // past the reserved bytes is on the caller, like indexing past a span
+    class ReservedReader {
+    public:
+        ReservedReader(BinaryCursor& cursor, const uint8_t* data) : m_cursor(cursor), m_start(data), m_data(data) {
+        }
+
+        ~ReservedReader() {
+            m_cursor.offset += static_cast<size_t>(m_data - m_start);
+        }
+
+        ReservedReader(const ReservedReader&) = delete;
+        ReservedReader& operator=(const ReservedReader&) = delete;
+
+        template <typename T>
+        T read() {
+            using U = std::make_unsigned_t<T>;
+            U value = 0;
+            std::memcpy(&value, m_data, sizeof(T));
+            m_data += sizeof(T);
+            if (is_little_endian()) {
+                return static_cast<T>(value);
+            }
+            return byteswap(static_cast<T>(value));
+        }
+
+        uint8_t read_u8() {
+            return *m_data++;
+        }
+
+        bool read_bool() {
+            return *m_data++ != 0;
+        }
+
+        void skip(size_t bytes) {
+            m_data += bytes;
+        }
+
+        int16_t read_i16() {
+            return read<int16_t>();
+        }
+
+        uint16_t read_u16() {
+            return read<uint16_t>();
+        }
+
+        int read_i32() {
+            return read<int>();
+        }
+
+        int64_t read_i64() {
+            return read<int64_t>();
+        }
+
+        float read_f32() {
+            const uint32_t bits = read<uint32_t>();
+            float value = 0.0f;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        double read_f64() {
+            const uint64_t bits = read<uint64_t>();
+            double value = 0.0;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+    private:
+        BinaryCursor& m_cursor;
+        const uint8_t* m_start;
+        const uint8_t* m_data;
+    };
+
+    inline ReservedReader BinaryCursor::reserve(size_t bytes) {
+        ensure_range(*this, bytes);
+        return ReservedReader(*this, buffer->data() + offset);
+    }
+
     inline uint8_t read_u8(BinaryCursor& cursor) {
         return read_integral<uint8_t>(cursor);
     }
@@ -136,7 +300,8 @@ namespace binary {
         return read_u8(cursor) != 0;
     }
 
-    inline uint32_t read_uleb128(BinaryCursor& cursor) {
+    // byte by byte through ensure_range, for the end of the buffer or a cursor window
+    inline uint32_t read_uleb128_checked(BinaryCursor& cursor) {
         uint32_t result = 0;
         int shift = 0;
         bool has_more = true;
@@ -162,29 +327,84 @@ namespace binary {
         return result;
     }
 
-    inline std::string read_string(BinaryCursor& cursor) {
-        uint8_t marker = read_u8(cursor);
-        if (marker == 0x00) {
-            return "";
+    inline uint32_t read_uleb128(BinaryCursor& cursor) {
+        ensure_range(cursor, 1);
+        const uint8_t* data = cursor.buffer->data() + cursor.offset;
+
+        // string lengths are almost always below 128
+        if (data[0] < 0x80) {
+            cursor.offset++;
+            return data[0];
         }
 
-        if (marker != 0x0B) {
-            throw std::runtime_error("invalid string marker");
+        if (cursor.buffer->size() - cursor.offset < 5) {
+            return read_uleb128_checked(cursor);
+        }
+
+        // the longest valid encoding is in the buffer, decode it without checking each byte
+        uint32_t result = data[0] & 0x7F;
+        size_t size = 1;
+
+        while (size < 5 && (data[size - 1] & 0x80) != 0) {
+            result |= static_cast<uint32_t>(data[size] & 0x7F) << (7 * size);
+            size++;
+        }
+
+        if ((data[size - 1] & 0x80) != 0 || (size == 5 && data[4] > 0x0F)) {
+            throw std::runtime_error("uleb128 overflow");
         }
 
-        uint32_t length = read_uleb128(cursor);
+        cursor.offset += size;
+        return result;
+    }
+
+    // the string bytes in place, without copying. it points into the cursor's buffer, so
+    // it's valid as long as the buffer is, and only until the next read for a cursor
+    // fed by a BinarySource
+    inline std::string_view view_string2(BinaryCursor& cursor) {
+        const uint32_t length = read_uleb128(cursor);
         ensure_range(cursor, length);
-        std::string value(reinterpret_cast<const char*>(cursor.buffer->data() + cursor.offset), length);
+        const std::string_view value(reinterpret_cast<const char*>(cursor.buffer->data() + cursor.offset), length);
         cursor.offset += length;
         return value;
     }
 
+    // same as view_string2, with the osu! 0x00 / 0x0B marker in front
+    inline std::string_view view_string(BinaryCursor& cursor) {
+        if (cursor.buffer != nullptr && cursor.offset + 2 <= cursor.buffer->size()) {
+            const uint8_t* data = cursor.buffer->data() + cursor.offset;
+            const size_t remaining = cursor.buffer->size() - cursor.offset - 2;
+
+            // marker, one byte length and the bytes themselves checked at once
+            if (data[0] == 0x0B && data[1] < 0x80 && data[1] <= remaining) {
+                cursor.offset += 2 + data[1];
+                return std::string_view(reinterpret_cast<const char*>(data + 2), data[1]);
+            }
+        }
+
+        const uint8_t marker = read_u8(cursor);
+
+        if (marker == 0x00) {
+            return {};
+        }
+
+        if (marker != 0x0B) {
+            throw std::runtime_error("invalid string marker");
+        }
+
+        return view_string2(cursor);
+    }
+
+    inline void skip_string(BinaryCursor& cursor) {
+        view_string(cursor);
+    }
+
+    inline std::string read_string(BinaryCursor& cursor) {
+        return std::string(view_string(cursor));
+    }
+
     inline std::string read_string2(BinaryCursor& cursor) {
-        uint32_t length = read_uleb128(cursor);
-        ensure_range(cursor, length);
-        std::string value(reinterpret_cast<const char*>(cursor.buffer->data() + cursor.offset), length);
-        cursor.offset += length;
-        return value;
+        return std::string(view_string2(cursor));
     }
 
     inline void skip(BinaryCursor& cursor, size_t bytes) {
@@ -203,6 +423,14 @@ namespace binary {
         std::memcpy(out.data() + start, &value, sizeof(T));
     }
 
+    // overwrites bytes that were already written, for sizes only known afterwards
+    inline void patch_i32(std::vector<uint8_t>& out, size_t offset, int value) {
+        if (!is_little_endian()) {
+            value = byteswap(value);
+        }
+        std::memcpy(out.data() + offset, &value, sizeof(value));
+    }
+
     inline void write_u8(std::vector<uint8_t>& out, uint8_t value) {
         out.push_back(value);
     }
@@ -262,6 +490,23 @@ namespace binary {
         } while (value != 0);
     }
 
+    inline size_t uleb128_size(uint32_t value) {
+        size_t size = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    // bytes write_string produces, for sizing a buffer before serializing
+    inline size_t string_size(const std::string& value) {
+        if (value.empty()) {
+            return 1;
+        }
+        return 1 + uleb128_size(static_cast<uint32_t>(value.size())) + value.size();
+    }
+
     inline void write_string(std::vector<uint8_t>& out, const std::string& value) {
         if (value.empty()) {
             out.push_back(0x00);
@@ -312,6 +557,44 @@ namespace binary {
         return file.good();
     }
 
+    // writes "<location>.tmp", fsyncs it and renames it over location. a crash at any
+    // point leaves either the old file or the complete new one
+    bool write_file_atomic(const std::string& location, const std::vector<uint8_t>& buffer);
+    bool write_file_atomic(const std::string& location, std::string_view buffer);
+
+    // an existing file mapped for reading and writing in place. writes land in the page
+    // cache right away, flush() pushes them to disk. the size can't change
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& location);
+        bool flush();
+        void close();
+
+        uint8_t* data() const {
+            return m_data;
+        }
+
+        size_t size() const {
+            return m_size;
+        }
+
+    private:
+        uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#else
+        int m_fd = -1;
+#endif
+    };
+
     template <typename T>
     T str_to(std::string_view sv, T _d = T()) {
         T value = {};
@@ -0,0 +1,147 @@
+#include "gzip.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+    // raw deflate of one block. everything but the last block ends with a sync flush,
+    // which leaves it byte aligned and not final
+    std::vector<uint8_t> deflate_block(const std::vector<uint8_t>& input, int level, bool last) {
+        mz_stream stream{};
+
+        if (mz_deflateInit2(&stream, level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 8, MZ_DEFAULT_STRATEGY) != MZ_OK) {
+            throw std::runtime_error("failed to start deflating");
+        }
+
+        // room for the worst case plus the empty stored block of the flush
+        std::vector<uint8_t> output(mz_deflateBound(&stream, static_cast<mz_ulong>(input.size())) + 16);
+
+        stream.next_in = const_cast<unsigned char*>(input.data());
+        stream.avail_in = static_cast<mz_uint32>(input.size());
+        stream.next_out = output.data();
+        stream.avail_out = static_cast<mz_uint32>(output.size());
+
+        const int status = mz_deflate(&stream, last ? MZ_FINISH : MZ_SYNC_FLUSH);
+        const bool done = last ? status == MZ_STREAM_END : status == MZ_OK && stream.avail_in == 0;
+
+        output.resize(output.size() - stream.avail_out);
+        mz_deflateEnd(&stream);
+
+        if (!done) {
+            throw std::runtime_error("failed to deflate block");
+        }
+
+        return output;
+    }
+} // namespace
+
+binary::ParallelGzipWriter::ParallelGzipWriter(std::ostream& output, int level, size_t block_size, size_t max_in_flight)
+    : m_output(output), m_level(level), m_block_size(std::max<size_t>(block_size, 64 * 1024)),
+      m_max_in_flight(std::max<size_t>(max_in_flight, 1)) {
+    g_thread_pool.initialize();
+    m_block.reserve(m_block_size);
+
+    // same header as gzip_compress
+    const uint8_t header[10] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+    m_output.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+binary::ParallelGzipWriter::~ParallelGzipWriter() {
+    // the blocks reference nothing of ours, but don't leave work running behind us
+    for (auto& pending : m_pending) {
+        pending.wait();
+    }
+}
+
+bool binary::ParallelGzipWriter::append(const uint8_t* data, size_t size) {
+    if (!m_ok || m_finished) {
+        return false;
+    }
+
+    // the checksum runs here while the workers compress
+    m_crc = mz_crc32(m_crc, data, size);
+    m_size += size;
+
+    while (size > 0) {
+        const size_t take = std::min(size, m_block_size - m_block.size());
+        m_block.insert(m_block.end(), data, data + take);
+        data += take;
+        size -= take;
+
+        if (m_block.size() == m_block_size && !submit(false)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool binary::ParallelGzipWriter::finish() {
+    if (!m_ok || m_finished) {
+        return false;
+    }
+
+    m_finished = true;
+
+    // the final block can be empty, it still has to close the stream
+    if (!submit(true)) {
+        return false;
+    }
+
+    while (!m_pending.empty()) {
+        if (!write_next()) {
+            return false;
+        }
+    }
+
+    uint8_t footer[8];
+    const mz_ulong isize = static_cast<mz_ulong>(m_size & 0xFFFFFFFFu);
+
+    for (int i = 0; i < 4; i++) {
+        footer[i] = static_cast<uint8_t>((m_crc >> (i * 8)) & 0xFF);
+        footer[i + 4] = static_cast<uint8_t>((isize >> (i * 8)) & 0xFF);
+    }
+
+    m_output.write(reinterpret_cast<const char*>(footer), sizeof(footer));
+    return m_output.good();
+}
+
+bool binary::ParallelGzipWriter::submit(bool last) {
+    m_pending.push_back(g_thread_pool.enqueue(
+        [block = std::move(m_block), level = m_level, last]() { return deflate_block(block, level, last); }
+    ));
+
+    m_block = {};
+    m_block.reserve(m_block_size);
+
+    // keeps memory at max_in_flight blocks, input and output
+    while (m_pending.size() > m_max_in_flight) {
+        if (!write_next()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool binary::ParallelGzipWriter::write_next() {
+    std::vector<uint8_t> compressed;
+
+    try {
+        compressed = m_pending.front().get();
+    } catch (const std::exception&) {
+        m_pending.pop_front();
+        m_ok = false;
+        return false;
+    }
+
+    m_pending.pop_front();
+    m_output.write(reinterpret_cast<const char*>(compressed.data()), static_cast<std::streamsize>(compressed.size()));
+
+    if (!m_output.good()) {
+        m_ok = false;
+        return false;
+    }
+
+    return true;
+}
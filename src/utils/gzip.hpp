@@ -1,7 +1,14 @@
 #pragma once
 
+#include "binary.hpp"
+
 #include <cstdint>
+#include <deque>
+#include <future>
+#include <istream>
 #include <miniz.h>
+#include <ostream>
+#include <stdexcept>
 #include <vector>
 
 namespace binary {
@@ -230,4 +237,327 @@ namespace binary {
         output.swap(temp_output);
         return true;
     }
+
+    // incremental gzip member, for data that arrives in pieces (downloads, streamed writes)
+    class GzipWriter {
+    public:
+        // writes the member to output as it's compressed instead of keeping it,
+        // finish it with finish()
+        explicit GzipWriter(std::ostream& output, int level = MZ_DEFAULT_LEVEL) : GzipWriter(level) {
+            m_sink = &output;
+        }
+
+        explicit GzipWriter(int level = MZ_DEFAULT_LEVEL) {
+            m_ok = mz_deflateInit2(&m_stream, level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 8, MZ_DEFAULT_STRATEGY) ==
+                   MZ_OK;
+
+            // same header as gzip_compress
+            const uint8_t header[10] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+            m_output.assign(std::begin(header), std::end(header));
+        }
+
+        ~GzipWriter() {
+            mz_deflateEnd(&m_stream);
+        }
+
+        GzipWriter(const GzipWriter&) = delete;
+        GzipWriter& operator=(const GzipWriter&) = delete;
+
+        bool append(const uint8_t* data, size_t size) {
+            if (!m_ok || m_finished) {
+                return false;
+            }
+
+            m_crc = mz_crc32(m_crc, data, size);
+            m_size += size;
+
+            m_stream.next_in = const_cast<unsigned char*>(data);
+            m_stream.avail_in = static_cast<mz_uint32>(size);
+            return pump(MZ_NO_FLUSH);
+        }
+
+        // writes the footer and hands over the compressed member
+        bool finish(std::vector<uint8_t>& output) {
+            if (m_sink != nullptr || !finish_member()) {
+                return false;
+            }
+
+            output.swap(m_output);
+            return true;
+        }
+
+        // writes the footer to the output stream
+        bool finish() {
+            return m_sink != nullptr && finish_member() && spill();
+        }
+
+    private:
+        bool finish_member() {
+            if (!m_ok || m_finished) {
+                return false;
+            }
+
+            m_finished = true;
+            m_stream.next_in = nullptr;
+            m_stream.avail_in = 0;
+
+            if (!pump(MZ_FINISH)) {
+                return false;
+            }
+
+            const mz_ulong isize = static_cast<mz_ulong>(m_size & 0xFFFFFFFFu);
+            for (int shift = 0; shift < 32; shift += 8) {
+                m_output.push_back(static_cast<uint8_t>((m_crc >> shift) & 0xFF));
+            }
+            for (int shift = 0; shift < 32; shift += 8) {
+                m_output.push_back(static_cast<uint8_t>((isize >> shift) & 0xFF));
+            }
+
+            return true;
+        }
+
+        bool spill() {
+            if (m_sink == nullptr || m_output.empty()) {
+                return true;
+            }
+
+            m_sink->write(
+                reinterpret_cast<const char*>(m_output.data()), static_cast<std::streamsize>(m_output.size())
+            );
+            m_output.clear();
+
+            if (!m_sink->good()) {
+                m_ok = false;
+                return false;
+            }
+
+            return true;
+        }
+
+        bool pump(int flush) {
+            const size_t chunk_size = 65536;
+            int status = MZ_OK;
+
+            do {
+                const size_t start = m_output.size();
+                m_output.resize(start + chunk_size);
+                m_stream.next_out = m_output.data() + start;
+                m_stream.avail_out = static_cast<mz_uint32>(chunk_size);
+
+                status = mz_deflate(&m_stream, flush);
+                m_output.resize(start + (chunk_size - m_stream.avail_out));
+
+                if (status != MZ_OK && status != MZ_STREAM_END && status != MZ_BUF_ERROR) {
+                    m_ok = false;
+                    return false;
+                }
+
+                if (!spill()) {
+                    return false;
+                }
+            } while (m_stream.avail_in > 0 || (flush == MZ_FINISH && status != MZ_STREAM_END));
+
+            return true;
+        }
+
+        mz_stream m_stream{};
+        std::vector<uint8_t> m_output;
+        std::ostream* m_sink = nullptr;
+        mz_ulong m_crc = MZ_CRC32_INIT;
+        uint64_t m_size = 0;
+        bool m_ok = false;
+        bool m_finished = false;
+    };
+
+    // one gzip member compressed in blocks on g_thread_pool, pigz style. each block is
+    // its own raw deflate stream ended with a sync flush so they can be glued back
+    // together in order, only the last one is final. the result is a regular single
+    // member any inflater reads. miniz can't prime a block with the tail of the previous
+    // one, so matches never cross a block boundary (slightly bigger output than GzipWriter).
+    // blocks until the work is done, don't use it from a pool task
+    class ParallelGzipWriter {
+    public:
+        ParallelGzipWriter(
+            std::ostream& output, int level = MZ_DEFAULT_LEVEL, size_t block_size = 1024 * 1024,
+            size_t max_in_flight = 8
+        );
+        ~ParallelGzipWriter();
+
+        ParallelGzipWriter(const ParallelGzipWriter&) = delete;
+        ParallelGzipWriter& operator=(const ParallelGzipWriter&) = delete;
+
+        bool append(const uint8_t* data, size_t size);
+        // compresses what's left and writes the footer
+        bool finish();
+
+    private:
+        bool submit(bool last);
+        bool write_next();
+
+        std::ostream& m_output;
+        int m_level;
+        size_t m_block_size;
+        size_t m_max_in_flight;
+        std::vector<uint8_t> m_block;
+        std::deque<std::future<std::vector<uint8_t>>> m_pending; // oldest first
+        mz_ulong m_crc = MZ_CRC32_INIT;
+        uint64_t m_size = 0;
+        bool m_ok = true;
+        bool m_finished = false;
+    };
+
+    // inflates gzip members (one or more, back to back) out of a stream while a cursor
+    // reads, so memory stays at one input chunk plus the cursor window
+    class GzipSource : public BinarySource {
+    public:
+        explicit GzipSource(std::istream& input, size_t chunk_size = 64 * 1024) : m_input(input) {
+            m_chunk.resize(chunk_size);
+        }
+
+        ~GzipSource() override {
+            if (m_inflating) {
+                mz_inflateEnd(&m_stream);
+            }
+        }
+
+    protected:
+        size_t read(uint8_t* out, size_t size) override {
+            size_t produced = 0;
+
+            while (produced < size) {
+                if (!m_inflating) {
+                    // members end on a byte boundary, nothing left means a clean end
+                    if (m_avail == 0 && !refill()) {
+                        break;
+                    }
+                    begin_member();
+                }
+
+                if (m_avail == 0 && !refill()) {
+                    throw std::runtime_error("gzip stream truncated");
+                }
+
+                m_stream.next_in = const_cast<unsigned char*>(m_next);
+                m_stream.avail_in = static_cast<mz_uint32>(m_avail);
+                m_stream.next_out = out + produced;
+                m_stream.avail_out = static_cast<mz_uint32>(size - produced);
+
+                const int status = mz_inflate(&m_stream, MZ_NO_FLUSH);
+                const size_t inflated = size - produced - m_stream.avail_out;
+
+                m_next = m_stream.next_in;
+                m_avail = m_stream.avail_in;
+                m_crc = mz_crc32(m_crc, out + produced, inflated);
+                m_size += inflated;
+                produced += inflated;
+
+                if (status == MZ_STREAM_END) {
+                    end_member();
+                } else if (status != MZ_OK && status != MZ_BUF_ERROR) {
+                    throw std::runtime_error("corrupted gzip data");
+                }
+            }
+
+            return produced;
+        }
+
+    private:
+        bool refill() {
+            m_input.read(reinterpret_cast<char*>(m_chunk.data()), static_cast<std::streamsize>(m_chunk.size()));
+            m_next = m_chunk.data();
+            m_avail = static_cast<size_t>(m_input.gcount());
+            return m_avail > 0;
+        }
+
+        uint8_t take() {
+            if (m_avail == 0 && !refill()) {
+                throw std::runtime_error("gzip stream truncated");
+            }
+            m_avail--;
+            return *m_next++;
+        }
+
+        // same checks as gzip_decompress
+        void begin_member() {
+            std::vector<uint8_t> header(10);
+
+            for (auto& byte : header) {
+                byte = take();
+            }
+
+            // ID1=0x1F, ID2=0x8B, CM=0x08 (deflate), reserved flag bits zero
+            if (header[0] != 0x1F || header[1] != 0x8B || header[2] != 0x08 || (header[3] & 0xE0) != 0) {
+                throw std::runtime_error("invalid gzip header");
+            }
+
+            const uint8_t flags = header[3];
+
+            if (flags & 0x04) {
+                // FEXTRA: 2 byte length followed by extra data
+                header.push_back(take());
+                header.push_back(take());
+                const uint16_t xlen = static_cast<uint16_t>(header[header.size() - 2] | (header.back() << 8));
+                for (uint16_t i = 0; i < xlen; i++) {
+                    header.push_back(take());
+                }
+            }
+
+            // FNAME, FCOMMENT: null terminated
+            for (const uint8_t flag : {uint8_t(0x08), uint8_t(0x10)}) {
+                if (flags & flag) {
+                    do {
+                        header.push_back(take());
+                    } while (header.back() != 0x00);
+                }
+            }
+
+            if (flags & 0x02) {
+                // FHCRC: low 16 bits of the header crc32
+                const mz_ulong header_crc = mz_crc32(MZ_CRC32_INIT, header.data(), header.size());
+                const uint8_t low = take();
+                const uint16_t expected = static_cast<uint16_t>(low | (take() << 8));
+                if ((header_crc & 0xFFFFu) != expected) {
+                    throw std::runtime_error("invalid gzip header crc");
+                }
+            }
+
+            m_stream = {};
+
+            if (mz_inflateInit2(&m_stream, -MZ_DEFAULT_WINDOW_BITS) != MZ_OK) {
+                throw std::runtime_error("failed to start inflating");
+            }
+
+            m_inflating = true;
+            m_crc = MZ_CRC32_INIT;
+            m_size = 0;
+        }
+
+        void end_member() {
+            mz_inflateEnd(&m_stream);
+            m_inflating = false;
+
+            mz_ulong expected_crc = 0;
+            mz_ulong expected_size = 0;
+
+            for (int shift = 0; shift < 32; shift += 8) {
+                expected_crc |= static_cast<mz_ulong>(take()) << shift;
+            }
+            for (int shift = 0; shift < 32; shift += 8) {
+                expected_size |= static_cast<mz_ulong>(take()) << shift;
+            }
+
+            if (m_crc != expected_crc || (m_size & 0xFFFFFFFFu) != expected_size) {
+                throw std::runtime_error("gzip checksum mismatch");
+            }
+        }
+
+        std::istream& m_input;
+        std::vector<uint8_t> m_chunk;
+        const uint8_t* m_next = nullptr;
+        size_t m_avail = 0;
+        mz_stream m_stream{};
+        mz_ulong m_crc = MZ_CRC32_INIT;
+        uint64_t m_size = 0;
+        bool m_inflating = false;
+    };
 } // namespace binary
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace binary {
+    // incremental md5, osu! keys beatmaps by the md5 of the .osu file
+    class Md5 {
+    public:
+        void update(const void* data, size_t size) {
+            const auto* bytes = static_cast<const uint8_t*>(data);
+            size_t used = static_cast<size_t>(m_length % 64);
+            m_length += size;
+
+            if (used > 0) {
+                const size_t take = std::min(size, 64 - used);
+                std::memcpy(m_block.data() + used, bytes, take);
+                bytes += take;
+                size -= take;
+                used += take;
+
+                if (used < 64) {
+                    return;
+                }
+
+                transform(m_block.data());
+            }
+
+            while (size >= 64) {
+                transform(bytes);
+                bytes += 64;
+                size -= 64;
+            }
+
+            std::memcpy(m_block.data(), bytes, size);
+        }
+
+        void update(std::string_view data) {
+            update(data.data(), data.size());
+        }
+
+        // lowercase hex digest, the object shouldn't be updated afterwards
+        std::string hex() {
+            const uint64_t bits = m_length * 8;
+            const uint8_t padding = 0x80;
+            const uint8_t zero = 0x00;
+
+            update(&padding, 1);
+            while (m_length % 64 != 56) {
+                update(&zero, 1);
+            }
+
+            uint8_t length[8];
+            for (int i = 0; i < 8; i++) {
+                length[i] = static_cast<uint8_t>(bits >> (8 * i));
+            }
+            update(length, 8);
+
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string result;
+            result.reserve(32);
+
+            for (const uint32_t word : m_state) {
+                for (int i = 0; i < 4; i++) {
+                    const auto byte = static_cast<uint8_t>(word >> (8 * i));
+                    result.push_back(digits[byte >> 4]);
+                    result.push_back(digits[byte & 0x0F]);
+                }
+            }
+
+            return result;
+        }
+
+    private:
+        static uint32_t rotate(uint32_t value, int count) {
+            return (value << count) | (value >> (32 - count));
+        }
+
+        void transform(const uint8_t* block) {
+            static constexpr uint32_t constants[64] = {
+                0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+                0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+                0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+                0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+                0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+                0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+                0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+                0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+            };
+            static constexpr int shifts[64] = {
+                7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+                5, 9,  14, 20, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 6, 10, 15, 21, 6, 10, 15, 21,
+                6, 10, 15, 21, 6, 10, 15, 21,
+            };
+
+            uint32_t words[16];
+            for (int i = 0; i < 16; i++) {
+                words[i] = static_cast<uint32_t>(block[i * 4]) | (static_cast<uint32_t>(block[i * 4 + 1]) << 8) |
+                           (static_cast<uint32_t>(block[i * 4 + 2]) << 16) |
+                           (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+            }
+
+            uint32_t a = m_state[0];
+            uint32_t b = m_state[1];
+            uint32_t c = m_state[2];
+            uint32_t d = m_state[3];
+
+            for (int i = 0; i < 64; i++) {
+                uint32_t f = 0;
+                int g = 0;
+
+                if (i < 16) {
+                    f = (b & c) | (~b & d);
+                    g = i;
+                } else if (i < 32) {
+                    f = (d & b) | (~d & c);
+                    g = (5 * i + 1) % 16;
+                } else if (i < 48) {
+                    f = b ^ c ^ d;
+                    g = (3 * i + 5) % 16;
+                } else {
+                    f = c ^ (b | ~d);
+                    g = (7 * i) % 16;
+                }
+
+                const uint32_t next = d;
+                d = c;
+                c = b;
+                b = b + rotate(a + f + constants[i] + words[g], shifts[i]);
+                a = next;
+            }
+
+            m_state[0] += a;
+            m_state[1] += b;
+            m_state[2] += c;
+            m_state[3] += d;
+        }
+
+        std::array<uint32_t, 4> m_state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+        std::array<uint8_t, 64> m_block{};
+        uint64_t m_length = 0;
+    };
+
+    inline std::string md5_hex(std::string_view data) {
+        Md5 md5;
+        md5.update(data);
+        return md5.hex();
+    }
+} // namespace binary
@@ -3,35 +3,34 @@
 #include <algorithm>
 
 void ThreadPool::initialize() {
-    if (!workers.empty()) {
-        return;
-    }
+    // callers on different threads may both see an empty pool, only one of them starts it
+    std::call_once(started, [this]() {
+        const auto thread_count = static_cast<int>(std::thread::hardware_concurrency());
+        const auto count = std::clamp(thread_count, 1, 4);
 
-    const auto thread_count = static_cast<int>(std::thread::hardware_concurrency());
-    const auto count = std::clamp(thread_count, 1, 4);
+        for (int i = 0; i < count; i++) {
+            workers.emplace_back([this]() {
+                while (true) {
+                    std::unique_ptr<TaskBase> task;
 
-    for (int i = 0; i < count; i++) {
-        workers.emplace_back([this]() {
-            while (true) {
-                std::unique_ptr<TaskBase> task;
+                    {
+                        std::unique_lock<std::mutex> lock(queue_mutex);
 
-                {
-                    std::unique_lock<std::mutex> lock(queue_mutex);
+                        cv.wait(lock, [this] { return stop || !tasks.empty(); });
 
-                    cv.wait(lock, [this] { return stop || !tasks.empty(); });
+                        if (stop && tasks.empty()) {
+                            break;
+                        }
 
-                    if (stop && tasks.empty()) {
-                        break;
+                        task = std::move(tasks.front());
+                        tasks.pop();
                     }
 
-                    task = std::move(tasks.front());
-                    tasks.pop();
+                    task->execute();
                 }
-
-                task->execute();
-            }
-        });
-    }
+            });
+        }
+    });
 }
 
 ThreadPool::~ThreadPool() {
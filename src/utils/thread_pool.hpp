@@ -62,6 +62,7 @@ public:
 
 private:
     bool stop = false;
+    std::once_flag started;
     std::vector<std::thread> workers;
     std::queue<std::unique_ptr<TaskBase>> tasks;
     std::mutex queue_mutex;
@@ -1,17 +1,27 @@
+#include "parser/beatmap/batch_edit.hpp"
 #include "parser/beatmap/beatmap.hpp"
+#include "utils/md5.hpp"
 #include "helper.hpp"
 
 #include <catch2/catch_test_macros.hpp>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+static std::string brightside_path() {
+    return (test_helper::osu_root() / "Songs/2134701 The Killers - Mr Brightside" /
+            "The Killers - Mr. Brightside (mindmaster107) [HD1].osu")
+        .string();
+}
 
 TEST_CASE("beatmap parser read", "[parsers][beatmap]") {
     ParsedBeatmap beatmap;
-    beatmap_parser::data = &beatmap;
-
-    const auto path = (test_helper::osu_root() / "Songs/2134701 The Killers - Mr Brightside" /
-                       "The Killers - Mr. Brightside (mindmaster107) [HD1].osu")
-                          .string();
+    BeatmapParser parser;
 
-    REQUIRE(beatmap_parser::parse(path));
+    REQUIRE(parser.parse(brightside_path(), beatmap));
     REQUIRE(beatmap.version == 14);
     REQUIRE(beatmap.metadata.title == "Mr. Brightside");
     REQUIRE(beatmap.metadata.artist == "The Killers");
@@ -25,24 +35,341 @@ TEST_CASE("beatmap parser read", "[parsers][beatmap]") {
 
 TEST_CASE("beatmap parser preserves the important map fields", "[parsers][beatmap]") {
     ParsedBeatmap original;
-    beatmap_parser::data = &original;
+    BeatmapParser parser;
 
-    const auto input_path = (test_helper::osu_root() / "Songs/2134701 The Killers - Mr Brightside" /
-                             "The Killers - Mr. Brightside (mindmaster107) [HD1].osu")
-                                .string();
+    REQUIRE(parser.parse(brightside_path(), original));
 
-    REQUIRE(beatmap_parser::parse(input_path));
-
-    beatmap_parser::location = (test_helper::temp_root() / "beatmap-roundtrip.osu").string();
-    std::filesystem::remove(beatmap_parser::location);
-    REQUIRE(beatmap_parser::write());
+    const auto location = (test_helper::temp_root() / "beatmap-roundtrip.osu").string();
+    std::filesystem::remove(location);
+    REQUIRE(parser.write(original, location));
 
     ParsedBeatmap roundtrip;
-    beatmap_parser::data = &roundtrip;
-    REQUIRE(beatmap_parser::parse(beatmap_parser::location));
+    REQUIRE(parser.parse(location, roundtrip));
     REQUIRE(roundtrip.metadata.title == original.metadata.title);
     REQUIRE(roundtrip.metadata.artist == original.metadata.artist);
     REQUIRE(roundtrip.metadata.version == original.metadata.version);
     REQUIRE(roundtrip.hit_objects.size() == original.hit_objects.size());
     REQUIRE(roundtrip.timing_points.size() == original.timing_points.size());
 }
+
+TEST_CASE("beatmap parsers run concurrently", "[parsers][beatmap]") {
+    std::ifstream file(brightside_path(), std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    REQUIRE_FALSE(content.empty());
+
+    constexpr int thread_count = 8;
+    std::vector<int> parsed(thread_count, 0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < thread_count; i++) {
+        threads.emplace_back([&content, &parsed, i]() {
+            BeatmapParser parser;
+
+            // the same instance is reused for every file on this thread
+            for (int round = 0; round < 10; round++) {
+                ParsedBeatmap beatmap;
+                if (parser.parse_content(content, beatmap) && beatmap.hit_objects.size() == 905 &&
+                    beatmap.metadata.version == "HD1") {
+                    parsed[i]++;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const int count : parsed) {
+        REQUIRE(count == 10);
+    }
+}
+
+TEST_CASE("beatmap parser splits sections in any order", "[parsers][beatmap]") {
+    // crlf, comments, sections out of order, an unknown section and a repeated one
+    const std::string content = "osu file format v12\r\n"
+                                "[HitObjects]\r\n"
+                                "256,192,1000,1,0,0:0:0:0:\r\n"
+                                "// comment\r\n"
+                                "256,192,2000,1,0,0:0:0:0:\r\n"
+                                "[Variables]\r\n"
+                                "$x=1\r\n"
+                                "[Metadata]\r\n"
+                                "Title:First\r\n"
+                                "  Version:Easy  \r\n"
+                                "[Metadata]\r\n"
+                                "Title:Second\r\n"
+                                "[General]\r\n"
+                                "Mode: 3";
+
+    ParsedBeatmap beatmap;
+    BeatmapParser parser;
+
+    REQUIRE(parser.parse_content(content, beatmap));
+    REQUIRE(beatmap.version == 12);
+    REQUIRE(beatmap.hit_objects.size() == 2);
+    REQUIRE(beatmap.metadata.title == "First");
+    REQUIRE(beatmap.metadata.version == "Easy");
+    REQUIRE(beatmap.general.mode == 3);
+    REQUIRE(beatmap.timing_points.empty());
+}
+
+TEST_CASE("beatmap parser header mode skips the map data", "[parsers][beatmap]") {
+    std::string content = "osu file format v14\n"
+                          "[General]\n"
+                          "AudioFilename: audio.mp3\n"
+                          "[Metadata]\n"
+                          "Title:Header\n"
+                          "Version:Hard\n"
+                          "[Difficulty]\n"
+                          "ApproachRate:9\n"
+                          "[Events]\n"
+                          "0,0,\"bg.jpg\",0,0\n";
+
+    // a storyboard big enough to push the end of [Events] past the first read
+    for (int i = 0; i < 2000; i++) {
+        content += " F,0," + std::to_string(i) + "," + std::to_string(i + 100) + ",0,1\n";
+    }
+
+    content += "2,1000,2000\n"
+               "[TimingPoints]\n"
+               "0,500,4,2,1,60,1,0\n"
+               "[HitObjects]\n";
+
+    for (int i = 0; i < 1000; i++) {
+        content += "256,192," + std::to_string(i * 100) + ",1,0,0:0:0:0:\n";
+    }
+
+    const auto location = (test_helper::temp_root() / "beatmap-header.osu").string();
+    std::filesystem::create_directories(test_helper::temp_root());
+    std::ofstream(location, std::ios::binary) << content;
+
+    BeatmapParser parser;
+    ParsedBeatmap from_file;
+    ParsedBeatmap from_memory;
+
+    REQUIRE(parser.parse_header(location, from_file));
+    REQUIRE(parser.parse_header_content(content, from_memory));
+
+    for (const auto* beatmap : {&from_file, &from_memory}) {
+        REQUIRE(beatmap->metadata.title == "Header");
+        REQUIRE(beatmap->metadata.version == "Hard");
+        REQUIRE(beatmap->difficulty.approach_rate == 9.0);
+        REQUIRE(beatmap->background.has_value());
+        REQUIRE(beatmap->breaks.size() == 1);
+        REQUIRE(beatmap->timing_points.empty());
+        REQUIRE(beatmap->hit_objects.empty());
+    }
+
+    ParsedBeatmap full;
+    REQUIRE(parser.parse(location, full));
+    REQUIRE(full.hit_objects.size() == 1000);
+}
+
+TEST_CASE("beatmap parser keeps slider data in shared arrays", "[parsers][beatmap]") {
+    const std::string content = "osu file format v14\n"
+                                "[HitObjects]\n"
+                                "100,100,1000,2,0,B|1:2|3:4,2,120.5,2|0|8,0:0|1:2|0:0,0:0:0:50:soft.wav\n"
+                                "256,192,2000,1,0,0:0:0:0:\n"
+                                "200,200,3000,6,0,P|5:6|7:8|9:10,1,70\n";
+
+    ParsedBeatmap beatmap;
+    BeatmapParser parser;
+    REQUIRE(parser.parse_content(content, beatmap));
+
+    const auto& objects = beatmap.hit_objects;
+    REQUIRE(objects.size() == 3);
+    REQUIRE(objects.curve_points.size() == 5);
+
+    const auto first = objects.curve(objects[0]);
+    REQUIRE(first.size() == 2);
+    REQUIRE(first[1] == std::pair{3, 4});
+    REQUIRE(objects.edge_sounds_of(objects[0])[2] == 8);
+    REQUIRE(objects.edge_sets_of(objects[0])[1] == std::pair{1, 2});
+    REQUIRE(objects.sample_file(objects[0].sample) == "soft.wav");
+
+    REQUIRE(objects.curve(objects[1]).empty());
+    REQUIRE(objects.sample_file(objects[1].sample).empty());
+
+    // missing edge lists default to one entry per slide end
+    REQUIRE(objects.curve(objects[2]).front() == std::pair{5, 6});
+    REQUIRE(objects.edge_sounds_of(objects[2]).size() == 2);
+    REQUIRE(objects.edge_sets_of(objects[2]).size() == 2);
+
+    // a reused beatmap starts from empty arrays
+    REQUIRE(parser.parse_content("osu file format v14\n[HitObjects]\n256,192,1,1,0\n", beatmap));
+    REQUIRE(beatmap.hit_objects.size() == 1);
+    REQUIRE(beatmap.hit_objects.curve_points.empty());
+}
+
+TEST_CASE("beatmap writer formats doubles like iostreams", "[parsers][beatmap]") {
+    // what the writer used to do, .osu files rewritten by older versions must not change
+    const auto reference = [](double value) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(15) << value;
+        std::string out = ss.str();
+        if (out.find('.') != std::string::npos) {
+            while (!out.empty() && out.back() == '0') {
+                out.pop_back();
+            }
+            if (!out.empty() && out.back() == '.') {
+                out.pop_back();
+            }
+        }
+        return out;
+    };
+
+    for (const double value : {0.0, -0.0, 1.0, 1.4, 0.7, 1.0 / 3.0, 333.333333333333, -66.6666666666667, 1e20, 1e-20,
+                               5e-16, 123456789.123456789, -2.5, 1.7976931348623157e308}) {
+        REQUIRE(BeatmapWriter::format_double(value) == reference(value));
+    }
+
+    BeatmapWriter writer;
+    writer.put_int(-12).put(',').put_double(0.25).put(',').put_ints(std::vector<int>{1, 2, 3}, '|').end_line();
+    writer.key_value("Mode", 3);
+    REQUIRE(writer.str() == "-12,0.25,1|2|3\nMode:3\n");
+}
+
+TEST_CASE("batch edit rewrites matching maps and reports new md5s", "[parsers][beatmap]") {
+    const auto directory = test_helper::temp_root() / "batch-edit";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    std::vector<std::filesystem::path> files;
+    OsuLegacyDatabase database;
+
+    for (int i = 0; i < 24; i++) {
+        const std::string artist = i % 3 == 0 ? "Kenji Ninuma" : "Other";
+        const std::string content = "osu file format v14\n\n"
+                                    "[General]\nAudioFilename: audio.mp3\n\n"
+                                    "[Metadata]\nTitle:Map " +
+                                    std::to_string(i) + "\nArtist:" + artist +
+                                    "\nVersion:Normal\nTags:old\n\n"
+                                    "[Events]\n0,0,\"bg.jpg\",0,0\n\n"
+                                    "[HitObjects]\n256,192,1000,1,0,0:0:0:0:\n";
+
+        files.push_back(directory / ("map" + std::to_string(i) + ".osu"));
+        std::ofstream(files.back(), std::ios::binary) << content;
+
+        LegacyBeatmap entry;
+        entry.md5 = binary::md5_hex(content);
+        database.beatmaps.push_back(entry);
+    }
+
+    const auto result = beatmap_batch::edit(
+        files, [](const ParsedBeatmap& beatmap) { return beatmap.metadata.artist == "Kenji Ninuma"; },
+        [](ParsedBeatmap& beatmap) { beatmap.metadata.tags = "fixed"; }, {.max_in_flight = 3}
+    );
+
+    REQUIRE(result.matched == 8);
+    REQUIRE(result.failed == 0);
+    REQUIRE(result.changes.size() == 8);
+
+    BeatmapParser parser;
+
+    for (size_t i = 0; i < result.changes.size(); i++) {
+        const auto& change = result.changes[i];
+        REQUIRE(change.path == files[i * 3]);
+
+        std::ifstream file(change.path, std::ios::binary);
+        const std::string written((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        REQUIRE(binary::md5_hex(written) == change.new_md5);
+
+        ParsedBeatmap beatmap;
+        REQUIRE(parser.parse_content(written, beatmap));
+        REQUIRE(beatmap.metadata.tags == "fixed");
+        REQUIRE(beatmap.hit_objects.size() == 1);
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        REQUIRE(entry.path().extension() == ".osu");
+    }
+
+    REQUIRE(beatmap_batch::apply(database, result) == 8);
+    REQUIRE(database.beatmaps[0].md5 == result.changes[0].new_md5);
+    REQUIRE(database.beatmaps[1].md5 != result.changes[0].new_md5);
+
+    // a second run has nothing left to change
+    const auto again = beatmap_batch::edit(
+        files, [](const ParsedBeatmap& beatmap) { return beatmap.metadata.artist == "Kenji Ninuma"; },
+        [](ParsedBeatmap& beatmap) { beatmap.metadata.tags = "fixed"; }
+    );
+    REQUIRE(again.matched == 8);
+    REQUIRE(again.changes.empty());
+}
+
+TEST_CASE("batch edit only touches the lines the transform changed", "[parsers][beatmap]") {
+    const auto directory = test_helper::temp_root() / "batch-edit-storyboard";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    const std::string content = "osu file format v14\r\n\r\n"
+                                "[General]\r\nAudioFilename:audio.mp3\r\nCustomKey: kept\r\n\r\n"
+                                "[Metadata]\r\nTitle:Map\r\nArtist:Someone\r\nVersion:Hard\r\nTags:old\r\n\r\n"
+                                "[Variables]\r\n$pos=320,240\r\n\r\n"
+                                "[Events]\r\n//Background and Video events\r\n0,0,\"bg.jpg\",0,0\r\n"
+                                "//Storyboard Layer 0 (Background)\r\nSprite,Background,Centre,\"sb/bg.png\",$pos\r\n"
+                                " F,0,1000,2000,0,1\r\n_M,0,1000,2000,320,240,320,200\r\n\r\n"
+                                "[HitObjects]\r\n256,192,1000,1,0,0:0:0:0:\r\n";
+
+    const auto path = directory / "storyboard.osu";
+    std::ofstream(path, std::ios::binary) << content;
+
+    const auto result = beatmap_batch::edit({path}, nullptr, [](ParsedBeatmap& beatmap) {
+        beatmap.metadata.tags = "fixed";
+        beatmap.metadata.source = "added";
+    });
+
+    REQUIRE(result.failed == 0);
+    REQUIRE(result.changes.size() == 1);
+
+    std::ifstream file(path, std::ios::binary);
+    const std::string written((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::string expected = content;
+    expected.replace(expected.find("Tags:old"), 8, "Tags:fixed");
+    expected.insert(expected.find("\r\n\r\n[Variables]") + 2, "Source:added\r\n");
+    REQUIRE(written == expected);
+    REQUIRE(result.changes[0].new_md5 == binary::md5_hex(written));
+
+    // a map list change keeps the storyboard around the background line
+    const auto moved = beatmap_batch::edit({path}, nullptr, [](ParsedBeatmap& beatmap) {
+        beatmap.background->filename = "other.jpg";
+    });
+    REQUIRE(moved.changes.size() == 1);
+
+    std::ifstream moved_file(path, std::ios::binary);
+    const std::string moved_text((std::istreambuf_iterator<char>(moved_file)), std::istreambuf_iterator<char>());
+    std::string moved_expected = expected;
+    moved_expected.replace(moved_expected.find("bg.jpg"), 6, "other.jpg");
+    REQUIRE(moved_text == moved_expected);
+}
+
+TEST_CASE("batch edit counts a throwing transform as a failed file", "[parsers][beatmap]") {
+    const auto directory = test_helper::temp_root() / "batch-edit-throw";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    std::vector<std::filesystem::path> files;
+
+    for (int i = 0; i < 6; i++) {
+        files.push_back(directory / ("map" + std::to_string(i) + ".osu"));
+        std::ofstream(files.back(), std::ios::binary)
+            << "osu file format v14\n\n[Metadata]\nTitle:Map " + std::to_string(i) + "\nVersion:Normal\n";
+    }
+
+    const auto result = beatmap_batch::edit(
+        files, nullptr,
+        [](ParsedBeatmap& beatmap) {
+            if (beatmap.metadata.title == "Map 2") {
+                throw std::runtime_error("bad map");
+            }
+            beatmap.metadata.version = "Edited";
+        },
+        {.max_in_flight = 2}
+    );
+
+    REQUIRE(result.matched == 6);
+    REQUIRE(result.failed == 1);
+    REQUIRE(result.changes.size() == 5);
+}
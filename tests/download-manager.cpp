@@ -0,0 +1,299 @@
+#include "../src/api/download_manager.hpp"
+#include "../src/api/mirror_selector.hpp"
+#include "helper.hpp"
+#include "local-server.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// stand-in for an .osz, the content doesn't matter, only that every byte is checked
+static std::string fake_osz(const std::string& key, size_t size) {
+    std::string data = "PK\x03\x04" + key;
+    data.reserve(size);
+
+    for (size_t i = data.size(); i < size; i++) {
+        data.push_back(static_cast<char>((i * 31 + key.size()) & 0xFF));
+    }
+
+    return data;
+}
+
+// serves body with "range: bytes=N-" support
+static test_helper::HttpResponse range_response(const test_helper::HttpRequest& request, const std::string& body) {
+    test_helper::HttpResponse response;
+    response.headers = {{"Content-Type", "application/octet-stream"}, {"Accept-Ranges", "bytes"}};
+
+    const std::string range = request.header("range");
+
+    if (range.rfind("bytes=", 0) != 0) {
+        response.body = body;
+        return response;
+    }
+
+    const size_t start = std::stoul(range.substr(6));
+
+    if (start >= body.size()) {
+        response.status = 416;
+        response.headers.push_back({"Content-Range", "bytes */" + std::to_string(body.size())});
+        return response;
+    }
+
+    response.status = 206;
+    response.body = body.substr(start);
+    response.headers.push_back(
+        {"Content-Range",
+         "bytes " + std::to_string(start) + "-" + std::to_string(body.size() - 1) + "/" + std::to_string(body.size())}
+    );
+    return response;
+}
+
+static std::string key_from_path(const std::string& path) {
+    return path.substr(path.rfind('/') + 1);
+}
+
+TEST_CASE("download manager respects the concurrency limit", "[download]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest& request) {
+        auto response = range_response(request, fake_osz(key_from_path(request.path), 64 * 1024));
+        response.chunk_size = 8 * 1024;
+        response.chunk_delay = std::chrono::milliseconds(5);
+        return response;
+    });
+
+    const auto directory = test_helper::make_temp_directory("downloads", "concurrent");
+    DownloadManager manager(
+        {{.name = "local", .url_template = server.url() + "/d/{key}", .max_connections = 8}},
+        {.directory = directory, .max_concurrent = 3}
+    );
+
+    std::vector<std::shared_ptr<DownloadTask>> tasks;
+    for (int i = 0; i < 10; i++) {
+        tasks.push_back(manager.enqueue(std::to_string(1000 + i), std::to_string(1000 + i) + ".osz"));
+    }
+
+    manager.wait();
+
+    for (const auto& task : tasks) {
+        REQUIRE(task->state == DownloadState::COMPLETED);
+        REQUIRE(test_helper::read_file(task->destination) == fake_osz(task->key, 64 * 1024));
+        REQUIRE_FALSE(std::filesystem::exists(task->destination.string() + ".part"));
+    }
+
+    REQUIRE(server.peak_in_flight() <= 3);
+    REQUIRE(manager.counters().completed == 10);
+    REQUIRE(manager.counters().bytes == 10 * 64 * 1024);
+}
+
+TEST_CASE("download manager resumes partial files with range requests", "[download]") {
+    const std::string body = fake_osz("resume", 100 * 1024);
+    std::mutex mutex;
+    std::vector<std::string> ranges;
+
+    test_helper::LocalServer server([&](const test_helper::HttpRequest& request) {
+        {
+            std::scoped_lock lock(mutex);
+            ranges.push_back(request.header("range"));
+        }
+        return range_response(request, body);
+    });
+
+    const auto directory = test_helper::make_temp_directory("downloads", "resume");
+    {
+        std::ofstream part(directory / "resume.osz.part", std::ios::binary);
+        part.write(body.data(), 40 * 1024);
+    }
+
+    DownloadManager manager(
+        {{.name = "local", .url_template = server.url() + "/d/{key}", .max_connections = 2}},
+        {.directory = directory, .max_concurrent = 1}
+    );
+
+    const auto task = manager.enqueue("resume", "resume.osz");
+    manager.wait();
+
+    REQUIRE(task->state == DownloadState::COMPLETED);
+    REQUIRE(test_helper::read_file(directory / "resume.osz") == body);
+    REQUIRE(task->downloaded == body.size());
+    REQUIRE(manager.counters().bytes == 60 * 1024);
+
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges[0] == "bytes=40960-");
+}
+
+TEST_CASE("download manager keeps a part that already holds the whole file", "[download]") {
+    const std::string body = fake_osz("complete", 32 * 1024);
+
+    test_helper::LocalServer server([&](const test_helper::HttpRequest& request) {
+        return range_response(request, body);
+    });
+
+    const auto directory = test_helper::make_temp_directory("downloads", "complete");
+    {
+        std::ofstream part(directory / "complete.osz.part", std::ios::binary);
+        part.write(body.data(), static_cast<std::streamsize>(body.size()));
+    }
+
+    DownloadManager manager(
+        {{.name = "local", .url_template = server.url() + "/d/{key}", .max_connections = 2}},
+        {.directory = directory, .max_concurrent = 1}
+    );
+
+    const auto task = manager.enqueue("complete", "complete.osz");
+    manager.wait();
+
+    REQUIRE(task->state == DownloadState::COMPLETED);
+    REQUIRE(test_helper::read_file(directory / "complete.osz") == body);
+    REQUIRE_FALSE(std::filesystem::exists(directory / "complete.osz.part"));
+    REQUIRE(manager.counters().bytes == 0);
+}
+
+TEST_CASE("download manager falls back to the next mirror", "[download]") {
+    const std::string body = fake_osz("fallback", 16 * 1024);
+
+    test_helper::LocalServer missing([](const test_helper::HttpRequest&) {
+        test_helper::HttpResponse response;
+        response.status = 404;
+        response.body = "not found";
+        return response;
+    });
+
+    test_helper::LocalServer mirror([&](const test_helper::HttpRequest& request) {
+        return range_response(request, body);
+    });
+
+    const auto directory = test_helper::make_temp_directory("downloads", "fallback");
+    DownloadManager manager(
+        {
+            {.name = "missing", .url_template = missing.url() + "/d/{key}", .max_connections = 2},
+            {.name = "mirror", .url_template = mirror.url() + "/d/{key}", .max_connections = 2},
+        },
+        {.directory = directory, .max_concurrent = 2}
+    );
+
+    const auto task = manager.enqueue("fallback", "fallback.osz");
+    manager.wait();
+
+    REQUIRE(task->state == DownloadState::COMPLETED);
+    REQUIRE(task->mirror == "mirror");
+    REQUIRE(test_helper::read_file(directory / "fallback.osz") == body);
+    REQUIRE(missing.requests() == 1);
+    REQUIRE(mirror.requests() == 1);
+}
+
+TEST_CASE("download manager reports failures once every mirror was tried", "[download]") {
+    test_helper::LocalServer missing([](const test_helper::HttpRequest&) {
+        test_helper::HttpResponse response;
+        response.status = 404;
+        return response;
+    });
+
+    const auto directory = test_helper::make_temp_directory("downloads", "failed");
+    DownloadManager manager(
+        {{.name = "missing", .url_template = missing.url() + "/d/{key}", .max_connections = 1}},
+        {.directory = directory, .max_concurrent = 1}
+    );
+
+    const auto task = manager.enqueue("gone", "gone.osz");
+    manager.wait();
+
+    REQUIRE(task->state == DownloadState::FAILED);
+    REQUIRE_FALSE(task->error.empty());
+    REQUIRE(manager.counters().failed == 1);
+    REQUIRE_FALSE(std::filesystem::exists(directory / "gone.osz"));
+}
+
+TEST_CASE("mirror selector ranks mirrors by their measured speed", "[download][mirror]") {
+    MirrorSelector selector(3);
+
+    // nothing measured yet, configured order
+    REQUIRE(selector.rank() == std::vector<size_t>{0, 1, 2});
+
+    for (int i = 0; i < 5; i++) {
+        selector.record_first_byte(0, std::chrono::milliseconds(400));
+        selector.record_transfer(0, 1024 * 1024, std::chrono::milliseconds(1000));
+        selector.record_first_byte(1, std::chrono::milliseconds(40));
+        selector.record_transfer(1, 1024 * 1024, std::chrono::milliseconds(100));
+    }
+
+    // the unmeasured mirror goes first so it gets a sample, then the faster one
+    REQUIRE(selector.rank() == std::vector<size_t>{2, 1, 0});
+
+    // failures push it behind the fast mirror, the slow one still expects ~10s per map
+    selector.record_failure(2);
+    selector.record_failure(2);
+    REQUIRE(selector.rank() == std::vector<size_t>{1, 2, 0});
+    REQUIRE(selector.stats(1).throughput > selector.stats(0).throughput);
+}
+
+TEST_CASE("mirror selector hedges after a latency percentile", "[download][mirror]") {
+    MirrorSelector selector(1, {.default_hedge_delay = std::chrono::milliseconds(700)});
+
+    REQUIRE(selector.hedge_delay(0) == std::chrono::milliseconds(700));
+
+    for (int i = 1; i <= 10; i++) {
+        selector.record_first_byte(0, std::chrono::milliseconds(i * 10));
+    }
+
+    REQUIRE(selector.hedge_delay(0) == std::chrono::milliseconds(90));
+}
+
+TEST_CASE("download manager races a second mirror when the first one stalls", "[download][mirror]") {
+    const std::string body = fake_osz("race", 32 * 1024);
+    std::atomic<int> slow_requests = 0;
+
+    test_helper::LocalServer slow([&](const test_helper::HttpRequest& request) {
+        slow_requests++;
+        auto response = range_response(request, body);
+        response.delay = std::chrono::milliseconds(2000);
+        return response;
+    });
+
+    test_helper::LocalServer fast([&](const test_helper::HttpRequest& request) {
+        return range_response(request, body);
+    });
+
+    const auto directory = test_helper::make_temp_directory("downloads", "race");
+    DownloadManager manager(
+        {
+            {.name = "slow", .url_template = slow.url() + "/d/{key}", .max_connections = 2},
+            {.name = "fast", .url_template = fast.url() + "/d/{key}", .max_connections = 2},
+        },
+        {.directory = directory,
+         .max_concurrent = 1,
+         .selector = {.default_hedge_delay = std::chrono::milliseconds(100)}}
+    );
+
+    const auto started = std::chrono::steady_clock::now();
+    const auto task = manager.enqueue("race", "race.osz");
+
+    while (task->state != DownloadState::COMPLETED && task->state != DownloadState::FAILED &&
+           std::chrono::steady_clock::now() - started < std::chrono::seconds(5)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    manager.wait();
+
+    // the slow lane is cut off when the fast one wins, it doesn't hold the worker for its 2s delay
+    REQUIRE(std::chrono::steady_clock::now() - started < std::chrono::milliseconds(1500));
+
+    REQUIRE(task->state == DownloadState::COMPLETED);
+    REQUIRE(task->mirror == "fast");
+    REQUIRE(elapsed < std::chrono::milliseconds(1500));
+    REQUIRE(test_helper::read_file(directory / "race.osz") == body);
+
+    // the slow mirror lost, the next download starts on the fast one without racing
+    const auto second = manager.enqueue("race", "race-2.osz");
+    manager.wait();
+
+    REQUIRE(second->state == DownloadState::COMPLETED);
+    REQUIRE(second->mirror == "fast");
+    REQUIRE(slow_requests == 1);
+    REQUIRE(manager.mirror_stats(0).latency_ms > manager.mirror_stats(1).latency_ms);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
 
 namespace test_helper {
     inline std::filesystem::path data_root() {
@@ -18,4 +21,17 @@ namespace test_helper {
     inline std::filesystem::path temp_root() {
         return std::filesystem::current_path() / "temp";
     }
+
+    // an empty temp_root()/group/name, whatever the last run left there is removed
+    inline std::filesystem::path make_temp_directory(const std::string& group, const std::string& name) {
+        const auto directory = temp_root() / group / name;
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        return directory;
+    }
+
+    inline std::string read_file(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
 } // namespace test_helper
@@ -1,9 +1,13 @@
 #include "parser/legacy/legacy.hpp"
 #include "parser/legacy/legacy_collection.hpp"
+#include "utils/binary.hpp"
 #include "helper.hpp"
 
 #include <catch2/catch_test_macros.hpp>
 #include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 
 TEST_CASE("legacy parser read osu.db", "[parsers][legacy]") {
     OsuLegacyDatabase database;
@@ -39,6 +43,203 @@ TEST_CASE("legacy parser roundtrip preserves osu db payload", "[parsers][legacy]
     REQUIRE(roundtrip.beatmaps.back().md5 == original.beatmaps.back().md5);
 }
 
+TEST_CASE("legacy parser writes every osu db format", "[parsers][legacy]") {
+    // old difficulty bytes + entry size, entry size only, float star ratings
+    for (const int version : {20140101, 20190101, 20250107}) {
+        const bool has_entry_size = version < 20191106;
+
+        OsuLegacyDatabase original;
+        original.version = version;
+        original.player_name = "mzle";
+
+        for (int i = 0; i < 50; i++) {
+            LegacyBeatmap beatmap;
+            beatmap.artist = "artist " + std::to_string(i);
+            beatmap.title = std::string(static_cast<size_t>(i) * 5, 't');
+            beatmap.md5 = std::string(32, static_cast<char>('a' + i % 26));
+            beatmap.folder_name = "folder";
+            beatmap.approach_rate = 9;
+            legacy_parser::set_star_ratings(original, beatmap, 0, {{0, 5.5}, {64, 7.25}});
+            legacy_parser::set_star_ratings(original, beatmap, 3,
+                                            std::vector<LegacyFloatPair>(static_cast<size_t>(i), {16, 3.5}));
+            legacy_parser::set_timing_points(
+                original, beatmap, std::vector<LegacyTimingPoint>(static_cast<size_t>(i % 7), {300.0, 1000.0, 1}));
+            beatmap.last_played = 1000 + i;
+            beatmap.unknown = version < 20140609 ? std::optional<int>(0) : std::nullopt;
+            original.beatmaps.push_back(std::move(beatmap));
+        }
+
+        const auto output_path = test_helper::temp_root() / ("legacy-format-" + std::to_string(version) + ".osu!.db");
+        std::filesystem::remove(output_path);
+        REQUIRE(legacy_parser::write(output_path, &original));
+
+        OsuLegacyDatabase roundtrip;
+        REQUIRE(legacy_parser::parse(output_path, &roundtrip));
+        REQUIRE(roundtrip.beatmaps.size() == original.beatmaps.size());
+        REQUIRE(roundtrip.beatmaps[49].title == original.beatmaps[49].title);
+        REQUIRE(legacy_parser::timing_points(roundtrip, roundtrip.beatmaps[49]).empty());
+        REQUIRE(legacy_parser::timing_points(roundtrip, roundtrip.beatmaps[48]).size() == 6);
+        REQUIRE(legacy_parser::timing_points(roundtrip, roundtrip.beatmaps[48])[5].bpm == 300.0);
+        REQUIRE(roundtrip.beatmaps[20].last_played == 1020);
+
+        if (version >= 20140609) {
+            REQUIRE(roundtrip.beatmaps[30].star_rating == 5.5);
+            REQUIRE(legacy_parser::star_ratings(roundtrip, roundtrip.beatmaps[30], 3).size() == 30);
+            REQUIRE(legacy_parser::star_ratings(roundtrip, roundtrip.beatmaps[30], 0)[1].star_rating == 7.25);
+            REQUIRE(legacy_parser::star_ratings(roundtrip, roundtrip.beatmaps[30], 1).empty());
+        }
+
+        if (has_entry_size) {
+            // the back patched sizes have to cover the file exactly
+            size_t total = 4 + 4 + 1 + 8 + binary::string_size(original.player_name) + 4 + 4;
+
+            for (const auto& beatmap : roundtrip.beatmaps) {
+                REQUIRE(beatmap.entry_size.has_value());
+                total += 4 + static_cast<size_t>(*beatmap.entry_size);
+            }
+
+            REQUIRE(std::filesystem::file_size(output_path) == total);
+        }
+
+        // cut anywhere, the file is rejected instead of read past its end
+        for (const size_t cut : {size_t(20), size_t(200), static_cast<size_t>(std::filesystem::file_size(output_path) - 1)}) {
+            const auto truncated_path = test_helper::temp_root() / "legacy-truncated.osu!.db";
+            const std::string bytes = test_helper::read_file(output_path);
+            std::ofstream(truncated_path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(cut));
+
+            OsuLegacyDatabase truncated;
+            REQUIRE_FALSE(legacy_parser::parse(truncated_path, &truncated));
+        }
+
+        // writing what was read gives the same bytes back, the ratings are copied instead
+        // of converted from the doubles set_star_ratings stored in original
+        const auto second_path = test_helper::temp_root() / ("legacy-format-" + std::to_string(version) + "-2.osu!.db");
+        REQUIRE(legacy_parser::write(second_path, &roundtrip));
+        REQUIRE(test_helper::read_file(output_path) == test_helper::read_file(second_path));
+    }
+}
+
+TEST_CASE("legacy parser patches osu db entries in place", "[parsers][legacy]") {
+    OsuLegacyDatabase database;
+    database.version = 20250107;
+    database.player_name = "mzle";
+
+    for (int i = 0; i < 20; i++) {
+        LegacyBeatmap beatmap;
+        beatmap.title = "title " + std::to_string(i);
+        beatmap.md5 = std::string(32, static_cast<char>('a' + i));
+        legacy_parser::set_star_ratings(database, beatmap, 0, {{0, 4.5}});
+        beatmap.unplayed = 1;
+        database.beatmaps.push_back(std::move(beatmap));
+    }
+
+    const auto directory = test_helper::temp_root() / "legacy-patch";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    const auto path = directory / "osu!.db";
+    const auto expected_path = directory / "expected.db";
+    // a hard link sees in place writes, a rewrite renames a new file over the name
+    const auto link_path = directory / "link.db";
+
+    REQUIRE(legacy_parser::write(path, &database));
+
+    OsuLegacyDatabase parsed;
+    REQUIRE(legacy_parser::parse(path, &parsed));
+    REQUIRE(parsed.beatmaps[5].entry_offset == database.beatmaps[5].entry_offset);
+    REQUIRE(parsed.beatmaps[5].entry_length == database.beatmaps[5].entry_length);
+    std::filesystem::create_hard_link(path, link_path);
+
+    parsed.beatmaps[3].last_played = 123456789;
+    parsed.beatmaps[3].unplayed = 0;
+    parsed.beatmaps[3].grade_standard = 2;
+    parsed.beatmaps[3].local_offset = -15;
+    parsed.beatmaps[7].md5 = std::string(32, 'z');
+    legacy_parser::set_star_ratings(parsed, parsed.beatmaps[7], 0, {{0, 6.0}});
+    parsed.folder_count = 99;
+    parsed.permissions = 4;
+
+    REQUIRE(legacy_parser::patch(path, &parsed, {3, 7}));
+    REQUIRE(test_helper::read_file(link_path) == test_helper::read_file(path));
+
+    // same bytes as writing everything again
+    OsuLegacyDatabase copy = parsed;
+    REQUIRE(legacy_parser::write(expected_path, &copy));
+    REQUIRE(test_helper::read_file(path) == test_helper::read_file(expected_path));
+
+    // a longer title doesn't fit, the whole file is written again
+    parsed.beatmaps[10].title = "a much longer title than before";
+    REQUIRE(legacy_parser::patch(path, &parsed, {10}));
+    REQUIRE(test_helper::read_file(link_path) != test_helper::read_file(path));
+
+    OsuLegacyDatabase roundtrip;
+    REQUIRE(legacy_parser::parse(path, &roundtrip));
+    REQUIRE(roundtrip.folder_count == 99);
+    REQUIRE(roundtrip.permissions == 4);
+    REQUIRE(roundtrip.beatmaps[3].last_played == 123456789);
+    REQUIRE(roundtrip.beatmaps[3].unplayed == 0);
+    REQUIRE(roundtrip.beatmaps[3].local_offset == -15);
+    REQUIRE(roundtrip.beatmaps[7].md5 == std::string(32, 'z'));
+    REQUIRE(roundtrip.beatmaps[7].star_rating == 6.0);
+    REQUIRE(legacy_parser::star_ratings(roundtrip, roundtrip.beatmaps[7], 0)[0].star_rating == 6.0);
+    REQUIRE(roundtrip.beatmaps[10].title == "a much longer title than before");
+    REQUIRE(roundtrip.beatmaps[11].entry_offset == parsed.beatmaps[11].entry_offset);
+
+    // the rewrite refreshed the offsets, the next small edit is in place again
+    std::filesystem::remove(link_path);
+    std::filesystem::create_hard_link(path, link_path);
+    parsed.beatmaps[19].grade_mania = 1;
+    REQUIRE(legacy_parser::patch(path, &parsed, {19}));
+    REQUIRE(test_helper::read_file(link_path) == test_helper::read_file(path));
+
+    // something else wrote the file since, don't trust the offsets
+    std::filesystem::last_write_time(path, parsed.write_time - std::chrono::seconds(10));
+    parsed.beatmaps[19].grade_taiko = 3;
+    REQUIRE(legacy_parser::patch(path, &parsed, {19}));
+    REQUIRE(test_helper::read_file(link_path) != test_helper::read_file(path));
+
+    // removing a beatmap moves everything after it
+    parsed.beatmaps.erase(parsed.beatmaps.begin() + 2);
+    REQUIRE(legacy_parser::patch(path, &parsed, {}));
+
+    roundtrip = {};
+    REQUIRE(legacy_parser::parse(path, &roundtrip));
+    REQUIRE(roundtrip.beatmaps.size() == 19);
+    REQUIRE(roundtrip.beatmaps[18].grade_mania == 1);
+}
+
+TEST_CASE("legacy parser ignores ranges from another database", "[parsers][legacy]") {
+    OsuLegacyDatabase source;
+    source.version = 20250107;
+
+    LegacyBeatmap beatmap;
+    beatmap.md5 = std::string(32, 'a');
+    legacy_parser::set_star_ratings(source, beatmap, 0, {{0, 4.5}, {64, 6.0}});
+    legacy_parser::set_timing_points(source, beatmap, {{300.0, 0.0, 1}});
+    REQUIRE(legacy_parser::star_ratings(source, beatmap, 0).size() == 2);
+
+    // the other database has enough bytes for the offsets to look valid
+    OsuLegacyDatabase other;
+    other.version = 20250107;
+    LegacyBeatmap filler;
+    legacy_parser::set_star_ratings(other, filler, 0, std::vector<LegacyFloatPair>(8, {0, 1.0}));
+    legacy_parser::set_timing_points(other, filler, std::vector<LegacyTimingPoint>(8, {100.0, 0.0, 1}));
+    REQUIRE(other.raw.size() >= source.raw.size());
+
+    other.beatmaps.push_back(beatmap);
+    REQUIRE(legacy_parser::star_ratings(other, beatmap, 0).empty());
+    REQUIRE(legacy_parser::timing_points(other, beatmap).empty());
+
+    const auto path = test_helper::temp_root() / "legacy-foreign-ranges.db";
+    REQUIRE(legacy_parser::write(path, &other));
+
+    OsuLegacyDatabase roundtrip;
+    REQUIRE(legacy_parser::parse(path, &roundtrip));
+    REQUIRE(roundtrip.beatmaps.size() == 1);
+    REQUIRE(legacy_parser::star_ratings(roundtrip, roundtrip.beatmaps[0], 0).empty());
+    REQUIRE(legacy_parser::timing_points(roundtrip, roundtrip.beatmaps[0]).empty());
+}
+
 TEST_CASE("legacy parser read collection.db", "[parsers][legacy]") {
     OsuLegacyCollection database;
     const auto path = (test_helper::osu_root() / "collection.db").string();
@@ -78,3 +279,43 @@ TEST_CASE("legacy collection parser roundtrip preserves collection data", "[pars
     REQUIRE(roundtrip.collections[0].name == original.collections[0].name);
     REQUIRE(roundtrip.collections[0].beatmap_md5 == original.collections[0].beatmap_md5);
 }
+
+TEST_CASE("legacy collection writer replaces the file atomically", "[parsers][legacy]") {
+    OsuLegacyCollection original;
+    original.version = 20250107;
+    // empty, one byte and two byte uleb128 lengths
+    original.collections.push_back({.name = "", .beatmaps_count = 0, .beatmap_md5 = {}});
+    original.collections.push_back({.name = std::string(300, 'n'), .beatmaps_count = 0, .beatmap_md5 = {}});
+
+    size_t expected_size = 8 + 1 + 4 + 3 + 300 + 4;
+
+    for (int i = 0; i < 2000; i++) {
+        original.collections[1].beatmap_md5.push_back(std::string(32, static_cast<char>('a' + i % 26)));
+        expected_size += 1 + 1 + 32;
+    }
+
+    const auto directory = test_helper::temp_root() / "collection-atomic";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const auto output_path = (directory / "collection.db").string();
+
+    REQUIRE(binary::string_size(original.collections[1].name) == 303);
+    REQUIRE(binary::uleb128_size(127) == 1);
+    REQUIRE(binary::uleb128_size(128) == 2);
+
+    // the second write goes over the first one
+    REQUIRE(legacy_collection_parser::write(output_path, &original));
+    REQUIRE(legacy_collection_parser::write(output_path, &original));
+    REQUIRE(std::filesystem::file_size(output_path) == expected_size);
+    REQUIRE_FALSE(std::filesystem::exists(output_path + ".tmp"));
+
+    OsuLegacyCollection roundtrip;
+    REQUIRE(legacy_collection_parser::parse(output_path, &roundtrip));
+    REQUIRE(roundtrip.collections_count == 2);
+    REQUIRE(roundtrip.collections[0].name.empty());
+    REQUIRE(roundtrip.collections[1].name == original.collections[1].name);
+    REQUIRE(roundtrip.collections[1].beatmap_md5 == original.collections[1].beatmap_md5);
+
+    // a missing directory fails without leaving anything behind
+    REQUIRE_FALSE(legacy_collection_parser::write((directory / "missing" / "collection.db").string(), &original));
+}
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// minimal http/1.1 stand-in server for api / download tests.
+// supports keep-alive and counts accepted connections so tests can check reuse.
+namespace test_helper {
+#ifdef _WIN32
+    using socket_t = SOCKET;
+    constexpr socket_t INVALID_SOCKET_VALUE = INVALID_SOCKET;
+
+    inline void close_socket(socket_t socket) {
+        closesocket(socket);
+    }
+#else
+    using socket_t = int;
+    constexpr socket_t INVALID_SOCKET_VALUE = -1;
+
+    inline void close_socket(socket_t socket) {
+        close(socket);
+    }
+#endif
+
+    struct HttpRequest {
+        std::string method;
+        std::string target; // path + query
+        std::string path;
+        std::string query;
+        std::unordered_map<std::string, std::string> headers; // lowercase keys
+        std::string body;
+
+        std::string header(const std::string& key) const {
+            const auto it = headers.find(key);
+            return it != headers.end() ? it->second : "";
+        }
+    };
+
+    struct HttpResponse {
+        int status = 200;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+        std::chrono::milliseconds delay{0};  // wait before sending anything
+        size_t chunk_size = 0;               // > 0 sends the body in pieces
+        std::chrono::milliseconds chunk_delay{0};
+        bool close_connection = false;
+    };
+
+    inline std::string status_text(int status) {
+        switch (status) {
+            case 200:
+                return "OK";
+            case 206:
+                return "Partial Content";
+            case 304:
+                return "Not Modified";
+            case 404:
+                return "Not Found";
+            case 416:
+                return "Range Not Satisfiable";
+            case 429:
+                return "Too Many Requests";
+            case 503:
+                return "Service Unavailable";
+            default:
+                return "Status";
+        }
+    }
+
+    class LocalServer {
+    public:
+        using Handler = std::function<HttpResponse(const HttpRequest&)>;
+
+        explicit LocalServer(Handler handler) : m_handler(std::move(handler)) {
+#ifdef _WIN32
+            WSADATA wsa_data;
+            WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+            m_listen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+            if (m_listen == INVALID_SOCKET_VALUE) {
+                throw std::runtime_error("failed to create server socket");
+            }
+
+            int reuse = 1;
+            setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = 0;
+
+            if (bind(m_listen, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+                listen(m_listen, 64) != 0) {
+                close_socket(m_listen);
+                throw std::runtime_error("failed to bind server socket");
+            }
+
+            socklen_t length = sizeof(address);
+            getsockname(m_listen, reinterpret_cast<sockaddr*>(&address), &length);
+            m_port = ntohs(address.sin_port);
+
+            m_accept_thread = std::thread([this]() { accept_loop(); });
+        }
+
+        ~LocalServer() {
+            m_running = false;
+
+            if (m_accept_thread.joinable()) {
+                m_accept_thread.join();
+            }
+
+            std::vector<std::thread> workers;
+            {
+                std::scoped_lock lock(m_mutex);
+                workers.swap(m_workers);
+            }
+
+            for (auto& worker : workers) {
+                worker.join();
+            }
+
+            close_socket(m_listen);
+#ifdef _WIN32
+            WSACleanup();
+#endif
+        }
+
+        LocalServer(const LocalServer&) = delete;
+        LocalServer& operator=(const LocalServer&) = delete;
+
+        uint16_t port() const {
+            return m_port;
+        }
+
+        std::string url() const {
+            return "http://127.0.0.1:" + std::to_string(m_port);
+        }
+
+        int connections() const {
+            return m_connections.load();
+        }
+
+        int requests() const {
+            return m_requests.load();
+        }
+
+        // highest number of requests being handled at the same time
+        int peak_in_flight() const {
+            return m_peak_in_flight.load();
+        }
+
+    private:
+        static bool wait_readable(socket_t socket, int timeout_ms) {
+            fd_set set;
+            FD_ZERO(&set);
+            FD_SET(socket, &set);
+
+            timeval timeout{};
+            timeout.tv_sec = timeout_ms / 1000;
+            timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+            return select(static_cast<int>(socket + 1), &set, nullptr, nullptr, &timeout) > 0;
+        }
+
+        static bool send_all(socket_t socket, std::string_view data) {
+            while (!data.empty()) {
+                const auto sent = send(socket, data.data(), static_cast<int>(data.size()), 0);
+                if (sent <= 0) {
+                    return false;
+                }
+                data.remove_prefix(static_cast<size_t>(sent));
+            }
+            return true;
+        }
+
+        void accept_loop() {
+            while (m_running) {
+                if (!wait_readable(m_listen, 50)) {
+                    continue;
+                }
+
+                const socket_t client = accept(m_listen, nullptr, nullptr);
+                if (client == INVALID_SOCKET_VALUE) {
+                    continue;
+                }
+
+                m_connections++;
+
+                std::scoped_lock lock(m_mutex);
+                m_workers.emplace_back([this, client]() {
+                    connection_loop(client);
+                    close_socket(client);
+                });
+            }
+        }
+
+        // reads one request from the connection, false when the peer went away
+        bool read_request(socket_t client, std::string& pending, HttpRequest& request) {
+            size_t header_end = std::string::npos;
+
+            while ((header_end = pending.find("\r\n\r\n")) == std::string::npos) {
+                if (!m_running) {
+                    return false;
+                }
+
+                if (!wait_readable(client, 50)) {
+                    continue;
+                }
+
+                char buffer[4096];
+                const auto received = recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    return false;
+                }
+                pending.append(buffer, static_cast<size_t>(received));
+            }
+
+            const std::string head = pending.substr(0, header_end);
+            pending.erase(0, header_end + 4);
+
+            size_t line_end = head.find("\r\n");
+            const std::string request_line = head.substr(0, line_end);
+            const size_t method_end = request_line.find(' ');
+            const size_t target_end = request_line.find(' ', method_end + 1);
+
+            request = {};
+            request.method = request_line.substr(0, method_end);
+            request.target = request_line.substr(method_end + 1, target_end - method_end - 1);
+
+            const size_t query_start = request.target.find('?');
+            request.path = request.target.substr(0, query_start);
+            request.query = query_start != std::string::npos ? request.target.substr(query_start + 1) : "";
+
+            while (line_end != std::string::npos && line_end < head.size()) {
+                const size_t start = line_end + 2;
+                line_end = head.find("\r\n", start);
+                const std::string line = head.substr(start, line_end == std::string::npos ? line_end : line_end - start);
+                const size_t colon = line.find(':');
+
+                if (colon == std::string::npos) {
+                    continue;
+                }
+
+                std::string key = line.substr(0, colon);
+                std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) {
+                    return static_cast<char>(std::tolower(c));
+                });
+
+                std::string value = line.substr(colon + 1);
+                value.erase(0, value.find_first_not_of(' '));
+                request.headers[key] = value;
+            }
+
+            const std::string content_length = request.header("content-length");
+            const size_t body_size = content_length.empty() ? 0 : std::stoul(content_length);
+
+            while (pending.size() < body_size) {
+                if (!m_running) {
+                    return false;
+                }
+
+                if (!wait_readable(client, 50)) {
+                    continue;
+                }
+
+                char buffer[4096];
+                const auto received = recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    return false;
+                }
+                pending.append(buffer, static_cast<size_t>(received));
+            }
+
+            request.body = pending.substr(0, body_size);
+            pending.erase(0, body_size);
+            return true;
+        }
+
+        void connection_loop(socket_t client) {
+            std::string pending;
+            HttpRequest request;
+
+            while (m_running && read_request(client, pending, request)) {
+                m_requests++;
+
+                const int in_flight = ++m_in_flight;
+                int peak = m_peak_in_flight.load();
+                while (in_flight > peak && !m_peak_in_flight.compare_exchange_weak(peak, in_flight)) {
+                }
+
+                HttpResponse response = m_handler(request);
+
+                if (response.delay.count() > 0) {
+                    std::this_thread::sleep_for(response.delay);
+                }
+
+                const bool close_after = response.close_connection || request.header("connection") == "close";
+
+                std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " +
+                                   status_text(response.status) + "\r\n";
+                head += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+                head += close_after ? "Connection: close\r\n" : "Connection: keep-alive\r\n";
+
+                for (const auto& [key, value] : response.headers) {
+                    head += key + ": " + value + "\r\n";
+                }
+
+                head += "\r\n";
+
+                bool ok = send_all(client, head);
+                const bool has_body = request.method != "HEAD" && response.status != 304;
+
+                if (ok && has_body && response.chunk_size > 0) {
+                    std::string_view body = response.body;
+                    while (ok && !body.empty() && m_running) {
+                        const size_t size = std::min(response.chunk_size, body.size());
+                        ok = send_all(client, body.substr(0, size));
+                        body.remove_prefix(size);
+                        if (response.chunk_delay.count() > 0) {
+                            std::this_thread::sleep_for(response.chunk_delay);
+                        }
+                    }
+                } else if (ok && has_body) {
+                    ok = send_all(client, response.body);
+                }
+
+                m_in_flight--;
+
+                if (!ok || close_after) {
+                    break;
+                }
+            }
+        }
+
+        Handler m_handler;
+        socket_t m_listen = INVALID_SOCKET_VALUE;
+        uint16_t m_port = 0;
+        std::atomic<bool> m_running = true;
+        std::atomic<int> m_connections = 0;
+        std::atomic<int> m_requests = 0;
+        std::atomic<int> m_in_flight = 0;
+        std::atomic<int> m_peak_in_flight = 0;
+        std::thread m_accept_thread;
+        std::mutex m_mutex;
+        std::vector<std::thread> m_workers;
+    };
+} // namespace test_helper
@@ -3,6 +3,7 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <cmath>
+#include <thread>
 
 TEST_CASE("osdb parser write / parse", "[parsers][osdb]") {
     const auto path = (test_helper::temp_root() / "collections.osdb").string();
@@ -53,13 +54,16 @@ TEST_CASE("osdb parser write / parse", "[parsers][osdb]") {
         },
     };
 
-    osdb_parser::data = &original;
-    osdb_parser::location = path;
-    REQUIRE(osdb_parser::write());
+    REQUIRE(OsdbWriter().write(path, original));
+    REQUIRE_FALSE(std::filesystem::exists(path + ".tmp"));
+
+    // an unknown version fails before anything is written, the last export stays readable
+    OsdbData broken = original;
+    broken.version_string = "not a version";
+    REQUIRE_FALSE(OsdbWriter().write(path, broken));
 
     OsdbData roundtrip;
-    osdb_parser::data = &roundtrip;
-    REQUIRE(osdb_parser::parse(path));
+    REQUIRE(OsdbReader().read(path, roundtrip));
     REQUIRE(roundtrip.version_string == "o!dm8");
     REQUIRE(roundtrip.last_editor == "codex");
     REQUIRE(roundtrip.count == 2);
@@ -70,3 +74,140 @@ TEST_CASE("osdb parser write / parse", "[parsers][osdb]") {
     REQUIRE(std::abs(roundtrip.collections[0].beatmaps[0].difficulty_rating - 5.35) < 0.000001);
     REQUIRE(roundtrip.collections[0].hash_only_beatmaps == std::vector<std::string>{"missing-md5"});
 }
+
+TEST_CASE("osdb parser streams large files", "[parsers][osdb]") {
+    // compressed and plain bodies, both much bigger than the read window
+    for (const std::string version : {"o!dm8", "o!dm6"}) {
+        const auto path = (test_helper::temp_root() / ("large-" + version + ".osdb")).string();
+        std::filesystem::remove(path);
+
+        OsdbData original;
+        original.version_string = version;
+        original.save_data = 1;
+        original.last_editor = "mzle";
+
+        for (int i = 0; i < 20; i++) {
+            OsdbCollection collection;
+            collection.name = "collection " + std::to_string(i);
+
+            for (int j = 0; j < 2000; j++) {
+                collection.beatmaps.push_back(OsdbBeatmap{
+                    .difficulty_id = i * 2000 + j,
+                    .beatmapset_id = j,
+                    .artist = "artist " + std::to_string(j),
+                    .title = "title " + std::to_string(i),
+                    .difficulty = "difficulty",
+                    .checksum = std::string(32, static_cast<char>('a' + j % 26)),
+                    .user_comment = j == 1999 ? std::string(300000, 'c') : "",
+                    .mode = j % 4,
+                    .difficulty_rating = j / 100.0,
+                });
+            }
+
+            collection.hash_only_beatmaps.assign(100, std::string(32, 'h'));
+            original.collections.push_back(std::move(collection));
+        }
+
+        REQUIRE(OsdbWriter().write(path, original));
+
+        OsdbData roundtrip;
+        REQUIRE(OsdbReader().read(path, roundtrip));
+        REQUIRE(roundtrip.version_string == version);
+        REQUIRE(roundtrip.collections.size() == 20);
+        REQUIRE(roundtrip.collections[19].name == "collection 19");
+        REQUIRE(roundtrip.collections[19].beatmaps.size() == 2000);
+        REQUIRE(roundtrip.collections[19].beatmaps[1999].difficulty_id == 39999);
+        REQUIRE(roundtrip.collections[19].beatmaps[1999].user_comment.size() == 300000);
+        REQUIRE(roundtrip.collections[7].beatmaps[123].artist == "artist 123");
+        REQUIRE(roundtrip.collections[7].hash_only_beatmaps.size() == 100);
+    }
+}
+
+TEST_CASE("osdb parser parallel export", "[parsers][osdb]") {
+    OsdbData original;
+    original.version_string = "o!dm8";
+    original.last_editor = "mzle";
+
+    for (int i = 0; i < 50; i++) {
+        OsdbCollection collection;
+        collection.name = "collection " + std::to_string(i);
+
+        for (int j = 0; j < 1000; j++) {
+            collection.beatmaps.push_back(OsdbBeatmap{
+                .difficulty_id = j,
+                .artist = "artist " + std::to_string(j % 40),
+                .title = "title " + std::to_string(j),
+                .checksum = std::string(32, static_cast<char>('a' + j % 26)),
+            });
+        }
+
+        original.collections.push_back(std::move(collection));
+    }
+
+    const auto serial_path = (test_helper::temp_root() / "serial.osdb").string();
+    const auto parallel_path = (test_helper::temp_root() / "parallel.osdb").string();
+
+    REQUIRE(OsdbWriter({.compression_level = 1}).write(serial_path, original));
+    REQUIRE(OsdbWriter({.compression_level = 9, .parallel = true}).write(parallel_path, original));
+
+    for (const auto& path : {serial_path, parallel_path}) {
+        OsdbData roundtrip;
+        REQUIRE(OsdbReader().read(path, roundtrip));
+        REQUIRE(roundtrip.collections.size() == 50);
+        REQUIRE(roundtrip.collections[49].beatmaps[999].title == "title 999");
+        REQUIRE(roundtrip.collections[25].beatmaps[10].checksum == original.collections[25].beatmaps[10].checksum);
+    }
+}
+
+TEST_CASE("osdb reader streams collections and runs concurrently", "[parsers][osdb]") {
+    constexpr int FILE_COUNT = 6;
+    std::vector<std::string> paths;
+
+    for (int i = 0; i < FILE_COUNT; i++) {
+        OsdbData data;
+        data.version_string = i % 2 == 0 ? "o!dm8" : "o!dm6";
+        data.last_editor = "editor " + std::to_string(i);
+
+        for (int j = 0; j <= i; j++) {
+            OsdbCollection collection;
+            collection.name = std::to_string(i) + "-" + std::to_string(j);
+            collection.beatmaps.assign(500, OsdbBeatmap{.difficulty_id = i, .checksum = "md5"});
+            data.collections.push_back(std::move(collection));
+        }
+
+        paths.push_back((test_helper::temp_root() / ("merge-" + std::to_string(i) + ".osdb")).string());
+        REQUIRE(OsdbWriter().write(paths.back(), data));
+    }
+
+    // one reader per file, no shared state between them
+    std::vector<OsdbData> headers(FILE_COUNT);
+    std::vector<std::vector<std::string>> names(FILE_COUNT);
+    std::vector<int> results(FILE_COUNT, 0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < FILE_COUNT; i++) {
+        threads.emplace_back([&, i]() {
+            OsdbReader reader;
+            bool valid = true;
+
+            results[i] = reader.read(paths[i], headers[i], [&](OsdbCollection&& collection) {
+                valid = valid && collection.beatmaps.size() == 500 && collection.beatmaps[0].difficulty_id == i;
+                names[i].push_back(std::move(collection.name));
+            }) && valid;
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (int i = 0; i < FILE_COUNT; i++) {
+        REQUIRE(results[i] == 1);
+        REQUIRE(headers[i].last_editor == "editor " + std::to_string(i));
+        REQUIRE(headers[i].count == i + 1);
+        // streamed, not kept
+        REQUIRE(headers[i].collections.empty());
+        REQUIRE(names[i].size() == static_cast<size_t>(i + 1));
+        REQUIRE(names[i].back() == std::to_string(i) + "-" + std::to_string(i));
+    }
+}
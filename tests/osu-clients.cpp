@@ -1,10 +1,13 @@
 #include "clients/lazer.hpp"
+#include "clients/songs_scanner.hpp"
 #include "clients/stable.hpp"
 #include "parser/legacy/legacy_collection.hpp"
+#include "utils/md5.hpp"
 #include "helper.hpp"
 
 #include <catch2/catch_test_macros.hpp>
 #include <algorithm>
+#include <fstream>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -166,3 +169,92 @@ TEST_CASE("stable update_collection persists the in memory collections", "[clien
     REQUIRE(it != database.collections.end());
     REQUIRE(it->beatmap_md5 == std::vector<std::string>{TEST_BEATMAP_HASH});
 }
+
+static std::string make_osu_text(int set_id, int index) {
+    return "osu file format v14\n\n[General]\nAudioFilename: audio.mp3\nMode: 0\n\n[Metadata]\nTitle:Song " +
+           std::to_string(set_id) + "\nArtist:scanner\nCreator:tester\nVersion:Diff " + std::to_string(index) +
+           "\nBeatmapID:" + std::to_string(set_id * 10 + index) + "\nBeatmapSetID:" + std::to_string(set_id) +
+           "\n\n[Difficulty]\nApproachRate:" + std::to_string(5 + index) +
+           "\n\n[HitObjects]\n256,192,1000,1,0,0:0:0:0:\n256,192,5000,1,0,0:0:0:0:\n";
+}
+
+// Songs/<set>/<diff>.osu for set_count sets with three difficulties each
+static void make_songs_folder(const std::filesystem::path& songs, int set_count) {
+    std::filesystem::remove_all(songs);
+
+    for (int set_id = 1; set_id <= set_count; set_id++) {
+        const auto folder = songs / (std::to_string(set_id) + " scanner - Song " + std::to_string(set_id));
+        std::filesystem::create_directories(folder);
+
+        for (int index = 0; index < 3; index++) {
+            std::ofstream file(folder / ("scanner - Song [Diff " + std::to_string(index) + "].osu"), std::ios::binary);
+            file << make_osu_text(set_id, index);
+        }
+
+        std::ofstream(folder / "audio.mp3") << "not really audio";
+    }
+}
+
+TEST_CASE("songs scanner indexes every set folder", "[clients][scanner]") {
+    const auto songs = test_helper::temp_root() / "songs-scanner" / "Songs";
+    make_songs_folder(songs, 40);
+
+    const auto result = songs_scanner::scan(songs, {.folders_per_task = 3});
+    REQUIRE(result.folders == 40);
+    REQUIRE(result.failed == 0);
+    REQUIRE(result.beatmaps.size() == 120);
+
+    const auto it = std::find_if(result.beatmaps.begin(), result.beatmaps.end(), [](const LegacyBeatmap& beatmap) {
+        return beatmap.beatmap_id == 7 && beatmap.difficulty == "Diff 2";
+    });
+
+    REQUIRE(it != result.beatmaps.end());
+    REQUIRE(it->md5 == binary::md5_hex(make_osu_text(7, 2)));
+    REQUIRE(it->difficulty_id == 72);
+    REQUIRE(it->approach_rate == 7.0);
+    REQUIRE(it->folder_name == "7 scanner - Song 7");
+    REQUIRE(it->osu_file_name == "scanner - Song [Diff 2].osu");
+    REQUIRE(it->hitcircle == 2);
+    REQUIRE(it->total_time == 5000);
+}
+
+TEST_CASE("songs scanner only counts objects under the [HitObjects] header", "[clients][scanner]") {
+    const std::string content = "osu file format v14\r\n\r\n[General]\r\nAudioFilename: audio.mp3\r\n\r\n"
+                                "[Metadata]\r\nTitle:Song\r\nTags:[HitObjects] not a header\r\nVersion:Diff\r\n\r\n"
+                                "  [HitObjects]  \r\n"
+                                "  256,192,1000,1,0,0:0:0:0:\r\n"
+                                "\t256,192,2000,2,0,B|300:200,1,100\r\n"
+                                "256,192,3000,12,0,6000,0:0:0:0:\r\n";
+
+    LegacyBeatmap beatmap;
+    REQUIRE(songs_scanner::build_beatmap(content, "1 folder", "diff.osu", beatmap));
+    REQUIRE(beatmap.hitcircle == 1);
+    REQUIRE(beatmap.sliders == 1);
+    REQUIRE(beatmap.spinners == 1);
+    REQUIRE(beatmap.total_time == 6000);
+}
+
+TEST_CASE("songs scanner agrees with osu!.db", "[clients][scanner]") {
+    const auto result = songs_scanner::scan(test_helper::osu_root() / "Songs");
+    REQUIRE_FALSE(result.beatmaps.empty());
+
+    auto client = make_client("stable");
+    const auto it = std::find_if(result.beatmaps.begin(), result.beatmaps.end(), [](const LegacyBeatmap& beatmap) {
+        return beatmap.beatmap_id == 2134701 && beatmap.difficulty == "HD1";
+    });
+
+    REQUIRE(it != result.beatmaps.end());
+    REQUIRE(client->get_beatmap(it->md5) != nullptr);
+}
+
+TEST_CASE("stable client indexes the Songs folder without osu!.db", "[clients][scanner]") {
+    const auto root = test_helper::temp_root() / "stable-without-db";
+    std::filesystem::remove_all(root);
+    make_songs_folder(root / "Songs", 5);
+
+    auto client = make_client("stable", root.string());
+    REQUIRE(client->get_beatmap(binary::md5_hex(make_osu_text(3, 1))) != nullptr);
+    REQUIRE(client->get_beatmapset(3) != nullptr);
+    REQUIRE(client->get_beatmapset(3)->beatmaps.size() == 3);
+    REQUIRE(client->search_beatmaps(make_search_options()).size() == 15);
+}
@@ -1,9 +1,17 @@
+#include "../src/api/osu-v2/beatmap_resolver.hpp"
 #include "../src/api/osu-v2/detail.hpp"
 #include "../src/api/osu-collector/detail.hpp"
+#include "helper.hpp"
+#include "local-server.hpp"
 
 #include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <filesystem>
 #include <string>
+#include <thread>
+#include <vector>
 
 static OAuthAuthRequest get_live_auth_data() {
     const char* id = std::getenv("OSU_ID");
@@ -30,6 +38,519 @@ static bool live_test_enabled(const char* variable) {
     return enabled != nullptr && std::string{enabled} == "1";
 }
 
+static test_helper::HttpResponse json_response(const nlohmann::json& body) {
+    test_helper::HttpResponse response;
+    response.headers = {{"Content-Type", "application/json"}};
+    response.body = body.dump();
+    return response;
+}
+
+TEST_CASE("oauth api reuses pooled connections", "[oauth][api]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest& request) {
+        return json_response({{"path", request.path}});
+    });
+
+    OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+
+    for (int i = 0; i < 8; i++) {
+        const auto response = api.get<nlohmann::json>("/ping", {{"index", std::to_string(i)}}, false);
+        REQUIRE(response.has_value());
+        REQUIRE(response->at("path") == "/ping");
+    }
+
+    REQUIRE(server.requests() == 8);
+    REQUIRE(server.connections() == 1);
+}
+
+TEST_CASE("oauth api caps concurrent streams", "[oauth][api]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest&) {
+        auto response = json_response({{"ok", true}});
+        response.delay = std::chrono::milliseconds(50);
+        return response;
+    });
+
+    OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+    api.set_connection_options({.max_concurrent_streams = 2, .keep_alive = true, .http2 = false});
+
+    std::vector<std::thread> workers;
+    std::atomic<int> succeeded = 0;
+
+    for (int i = 0; i < 6; i++) {
+        workers.emplace_back([&api, &succeeded]() {
+            if (api.get<nlohmann::json>("/slow", {}, false).has_value()) {
+                succeeded++;
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    REQUIRE(succeeded.load() == 6);
+    REQUIRE(server.peak_in_flight() <= 2);
+    REQUIRE(server.connections() <= 2);
+}
+
+TEST_CASE("oauth api retries throttled requests", "[oauth][api][rate-limit]") {
+    std::atomic<int> calls = 0;
+    test_helper::LocalServer server([&calls](const test_helper::HttpRequest&) {
+        if (calls++ < 2) {
+            test_helper::HttpResponse response;
+            response.status = 429;
+            response.headers = {{"Retry-After", "0"}};
+            return response;
+        }
+
+        return json_response({{"ok", true}});
+    });
+
+    OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+    api.set_rate_limit_options({.base_backoff = std::chrono::milliseconds(10)});
+
+    const auto response = api.get<nlohmann::json>("/throttled", {}, false);
+
+    REQUIRE(response.has_value());
+    REQUIRE(response->at("ok") == true);
+    REQUIRE(server.requests() == 3);
+}
+
+TEST_CASE("oauth api gives up after max attempts", "[oauth][api][rate-limit]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest&) {
+        test_helper::HttpResponse response;
+        response.status = 503;
+        return response;
+    });
+
+    OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+    api.set_rate_limit_options({.max_attempts = 3, .base_backoff = std::chrono::milliseconds(5)});
+
+    REQUIRE_FALSE(api.get<nlohmann::json>("/down", {}, false).has_value());
+    REQUIRE(server.requests() == 3);
+}
+
+TEST_CASE("oauth api paces requests with the token bucket", "[oauth][api][rate-limit]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest&) {
+        return json_response({{"ok", true}});
+    });
+
+    OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+    api.set_rate_limit_options({.requests_per_second = 20.0, .burst = 1.0});
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 5; i++) {
+        REQUIRE(api.get<nlohmann::json>("/paced", {}, false).has_value());
+    }
+
+    // first request uses the burst token, the other four wait 50ms each
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(180));
+}
+
+TEST_CASE("oauth api throttles token requests and refuses conflicting limits", "[oauth][api][rate-limit]") {
+    std::atomic<int> token_calls = 0;
+    test_helper::LocalServer server([&token_calls](const test_helper::HttpRequest&) {
+        if (token_calls++ == 0) {
+            test_helper::HttpResponse response;
+            response.status = 429;
+            response.headers = {{"Retry-After", "0"}};
+            return response;
+        }
+
+        return json_response({{"access_token", "token"}, {"expires_in", 3600}, {"token_type", "Bearer"}});
+    });
+
+    OAuthApi first(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+    OAuthApi second(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+
+    REQUIRE(first.set_rate_limit_options({.burst = 2.0, .base_backoff = std::chrono::milliseconds(10)}));
+    REQUIRE(second.set_rate_limit_options({.burst = 2.0, .base_backoff = std::chrono::milliseconds(10)}));
+    REQUIRE_FALSE(second.set_rate_limit_options({.burst = 5.0}));
+    REQUIRE(second.get_rate_limit_options().burst == 2.0);
+
+    // the token post went through the shared limiter and was retried after the 429
+    first.set_auth_data({.client_id = "id", .client_secret = "secret", .grant_type = "client_credentials"});
+    REQUIRE(first.authenticate());
+    REQUIRE(server.requests() == 2);
+    REQUIRE(first.get_rate_limit_options().burst == 2.0);
+}
+
+TEST_CASE("oauth api serves fresh responses from disk", "[oauth][api][cache]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest& request) {
+        auto response = json_response({{"path", request.path}});
+        response.headers.emplace_back("Cache-Control", "public, max-age=60");
+        return response;
+    });
+
+    const auto directory = test_helper::make_temp_directory("response-cache", "fresh");
+
+    {
+        OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+        api.set_cache_options({.directory = directory});
+
+        REQUIRE(api.get<nlohmann::json>("/collections/1", {}, false).has_value());
+        REQUIRE(api.get<nlohmann::json>("/collections/1", {}, false).has_value());
+        REQUIRE(api.get<nlohmann::json>("/collections/2", {}, false).has_value());
+    }
+
+    // a new instance picks the entries up from disk
+    OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+    api.set_cache_options({.directory = directory});
+
+    const auto response = api.get<nlohmann::json>("/collections/1", {}, false);
+
+    REQUIRE(response.has_value());
+    REQUIRE(response->at("path") == "/collections/1");
+    REQUIRE(server.requests() == 2);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("oauth api revalidates stale responses", "[oauth][api][cache]") {
+    std::atomic<int> full_responses = 0;
+    test_helper::LocalServer server([&full_responses](const test_helper::HttpRequest& request) {
+        if (request.header("if-none-match") == "\"v1\"") {
+            test_helper::HttpResponse response;
+            response.status = 304;
+            response.headers = {{"ETag", "\"v1\""}};
+            return response;
+        }
+
+        full_responses++;
+        auto response = json_response({{"version", 1}});
+        response.headers.emplace_back("ETag", "\"v1\"");
+        response.headers.emplace_back("Cache-Control", "no-cache");
+        return response;
+    });
+
+    const auto directory = test_helper::make_temp_directory("response-cache", "revalidate");
+    OAuthApi api(server.url(), OAuthAuthType::CLIENT_CREDENTIALS_GRANT);
+    api.set_cache_options({.directory = directory});
+
+    for (int i = 0; i < 3; i++) {
+        const auto response = api.get<nlohmann::json>("/beatmaps/75", {}, false);
+        REQUIRE(response.has_value());
+        REQUIRE(response->at("version") == 1);
+    }
+
+    REQUIRE(server.requests() == 3);
+    REQUIRE(full_responses.load() == 1);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("oauth api keeps cached responses per login", "[oauth][api][cache]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest& request) {
+        auto response = json_response({{"user", request.header("authorization")}});
+        response.headers.emplace_back("Cache-Control", "private, max-age=60");
+        return response;
+    });
+
+    const auto directory = test_helper::make_temp_directory("response-cache", "private");
+
+    const auto fetch_me = [&](const char* token) {
+        OAuthApi api(server.url(), OAuthAuthType::CODE_GRANT);
+        api.set_cache_options({.directory = directory});
+        api.set_access_token(token, 3600);
+        const auto response = api.get<nlohmann::json>("/me", {});
+        REQUIRE(response.has_value());
+        return response->at("user").get<std::string>();
+    };
+
+    REQUIRE(fetch_me("alice") == "Bearer alice");
+    REQUIRE(fetch_me("bob") == "Bearer bob");
+    REQUIRE(fetch_me("alice") == "Bearer alice");
+    REQUIRE(server.requests() == 2);
+
+    // a refreshed jwt names the same user, the cached response is still theirs
+    REQUIRE(fetch_me("h.eyJzdWIiOiI0MiIsImp0aSI6ImEifQ.s") == "Bearer h.eyJzdWIiOiI0MiIsImp0aSI6ImEifQ.s");
+    REQUIRE(fetch_me("h.eyJzdWIiOiI0MiIsImp0aSI6ImIifQ.s") == "Bearer h.eyJzdWIiOiI0MiIsImp0aSI6ImEifQ.s");
+    REQUIRE(fetch_me("h.eyJzdWIiOiI3In0.s") == "Bearer h.eyJzdWIiOiI3In0.s");
+    REQUIRE(server.requests() == 4);
+
+    // nobody to key an anonymous private response on, it's never stored
+    OAuthApi anonymous(server.url(), OAuthAuthType::CODE_GRANT);
+    anonymous.set_cache_options({.directory = directory});
+    REQUIRE(anonymous.get<nlohmann::json>("/me", {}, false).has_value());
+    REQUIRE(anonymous.get<nlohmann::json>("/me", {}, false).has_value());
+    REQUIRE(server.requests() == 6);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("response cache evicts the least recently used entries", "[oauth][cache]") {
+    const auto directory = test_helper::make_temp_directory("response-cache", "eviction");
+    ResponseCache cache({.directory = directory, .max_size = 4096});
+
+    cpr::Response response;
+    response.status_code = 200;
+    response.header["Cache-Control"] = "max-age=60";
+
+    for (int i = 0; i < 32; i++) {
+        // incompressible enough that every entry is a few hundred bytes
+        response.text.clear();
+        for (int j = 0; j < 256; j++) {
+            response.text.push_back(static_cast<char>((i * 7919 + j * j * 31) % 251));
+        }
+
+        REQUIRE(cache.store("GET /entry/" + std::to_string(i), response, false));
+    }
+
+    uint64_t total = 0;
+    for (const auto& file : std::filesystem::directory_iterator(directory)) {
+        total += file.file_size();
+    }
+
+    REQUIRE(total <= 4096);
+    REQUIRE(cache.load("GET /entry/31").has_value());
+    REQUIRE_FALSE(cache.load("GET /entry/0").has_value());
+
+    response.header["Cache-Control"] = "private, max-age=60";
+    REQUIRE_FALSE(cache.store("GET /private", response, false));
+    REQUIRE(cache.store("GET /private @token:1234", response, true));
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("cache-control directives are parsed", "[oauth][cache]") {
+    const auto control = response_cache::parse_cache_control("public, Max-Age=\"120\", no-cache");
+    REQUIRE(control.no_cache);
+    REQUIRE_FALSE(control.no_store);
+    REQUIRE(control.max_age == 120);
+
+    REQUIRE(response_cache::parse_cache_control("no-store").no_store);
+    REQUIRE_FALSE(response_cache::parse_cache_control("private").max_age.has_value());
+    REQUIRE(response_cache::parse_cache_control("private, max-age=60").is_private);
+
+    REQUIRE(
+        response_cache::make_key("GET", "https://osu.ppy.sh/api/v2/beatmaps", {{"ids[]", "1"}, {"ids[]", "2"}}) ==
+        "GET https://osu.ppy.sh/api/v2/beatmaps?ids%5B%5D=1&ids%5B%5D=2"
+    );
+    REQUIRE(
+        response_cache::make_key("GET", "https://osu.ppy.sh/api/v2/me", {{"a", "1&b=2"}}) !=
+        response_cache::make_key("GET", "https://osu.ppy.sh/api/v2/me", {{"a", "1"}, {"b", "2"}})
+    );
+    REQUIRE(
+        response_cache::make_key("GET", "https://osu.ppy.sh/api/v2/me", {}, "token:abc") !=
+        response_cache::make_key("GET", "https://osu.ppy.sh/api/v2/me", {})
+    );
+}
+
+TEST_CASE("retry-after accepts seconds and http dates", "[oauth][rate-limit]") {
+    REQUIRE(rate_limit::parse_retry_after("120") == std::chrono::milliseconds(120000));
+    REQUIRE(rate_limit::parse_retry_after("Sun, 06 Nov 1994 08:49:37 GMT") == std::chrono::milliseconds(0));
+    REQUIRE_FALSE(rate_limit::parse_retry_after("soon").has_value());
+    REQUIRE(rate_limit::host_key("https://Osu.ppy.sh/api/v2") == "osu.ppy.sh");
+    REQUIRE(rate_limit::host_key("http://127.0.0.1:8080") == "127.0.0.1:8080");
+}
+
+static test_helper::HttpResponse token_response() {
+    return json_response({{"access_token", "token"}, {"expires_in", 3600}, {"token_type", "Bearer"}});
+}
+
+// ids[]=1&ids[]=2 (cpr encodes the brackets)
+static std::vector<int32_t> query_ids(const std::string& query) {
+    std::vector<int32_t> ids;
+    size_t start = 0;
+
+    while (start < query.size()) {
+        const size_t end = std::min(query.find('&', start), query.size());
+        const size_t equals = query.find('=', start);
+
+        if (equals < end) {
+            ids.push_back(std::stoi(query.substr(equals + 1, end - equals - 1)));
+        }
+
+        start = end + 1;
+    }
+
+    return ids;
+}
+
+TEST_CASE("beatmap resolver coalesces lookups into batches", "[osu-api][api]") {
+    std::atomic<int> batches = 0;
+    std::atomic<size_t> largest_batch = 0;
+
+    test_helper::LocalServer server([&](const test_helper::HttpRequest& request) {
+        if (request.path == "/oauth/token") {
+            return token_response();
+        }
+
+        const auto ids = query_ids(request.query);
+        batches++;
+        largest_batch = std::max(largest_batch.load(), ids.size());
+
+        nlohmann::json beatmaps = nlohmann::json::array();
+        for (const auto id : ids) {
+            // 13 was "deleted"
+            if (id != 13) {
+                beatmaps.push_back({{"id", id}, {"beatmapset_id", id * 10}, {"checksum", std::to_string(id)}});
+            }
+        }
+
+        return json_response({{"beatmaps", beatmaps}});
+    });
+
+    OsuV2API api(server.url());
+    api.set_auth_data({.client_id = "id", .client_secret = "secret", .grant_type = "client_credentials"});
+
+    std::vector<int32_t> ids;
+    for (int32_t id = 1; id <= 120; id++) {
+        ids.push_back(id);
+    }
+
+    // full batches go out by count and resolve_all flushes the rest, the window never expires
+    BeatmapResolver resolver(api, {.window = std::chrono::hours(1)});
+    const auto duplicate = resolver.resolve(7);
+    const auto beatmaps = resolver.resolve_all(ids);
+
+    REQUIRE(beatmaps.size() == ids.size());
+    REQUIRE(batches.load() == 3);
+    REQUIRE(largest_batch.load() == 50);
+    REQUIRE_FALSE(beatmaps[12].has_value());
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (ids[i] != 13) {
+            REQUIRE(beatmaps[i].has_value());
+            REQUIRE(beatmaps[i]->id == ids[i]);
+            REQUIRE(beatmaps[i]->beatmapset_id == ids[i] * 10);
+        }
+    }
+
+    REQUIRE(duplicate.get().has_value());
+    REQUIRE(duplicate.get()->id == 7);
+}
+
+static nlohmann::json collection_beatmaps_body(int32_t count) {
+    nlohmann::json beatmaps = nlohmann::json::array();
+    nlohmann::json beatmapsets = nlohmann::json::array();
+
+    for (int32_t i = 1; i <= count; i++) {
+        beatmaps.push_back({{"id", i}, {"beatmapset_id", i / 2}, {"checksum", std::to_string(i)}, {"bpm", 180.5}});
+        if (i % 2 == 0) {
+            beatmapsets.push_back({{"id", i / 2}, {"title", "set " + std::to_string(i / 2)}});
+        }
+    }
+
+    return {{"hasMore", false}, {"beatmaps", beatmaps}, {"beatmapsets", beatmapsets}};
+}
+
+TEST_CASE("streamed decoder fills streamed arrays and the remaining fields", "[osu-collector][api]") {
+    json_stream::Decoder<OsuCollectorCollectionBeatmapsResponse> decoder;
+    decoder.stream_array("beatmaps", &OsuCollectorCollectionBeatmapsResponse::beatmaps);
+
+    REQUIRE(decoder.parse(collection_beatmaps_body(10).dump()));
+
+    const auto response = decoder.take();
+    REQUIRE(response.has_value());
+    REQUIRE(response->beatmaps.size() == 10);
+    REQUIRE(response->beatmaps.back().id == 10);
+    REQUIRE(response->beatmaps.back().bpm == 180.5);
+    REQUIRE(response->beatmapsets.size() == 5);
+    REQUIRE(response->beatmapsets.front().title == "set 1");
+
+    REQUIRE_FALSE(decoder.parse(std::string_view(R"({"beatmaps": [{"id": 1}, )")));
+    REQUIRE_FALSE(decoder.take().has_value());
+}
+
+TEST_CASE("osu collector api streams large collections", "[osu-collector][api]") {
+    const std::string body = collection_beatmaps_body(5000).dump();
+
+    test_helper::LocalServer server([&body](const test_helper::HttpRequest& request) {
+        if (request.path != "/collections/7/beatmapsv3") {
+            test_helper::HttpResponse response;
+            response.status = 404;
+            response.body = R"({"error": "not found"})";
+            return response;
+        }
+
+        test_helper::HttpResponse response;
+        response.headers = {{"Content-Type", "application/json"}, {"Cache-Control", "max-age=60"}};
+        response.body = body;
+        response.chunk_size = 16384;
+        return response;
+    });
+
+    const auto directory = test_helper::make_temp_directory("response-cache", "streamed");
+    OsuCollectorAPI api(server.url());
+    api.set_cache_options({.directory = directory});
+
+    const auto beatmaps = api.get_collection_beatmaps({.id = 7, .per_page = 5000});
+
+    REQUIRE(beatmaps.has_value());
+    REQUIRE(beatmaps->beatmaps.size() == 5000);
+    REQUIRE(beatmaps->beatmapsets.size() == 2500);
+    REQUIRE(beatmaps->beatmaps[1234].checksum == "1235");
+
+    // the streamed body was teed into the cache
+    const auto cached = api.get_collection_beatmaps({.id = 7, .per_page = 5000});
+    REQUIRE(cached.has_value());
+    REQUIRE(cached->beatmaps.size() == 5000);
+    REQUIRE(server.requests() == 1);
+
+    REQUIRE_FALSE(api.get_collection_beatmaps({.id = 8}).has_value());
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("osu collector pager prefetches a bounded number of pages", "[osu-collector][api]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest& request) {
+        // cursor is the first id of the page, 5 pages of 10
+        int32_t cursor = 0;
+        if (const size_t start = request.query.find("cursor="); start != std::string::npos) {
+            cursor = std::stoi(request.query.substr(start + 7));
+        }
+
+        nlohmann::json collections = nlohmann::json::array();
+        for (int32_t id = cursor; id < cursor + 10; id++) {
+            collections.push_back({{"id", id}, {"name", "collection " + std::to_string(id)}});
+        }
+
+        const bool has_more = cursor + 10 < 50;
+        return json_response(
+            {{"hasMore", has_more},
+             {"nextPageCursor", has_more ? nlohmann::json(cursor + 10) : nlohmann::json(nullptr)},
+             {"collections", collections}}
+        );
+    });
+
+    OsuCollectorAPI api(server.url());
+    auto pager = api.page_recent_collections({}, 2);
+
+    // nothing consumed yet, only the prefetch window is requested
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    REQUIRE(server.requests() == 2);
+
+    int32_t expected = 0;
+    for (const auto& collection : *pager) {
+        REQUIRE(collection.id == expected++);
+    }
+
+    REQUIRE(expected == 50);
+    REQUIRE(pager->pages_fetched() == 5);
+    REQUIRE_FALSE(pager->failed());
+    REQUIRE_FALSE(pager->next().has_value());
+}
+
+TEST_CASE("osu collector pager aborts the page in flight when destroyed", "[osu-collector][api]") {
+    test_helper::LocalServer server([](const test_helper::HttpRequest&) {
+        // slow enough that waiting it out would be obvious
+        auto response = json_response({{"hasMore", false}, {"collections", nlohmann::json::array()}});
+        response.chunk_size = 1;
+        response.chunk_delay = std::chrono::milliseconds(100);
+        return response;
+    });
+
+    OsuCollectorAPI api(server.url());
+    auto pager = api.page_recent_collections({}, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    const auto start = std::chrono::steady_clock::now();
+    pager.reset();
+
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+}
+
 TEST_CASE("oauth base implementation authenticates against osu", "[oauth][live]") {
     if (!live_test_enabled("OSU_API_LIVE")) {
         SKIP("OSU_API_LIVE=1 is required for the live osu! API test");
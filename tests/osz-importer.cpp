@@ -0,0 +1,260 @@
+#include "clients/osz_importer.hpp"
+#include "clients/stable.hpp"
+#include "utils/md5.hpp"
+#include "helper.hpp"
+#include "local-server.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const char* TEST_OSU = "osu file format v14\n"
+                              "\n"
+                              "[General]\n"
+                              "AudioFilename: audio.mp3\n"
+                              "PreviewTime: 1000\n"
+                              "Mode: 0\n"
+                              "\n"
+                              "[Metadata]\n"
+                              "Title:Import Test\n"
+                              "TitleUnicode:Import Test\n"
+                              "Artist:osu-stuff\n"
+                              "ArtistUnicode:osu-stuff\n"
+                              "Creator:tester\n"
+                              "Version:Hard\n"
+                              "BeatmapID:123\n"
+                              "BeatmapSetID:456\n"
+                              "\n"
+                              "[Difficulty]\n"
+                              "HPDrainRate:5\n"
+                              "CircleSize:4\n"
+                              "OverallDifficulty:8\n"
+                              "ApproachRate:9\n"
+                              "SliderMultiplier:1.4\n"
+                              "SliderTickRate:1\n"
+                              "\n"
+                              "[HitObjects]\n"
+                              "256,192,1000,1,0,0:0:0:0:\n"
+                              "256,192,2000,2,0,L|300:200,1,100\n"
+                              "256,192,3000,12,0,4000,0:0:0:0:\n";
+
+struct ZipEntry {
+    std::string name;
+    std::string data;
+    bool deflate = true;
+    bool descriptor = false; // sizes after the data, like streamed zip writers do
+};
+
+static void put_u16(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+static void put_u32(std::string& out, uint32_t value) {
+    put_u16(out, value & 0xFFFF);
+    put_u16(out, value >> 16);
+}
+
+static std::string raw_deflate(const std::string& input) {
+    mz_stream stream{};
+    mz_deflateInit2(&stream, MZ_DEFAULT_LEVEL, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 8, MZ_DEFAULT_STRATEGY);
+
+    std::string output(mz_deflateBound(&stream, static_cast<mz_ulong>(input.size())) + 64, '\0');
+    stream.next_in = reinterpret_cast<unsigned char*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<mz_uint32>(input.size());
+    stream.next_out = reinterpret_cast<unsigned char*>(output.data());
+    stream.avail_out = static_cast<mz_uint32>(output.size());
+
+    mz_deflate(&stream, MZ_FINISH);
+    output.resize(stream.total_out);
+    mz_deflateEnd(&stream);
+    return output;
+}
+
+// local headers + a central directory, enough for the importer to walk
+static std::string make_zip(const std::vector<ZipEntry>& entries) {
+    std::string archive;
+    std::string central;
+    uint16_t count = 0;
+
+    for (const auto& entry : entries) {
+        const std::string data = entry.deflate ? raw_deflate(entry.data) : entry.data;
+        const auto crc = static_cast<uint32_t>(
+            mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const unsigned char*>(entry.data.data()), entry.data.size())
+        );
+        const auto offset = static_cast<uint32_t>(archive.size());
+        const uint16_t flags = entry.descriptor ? 0x08 : 0;
+        const uint16_t method = entry.deflate ? 8 : 0;
+
+        put_u32(archive, 0x04034b50);
+        put_u16(archive, 20);
+        put_u16(archive, flags);
+        put_u16(archive, method);
+        put_u32(archive, 0);
+        put_u32(archive, entry.descriptor ? 0 : crc);
+        put_u32(archive, entry.descriptor ? 0 : static_cast<uint32_t>(data.size()));
+        put_u32(archive, entry.descriptor ? 0 : static_cast<uint32_t>(entry.data.size()));
+        put_u16(archive, static_cast<uint32_t>(entry.name.size()));
+        put_u16(archive, 0);
+        archive += entry.name;
+        archive += data;
+
+        if (entry.descriptor) {
+            put_u32(archive, 0x08074b50);
+            put_u32(archive, crc);
+            put_u32(archive, static_cast<uint32_t>(data.size()));
+            put_u32(archive, static_cast<uint32_t>(entry.data.size()));
+        }
+
+        put_u32(central, 0x02014b50);
+        put_u16(central, 20);
+        put_u16(central, 20);
+        put_u16(central, flags);
+        put_u16(central, method);
+        put_u32(central, 0);
+        put_u32(central, crc);
+        put_u32(central, static_cast<uint32_t>(data.size()));
+        put_u32(central, static_cast<uint32_t>(entry.data.size()));
+        put_u16(central, static_cast<uint32_t>(entry.name.size()));
+        put_u32(central, 0);
+        put_u32(central, 0);
+        put_u32(central, 0);
+        put_u32(central, offset);
+        central += entry.name;
+        count++;
+    }
+
+    const auto central_offset = static_cast<uint32_t>(archive.size());
+    archive += central;
+
+    put_u32(archive, 0x06054b50);
+    put_u32(archive, 0);
+    put_u16(archive, count);
+    put_u16(archive, count);
+    put_u32(archive, static_cast<uint32_t>(central.size()));
+    put_u32(archive, central_offset);
+    put_u16(archive, 0);
+    return archive;
+}
+
+static std::string fake_audio(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<char>((i * 131) & 0xFF);
+    }
+    return data;
+}
+
+static bool feed(OszImporter& importer, const std::string& archive, size_t chunk_size) {
+    for (size_t offset = 0; offset < archive.size(); offset += chunk_size) {
+        if (!importer.write(archive.data() + offset, std::min(chunk_size, archive.size() - offset))) {
+            return false;
+        }
+    }
+
+    return importer.finish();
+}
+
+TEST_CASE("osz importer extracts entries as they stream in", "[import]") {
+    const std::string audio = fake_audio(300 * 1024);
+    const std::string archive = make_zip({
+        {.name = "Import Test [Hard].osu", .data = TEST_OSU},
+        {.name = "audio.mp3", .data = audio, .deflate = false},
+        {.name = "sb/", .data = "", .deflate = false},
+        {.name = "sb/bg.jpg", .data = std::string(50000, 'x'), .descriptor = true},
+    });
+
+    const auto folder = test_helper::make_temp_directory("import", "stream") / "456 osu-stuff - Import Test";
+    std::vector<LegacyBeatmap> imported;
+    OszImporter importer(folder, [&imported](const LegacyBeatmap& beatmap) { imported.push_back(beatmap); });
+
+    // tiny chunks so headers, data and descriptors get split everywhere
+    REQUIRE(feed(importer, archive, 7));
+    REQUIRE(importer.files().size() == 3);
+    REQUIRE(test_helper::read_file(folder / "Import Test [Hard].osu") == TEST_OSU);
+    REQUIRE(test_helper::read_file(folder / "audio.mp3") == audio);
+    REQUIRE(test_helper::read_file(folder / "sb" / "bg.jpg") == std::string(50000, 'x'));
+
+    REQUIRE(imported.size() == 1);
+    const auto& beatmap = imported.front();
+    REQUIRE(beatmap.md5 == binary::md5_hex(TEST_OSU));
+    REQUIRE(beatmap.title == "Import Test");
+    REQUIRE(beatmap.difficulty == "Hard");
+    REQUIRE(beatmap.folder_name == "456 osu-stuff - Import Test");
+    REQUIRE(beatmap.osu_file_name == "Import Test [Hard].osu");
+    REQUIRE(beatmap.beatmap_id == 456);
+    REQUIRE(beatmap.difficulty_id == 123);
+    REQUIRE(beatmap.hitcircle == 1);
+    REQUIRE(beatmap.sliders == 1);
+    REQUIRE(beatmap.spinners == 1);
+    REQUIRE(beatmap.total_time == 4000);
+
+    StableClient client(ClientOptions{.osu_path = "", .lazer_realm_path = "", .lazer_files_path = ""});
+    REQUIRE(client.add_beatmap(beatmap) != nullptr);
+    REQUIRE(client.add_beatmap(beatmap) == nullptr);
+    REQUIRE(client.get_beatmap(beatmap.md5) != nullptr);
+    REQUIRE(client.get_beatmapset(456) != nullptr);
+    REQUIRE(client.get_beatmapset(456)->beatmaps.size() == 1);
+}
+
+TEST_CASE("osz importer rejects broken archives", "[import]") {
+    const auto folder = test_helper::make_temp_directory("import", "broken");
+
+    SECTION("entries can't escape the folder") {
+        OszImporter importer(folder / "set", nullptr);
+        REQUIRE_FALSE(feed(importer, make_zip({{.name = "../escape.txt", .data = "nope"}}), 4096));
+        REQUIRE_FALSE(std::filesystem::exists(folder / "escape.txt"));
+    }
+
+    SECTION("truncated archives fail on finish") {
+        const std::string archive = make_zip({{.name = "audio.mp3", .data = fake_audio(10000)}});
+        OszImporter importer(folder / "set", nullptr);
+        REQUIRE(importer.write(archive.data(), archive.size() / 2));
+        REQUIRE_FALSE(importer.finish());
+        REQUIRE_FALSE(importer.error().empty());
+    }
+
+    SECTION("corrupted data fails the crc check") {
+        std::string archive = make_zip({{.name = "audio.mp3", .data = fake_audio(10000), .deflate = false}});
+        archive[100] = static_cast<char>(archive[100] ^ 0xFF);
+        OszImporter importer(folder / "set", nullptr);
+        REQUIRE_FALSE(feed(importer, archive, 4096));
+    }
+}
+
+TEST_CASE("download manager imports archives while they download", "[import][download]") {
+    const std::string archive = make_zip({
+        {.name = "Import Test [Hard].osu", .data = TEST_OSU},
+        {.name = "audio.mp3", .data = fake_audio(200 * 1024)},
+    });
+
+    test_helper::LocalServer server([&archive](const test_helper::HttpRequest&) {
+        test_helper::HttpResponse response;
+        response.headers = {{"Content-Type", "application/octet-stream"}};
+        response.body = archive;
+        response.chunk_size = 4096;
+        return response;
+    });
+
+    const auto songs = test_helper::make_temp_directory("import", "download");
+    std::mutex mutex;
+    std::vector<LegacyBeatmap> imported;
+
+    auto importer = std::make_shared<OszImporter>(songs / "456 osu-stuff - Import Test", [&](const LegacyBeatmap& beatmap) {
+        std::scoped_lock lock(mutex);
+        imported.push_back(beatmap);
+    });
+
+    DownloadManager manager({{.name = "local", .url_template = server.url() + "/d/{key}", .max_connections = 1}},
+                            {.directory = songs / "downloads", .max_concurrent = 1});
+
+    const auto task = manager.enqueue("456", "456.osz", importer);
+    manager.wait();
+
+    REQUIRE(task->state == DownloadState::COMPLETED);
+    REQUIRE(test_helper::read_file(songs / "456 osu-stuff - Import Test" / "Import Test [Hard].osu") == TEST_OSU);
+    REQUIRE(imported.size() == 1);
+    REQUIRE(imported.front().md5 == binary::md5_hex(TEST_OSU));
+}
@@ -1,3 +1,6 @@
+#include "utils/binary.hpp"
+#include "utils/gzip.hpp"
+#include "utils/md5.hpp"
 #include "utils/thread_pool.hpp"
 
 #include <catch2/catch_test_macros.hpp>
@@ -6,7 +9,9 @@
 #include <chrono>
 #include <latch>
 #include <mutex>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -120,3 +125,186 @@ TEST_CASE("thread pool", "[utils][thread_pool]") {
         REQUIRE_THROWS_AS(throw_future.get(), std::runtime_error);
     }
 }
+
+TEST_CASE("gzip source inflates while a cursor reads", "[utils][gzip]") {
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> second;
+
+    for (int i = 0; i < 100000; i++) {
+        binary::write_i32(first, i);
+    }
+    binary::write_string2(second, std::string(70000, 's'));
+    binary::write_i64(second, -5);
+
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> member;
+    REQUIRE(binary::gzip_compress(first, member));
+    compressed.insert(compressed.end(), member.begin(), member.end());
+
+    // the streamed writer has to produce the same member as the buffered one
+    std::stringstream streamed;
+    {
+        binary::GzipWriter writer(streamed, MZ_BEST_COMPRESSION);
+        REQUIRE(writer.append(second.data(), 1000));
+        REQUIRE(writer.append(second.data() + 1000, second.size() - 1000));
+        REQUIRE(writer.finish());
+    }
+    const std::string streamed_member = streamed.str();
+    std::vector<uint8_t> buffered;
+    REQUIRE(binary::gzip_compress(second, buffered));
+    REQUIRE(streamed_member == std::string(buffered.begin(), buffered.end()));
+    compressed.insert(compressed.end(), streamed_member.begin(), streamed_member.end());
+
+    std::vector<uint8_t> expected;
+    REQUIRE(binary::gzip_decompress(compressed, expected));
+    REQUIRE(expected.size() == first.size() + second.size());
+
+    // tiny input chunks, every read crosses a refill somewhere
+    std::istringstream input(std::string(compressed.begin(), compressed.end()));
+    binary::GzipSource source(input, 7);
+    binary::BinaryCursor cursor;
+    source.attach(cursor);
+
+    for (int i = 0; i < 100000; i++) {
+        REQUIRE(binary::read_i32(cursor) == i);
+    }
+    // longer than the window
+    REQUIRE(binary::read_string2(cursor) == std::string(70000, 's'));
+    REQUIRE(binary::read_i64(cursor) == -5);
+    REQUIRE(source.position(cursor) == expected.size());
+    REQUIRE_THROWS(binary::read_u8(cursor));
+
+    // a broken checksum is caught at the end of the member
+    compressed[member.size() - 8] ^= 0xFF;
+    std::istringstream corrupted(std::string(compressed.begin(), compressed.end()));
+    binary::GzipSource broken(corrupted);
+    broken.attach(cursor);
+    REQUIRE_THROWS(binary::skip(cursor, first.size()));
+}
+
+TEST_CASE("parallel gzip writer produces one regular member", "[utils][gzip]") {
+    std::vector<uint8_t> input;
+
+    for (int i = 0; i < 400000; i++) {
+        binary::write_i32(input, i % 1000);
+        binary::write_string2(input, "beatmap " + std::to_string(i % 77));
+    }
+
+    for (const size_t size : {size_t(0), size_t(100), input.size()}) {
+        const std::vector<uint8_t> data(input.begin(), input.begin() + static_cast<std::ptrdiff_t>(size));
+        std::stringstream output;
+
+        {
+            // small blocks and few in flight, so the ordering actually gets exercised
+            binary::ParallelGzipWriter writer(output, 6, 64 * 1024, 2);
+            REQUIRE(writer.append(data.data(), data.size() / 2));
+            REQUIRE(writer.append(data.data() + data.size() / 2, data.size() - data.size() / 2));
+            REQUIRE(writer.finish());
+            REQUIRE_FALSE(writer.append(data.data(), data.size()));
+        }
+
+        const std::string compressed = output.str();
+        std::vector<uint8_t> inflated;
+        REQUIRE(binary::gzip_decompress(std::vector<uint8_t>(compressed.begin(), compressed.end()), inflated));
+        REQUIRE(inflated == data);
+
+        std::istringstream stream(compressed);
+        binary::GzipSource source(stream);
+        binary::BinaryCursor cursor;
+        source.attach(cursor);
+        REQUIRE_NOTHROW(binary::skip(cursor, data.size()));
+        REQUIRE_THROWS(binary::read_u8(cursor));
+    }
+}
+
+TEST_CASE("md5 matches known digests", "[utils][md5]") {
+    REQUIRE(binary::md5_hex("") == "d41d8cd98f00b204e9800998ecf8427e");
+    REQUIRE(binary::md5_hex("abc") == "900150983cd24fb0d6963f7d28e17f72");
+
+    std::string data(100000, '\0');
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>((i * 131) & 0xFF);
+    }
+
+    binary::Md5 md5;
+    for (size_t offset = 0; offset < data.size(); offset += 77) {
+        md5.update(data.data() + offset, std::min<size_t>(77, data.size() - offset));
+    }
+    REQUIRE(md5.hex() == binary::md5_hex(data));
+}
+
+TEST_CASE("binary uleb128 and string views", "[utils][binary]") {
+    std::vector<uint8_t> buffer;
+    const std::vector<uint32_t> values = {0, 1, 127, 128, 300, 16383, 16384, 2097151, 2097152, 0xFFFFFFFFu};
+
+    for (const uint32_t value : values) {
+        binary::write_uleb128(buffer, value);
+    }
+
+    // the last values sit at the end of the buffer and go through the checked path
+    binary::BinaryCursor cursor;
+    binary::set_cursor(cursor, buffer);
+
+    for (const uint32_t value : values) {
+        REQUIRE(binary::read_uleb128(cursor) == value);
+    }
+    REQUIRE(cursor.offset == buffer.size());
+
+    // 6 bytes and a 5th byte above 4 bits don't fit in 32 bits
+    for (const std::vector<uint8_t>& invalid : std::vector<std::vector<uint8_t>>{
+             {0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0, 0}, {0xFF, 0xFF, 0xFF, 0xFF, 0x1F, 0, 0}, {0x80, 0x80}}) {
+        binary::set_cursor(cursor, invalid);
+        REQUIRE_THROWS(binary::read_uleb128(cursor));
+    }
+
+    std::vector<uint8_t> strings;
+    binary::write_string(strings, "");
+    binary::write_string(strings, "short");
+    binary::write_string(strings, std::string(200, 'l'));
+    binary::write_string(strings, "end");
+
+    binary::set_cursor(cursor, strings);
+    REQUIRE(binary::view_string(cursor).empty());
+    REQUIRE(binary::view_string(cursor) == "short");
+    binary::skip_string(cursor);
+    const std::string_view last = binary::view_string(cursor);
+    REQUIRE(last == "end");
+    REQUIRE(last.data() == reinterpret_cast<const char*>(strings.data() + strings.size() - 3));
+    REQUIRE(cursor.offset == strings.size());
+
+    // a length running past the end fails instead of reading it
+    strings.pop_back();
+    binary::set_cursor(cursor, strings);
+    binary::skip_string(cursor);
+    binary::skip_string(cursor);
+    binary::skip_string(cursor);
+    REQUIRE_THROWS(binary::view_string(cursor));
+
+    const std::vector<uint8_t> bad_marker = {0x0C, 0x01, 'a'};
+    binary::set_cursor(cursor, bad_marker);
+    REQUIRE_THROWS(binary::view_string(cursor));
+}
+
+TEST_CASE("binary cursor reserve reads without checks", "[utils][binary]") {
+    std::vector<uint8_t> buffer;
+    binary::write_i32(buffer, -7);
+    binary::write_f64(buffer, 2.5);
+    binary::write_u8(buffer, 1);
+    binary::write_i16(buffer, 300);
+
+    binary::BinaryCursor cursor;
+    binary::set_cursor(cursor, buffer);
+
+    {
+        auto reader = cursor.reserve(4 + 8 + 1);
+        REQUIRE(reader.read_i32() == -7);
+        REQUIRE(reader.read_f64() == 2.5);
+        REQUIRE(reader.read_bool());
+    }
+
+    // the offset moves once the reader is done
+    REQUIRE(cursor.offset == 13);
+    REQUIRE_THROWS(cursor.reserve(3));
+    REQUIRE(cursor.offset == 13);
+    REQUIRE(binary::read_i16(cursor) == 300);
+}